@@ -0,0 +1,250 @@
+/**
+ * Checks and microbenchmark for the barcode payload kernels (GTIN, character sets, multi-part reassembly,
+ * GS1 element strings and Digital Link) in src/core.
+ * Exits with a non-zero status if a known vector does not produce the expected result.
+ *
+ * Build and run on any machine with a C compiler:
+ *   cc -O2 -std=c99 -Isrc/core bench/barcode.c src/core/InfineaBarcode.c -o barcode_bench && ./barcode_bench
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include "InfineaBarcode.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 1000000
+
+static int failures = 0;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start, size_t sink)
+{
+    printf("%-28s %8.1f ns/op  (%zu)\n", name, (now_ns() - start) / ITERATIONS, sink);
+}
+
+static void check_charset(const char *name, const char *data, size_t length, infinea_charset expected)
+{
+    infinea_charset charset = infinea_charset_detect((const uint8_t *)data, length);
+    if (charset != expected) {
+        printf("FAIL charset %s: got %d, expected %d\n", name, charset, expected);
+        failures++;
+    }
+}
+
+static void check_gtin(const char *code, int upce, uint64_t expected)
+{
+    uint64_t gtin = 0;
+    int ok = infinea_gtin14(code, strlen(code), upce, &gtin);
+    if (ok != (expected != 0) || (ok && gtin != expected)) {
+        printf("FAIL gtin %s: got %d %llu, expected %llu\n", code, ok, (unsigned long long)gtin, (unsigned long long)expected);
+        failures++;
+    }
+}
+
+static void check_gtin_scan(const char *code, infinea_gtin_symbology symbology, uint64_t expected)
+{
+    uint64_t gtin = 0;
+    int ok = infinea_gtin14_scan(code, strlen(code), symbology, &gtin);
+    if (ok != (expected != 0) || (ok && gtin != expected)) {
+        printf("FAIL gtin scan %s as %d: got %d %llu, expected %llu\n", code, symbology, ok, (unsigned long long)gtin, (unsigned long long)expected);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    // EAN-13, UPC-A with and without zero strip, EAN-8, ITF-14
+    check_gtin("4006381333931", 0, 4006381333931ULL);
+    check_gtin("036000291452", 0, 36000291452ULL);
+    check_gtin("36000291452", 0, 36000291452ULL);
+    check_gtin("0036000291452", 0, 36000291452ULL);
+    check_gtin("96385074", 0, 96385074ULL);
+    check_gtin("10012345678902", 0, 10012345678902ULL);
+    // UPC-E 0425261(4) expands to 042100005264
+    check_gtin("04252614", 0, 42100005264ULL);
+    check_gtin("04252614", 1, 42100005264ULL);
+    check_gtin("425261", 1, 42100005264ULL);
+    check_gtin("4252614", 1, 42100005264ULL);
+    // UPC-E 01234565 with last digit 5 expands to 012345000065
+    check_gtin("01234565", 1, 12345000065ULL);
+    // Wrong check digits, bad lengths and non-digits
+    check_gtin("4006381333932", 0, 0);
+    check_gtin("04252615", 1, 0);
+    check_gtin("12345", 0, 0);
+    check_gtin("40063813339A1", 0, 0);
+    check_gtin("123456789012345", 0, 0);
+    // 01234565 is also a valid EAN-8, but a UPC scan of 8 digits can only be UPC-E
+    check_gtin_scan("01234565", INFINEA_GTIN_UPC, 12345000065ULL);
+    check_gtin_scan("01234565", INFINEA_GTIN_EAN8, 1234565ULL);
+    check_gtin_scan("425261", INFINEA_GTIN_UPC, 42100005264ULL);
+    check_gtin_scan("036000291452", INFINEA_GTIN_UPC, 36000291452ULL);
+    // 14 digits are only GTIN-14 from ITF-14, never from UPC or EAN-13
+    check_gtin_scan("10012345678902", INFINEA_GTIN_UPC, 0);
+    check_gtin_scan("10012345678902", INFINEA_GTIN_EAN13, 0);
+    check_gtin_scan("10012345678902", INFINEA_GTIN_ITF14, 10012345678902ULL);
+    check_gtin_scan("4006381333931", INFINEA_GTIN_EAN13, 4006381333931ULL);
+
+    static const char catalogue[] = "4006381333931\r\n036000291452\n\n96385074\nnot a gtin\n04252614";
+    static const uint64_t expected[] = { 4006381333931ULL, 36000291452ULL, 96385074ULL, 0, 42100005264ULL };
+    uint64_t batch[8];
+    size_t count = infinea_gtin14_batch(catalogue, sizeof(catalogue) - 1, '\n', batch, 8);
+    if (count != 5 || memcmp(batch, expected, sizeof(expected)) != 0) {
+        printf("FAIL gtin batch: %zu entries\n", count);
+        failures++;
+    }
+
+    check_charset("ascii", "ABC-123\x1d" "01", 10, INFINEA_CHARSET_ASCII);
+    check_charset("utf-8", "caf\xc3\xa9", 5, INFINEA_CHARSET_UTF8);
+    check_charset("latin-1", "caf\xe9", 4, INFINEA_CHARSET_ISO8859_1);
+    check_charset("shift-jis", "\x93\xfa\x96\x7b\x8c\xea", 6, INFINEA_CHARSET_SHIFT_JIS);
+    check_charset("utf-16", "\xfe\xff\x00\x41", 4, INFINEA_CHARSET_UTF16BE);
+    check_charset("binary", "\x00\x01\x02\x03", 4, INFINEA_CHARSET_BINARY);
+
+    // Shift-JIS, UTF-8 and an escaped backslash in one ECI-tagged payload
+    static const char eci[] = "\\000020\x93\xfa\x96\x7b\\000026a\\\\b\xc3\xa9";
+    uint8_t payload[sizeof(eci)];
+    size_t payloadLength = 0;
+    infinea_text_segment segments[4];
+    size_t segmentCount = infinea_text_segments((const uint8_t *)eci, sizeof(eci) - 1, 1, payload, &payloadLength, segments, 4);
+    if (segmentCount != 2 || segments[0].charset != INFINEA_CHARSET_SHIFT_JIS || segments[0].length != 4 ||
+        segments[1].charset != INFINEA_CHARSET_UTF8 || segments[1].eci != 26 || memcmp(payload + segments[1].offset, "a\\b\xc3\xa9", 5) != 0) {
+        printf("FAIL eci segments: %zu segments\n", segmentCount);
+        failures++;
+    }
+
+    // Three parts scanned out of order, with a duplicate, an expired payload and a restarted one
+    static uint8_t arena[256];
+    uint8_t combined[64];
+    size_t combinedLength = 0;
+    infinea_assembler assembler;
+    infinea_assembler_init(&assembler, arena, sizeof(arena));
+    int results[6];
+    results[0] = infinea_assembler_add(&assembler, 7, 2, 3, (const uint8_t *)"ghi", 3, 0, combined, sizeof(combined), &combinedLength);
+    results[1] = infinea_assembler_add(&assembler, 9, 0, 2, (const uint8_t *)"xx", 2, 0, combined, sizeof(combined), &combinedLength);
+    results[2] = infinea_assembler_add(&assembler, 7, 0, 3, (const uint8_t *)"abc", 3, 10, combined, sizeof(combined), &combinedLength);
+    results[3] = infinea_assembler_add(&assembler, 7, 0, 3, (const uint8_t *)"abc", 3, 20, combined, sizeof(combined), &combinedLength);
+    size_t expired = infinea_assembler_expire(&assembler, 5000, 1000);
+    results[4] = infinea_assembler_add(&assembler, 7, 1, 3, (const uint8_t *)"def", 3, 5000, combined, sizeof(combined), &combinedLength);
+    infinea_assembler_add(&assembler, 7, 0, 3, (const uint8_t *)"abc", 3, 5000, combined, sizeof(combined), &combinedLength);
+    results[5] = infinea_assembler_add(&assembler, 7, 2, 3, (const uint8_t *)"ghi", 3, 5000, combined, sizeof(combined), &combinedLength);
+    if (results[0] != INFINEA_ASSEMBLY_PENDING || results[2] != INFINEA_ASSEMBLY_PENDING || results[3] != INFINEA_ASSEMBLY_DUPLICATE ||
+        expired != 2 || results[4] != INFINEA_ASSEMBLY_PENDING || results[5] != INFINEA_ASSEMBLY_COMPLETE ||
+        combinedLength != 9 || memcmp(combined, "abcdefghi", 9) != 0 || assembler.used != 0 || assembler.count != 0) {
+        printf("FAIL assembler\n");
+        failures++;
+    }
+
+    unsigned partIndex, partTotal;
+    uint32_t parity;
+    static const uint8_t qrPart[] = { 0x12, 0x5A, 'd', 'a', 't', 'a' };
+    if (infinea_qr_append_header(qrPart, sizeof(qrPart), &partIndex, &partTotal, &parity) != 2 || partIndex != 1 || partTotal != 3 || parity != 0x5A) {
+        printf("FAIL qr append header\n");
+        failures++;
+    }
+    infinea_assembler_add(&assembler, 3, 0, 3, (const uint8_t *)"ab", 2, 0, combined, sizeof(combined), &combinedLength);
+    infinea_assembler_add(&assembler, 3, 2, 3, (const uint8_t *)"ef", 2, 0, combined, sizeof(combined), &combinedLength);
+    uint8_t expectedParity = 'a' ^ 'b' ^ 'c' ^ 'd' ^ 'e' ^ 'f';
+    if (infinea_assembler_parity(&assembler, infinea_assembler_find(&assembler, 3), (const uint8_t *)"cd", 2) != expectedParity ||
+        infinea_assembler_parity(&assembler, NULL, (const uint8_t *)"cd", 2) != ('c' ^ 'd')) {
+        printf("FAIL assembler parity\n");
+        failures++;
+    }
+
+    // The same elements from an element string and a Digital Link URI
+    static const char elementString[] = "]d20109506000134352\x1d" "10AB-123\x1d" "17251231";
+    static const char digitalLink[] = "https://example.com/shop/01/09506000134352/10/AB%2D123?17=251231&utm=x#top";
+    infinea_gs1_element elements[8];
+    infinea_gs1_element linkElements[8];
+    size_t elementCount = infinea_gs1_parse(elementString, sizeof(elementString) - 1, elements, 8);
+    size_t linkCount = infinea_gs1_digital_link(digitalLink, sizeof(digitalLink) - 1, linkElements, 8);
+    char decoded[16];
+    size_t decodedLength = linkCount == 3 ? infinea_percent_decode(linkElements[1].value.data, linkElements[1].value.length, decoded) : 0;
+    if (elementCount != 3 || linkCount != 3 || strcmp(elements[0].ai, "01") || elements[0].check != 1 || strcmp(elements[2].ai, "17") ||
+        elements[1].value.length != 6 || elements[2].value.length != 6 || strcmp(linkElements[1].ai, "10") || !linkElements[1].escaped ||
+        decodedLength != 6 || memcmp(decoded, elements[1].value.data, 6) || linkElements[0].check != 1 || strcmp(linkElements[2].ai, "17")) {
+        printf("FAIL gs1: %zu element string, %zu digital link elements\n", elementCount, linkCount);
+        failures++;
+    }
+    static const char badCheck[] = "https://id.gs1.org/gtin/09506000134353/ser/1";
+    linkCount = infinea_gs1_digital_link(badCheck, sizeof(badCheck) - 1, linkElements, 8);
+    if (linkCount != 2 || linkElements[0].check != -1 || strcmp(linkElements[1].ai, "21")) {
+        printf("FAIL gs1 check digit\n");
+        failures++;
+    }
+    static const char grai[] = "800304719512002889";
+    elementCount = infinea_gs1_parse(grai, sizeof(grai) - 1, elements, 8);
+    if (elementCount != 1 || strcmp(elements[0].ai, "8003") || elements[0].check != 1) {
+        printf("FAIL gs1 grai\n");
+        failures++;
+    }
+    static const char upperScheme[] = "HTTPS://example.com/01/09506000134352/";
+    linkCount = infinea_gs1_digital_link(upperScheme, sizeof(upperScheme) - 1, linkElements, 8);
+    if (linkCount != 1 || strcmp(linkElements[0].ai, "01") || linkElements[0].check != 1) {
+        printf("FAIL gs1 scheme case and trailing slash\n");
+        failures++;
+    }
+    if (infinea_gs1_digital_link("https://example.com/about/us", 28, linkElements, 8) != 0) {
+        printf("FAIL gs1 plain url\n");
+        failures++;
+    }
+
+    size_t sink = 0;
+    uint64_t gtin;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += (size_t)infinea_gtin14("4006381333931", 13, 0, &gtin) + (size_t)gtin;
+    }
+    report("gtin14 EAN-13", start, sink);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += (size_t)infinea_gtin14("04252614", 8, 1, &gtin) + (size_t)gtin;
+    }
+    report("gtin14 UPC-E", start, sink);
+
+    static const char kanji[] = "\x93\xfa\x96\x7b\x8c\xea\x82\xcc\x83\x65\x83\x4c\x83\x58\x83\x67 ABC 12345";
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_charset_detect((const uint8_t *)kanji, sizeof(kanji) - 1);
+    }
+    report("charset detect Shift-JIS", start, sink);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_text_segments((const uint8_t *)eci, sizeof(eci) - 1, 1, payload, &payloadLength, segments, 4);
+    }
+    report("text segments ECI", start, sink);
+
+    static const uint8_t part[200] = { 0 };
+    static uint8_t joined[256];
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint32_t key = (uint32_t)i;
+        sink += (size_t)infinea_assembler_add(&assembler, key, 1, 2, part, sizeof(part), 0, joined, sizeof(joined), &combinedLength) + 1;
+        sink += (size_t)infinea_assembler_add(&assembler, key, 0, 2, part, 20, 0, joined, sizeof(joined), &combinedLength) + combinedLength;
+    }
+    report("assemble 2 parts", start, sink);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_gs1_digital_link(digitalLink, sizeof(digitalLink) - 1, linkElements, 8);
+    }
+    report("gs1 digital link", start, sink);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_gs1_parse(elementString, sizeof(elementString) - 1, elements, 8);
+    }
+    report("gs1 element string", start, sink);
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * Checks and load test for the DUKPT kernels in src/core: X9.24 test vectors, then encrypts payloads the way a reader
+ * does with a test BDK and decrypts them again, several payloads per KSN like the tracks of one card swipe.
+ * Exits with a non-zero status if a vector or a round trip does not match.
+ *
+ * Build and run on any machine with a C compiler:
+ *   cc -O2 -std=c99 -Isrc/core bench/dukpt.c src/core/InfineaDUKPT.c -o dukpt_bench && ./dukpt_bench [transactions]
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include "InfineaDUKPT.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PAYLOADS_PER_KSN 3
+#define PAYLOAD_LENGTH 64
+
+static int failures = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void expect(const char *what, const uint8_t *actual, const char *hex)
+{
+    char actual_hex[65];
+    size_t length = strlen(hex) / 2;
+    for (size_t i = 0; i < length; i++) {
+        snprintf(actual_hex + 2 * i, 3, "%02X", actual[i]);
+    }
+    if (memcmp(actual_hex, hex, 2 * length) != 0) {
+        printf("FAIL %s: %s, expected %s\n", what, actual_hex, hex);
+        failures++;
+    }
+}
+
+static const uint8_t kTDESBDK[16] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10 };
+static const uint8_t kAESBDK[16] = { 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10, 0xF1, 0xF1, 0xF1, 0xF1, 0xF1, 0xF1, 0xF1, 0xF1 };
+
+static void check_vectors(void)
+{
+    uint8_t out[16];
+
+    // FIPS 46 and FIPS 197 block vectors
+    static const uint8_t des_key[16] = { 0x13, 0x34, 0x57, 0x79, 0x9B, 0xBC, 0xDF, 0xF1, 0x13, 0x34, 0x57, 0x79, 0x9B, 0xBC, 0xDF, 0xF1 };
+    static const uint8_t des_plain[8] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF };
+    infinea_tdes_key tdes;
+    infinea_tdes_init(&tdes, des_key);
+    infinea_tdes_encrypt(&tdes, des_plain, out);
+    expect("des", out, "85E813540F0AB405");
+
+    uint8_t aes_key[16], aes_plain[16];
+    for (int i = 0; i < 16; i++) {
+        aes_key[i] = (uint8_t)i;
+        aes_plain[i] = (uint8_t)(i * 0x11);
+    }
+    infinea_aes128_key aes;
+    infinea_aes128_init(&aes, aes_key);
+    infinea_aes128_encrypt(&aes, aes_plain, out);
+    expect("aes", out, "69C4E0D86A7B0430D8CDB78070B4C55A");
+    infinea_aes128_decrypt(&aes, out, out);
+    expect("aes decrypt", out, "00112233445566778899AABBCCDDEEFF");
+
+    // X9.24-1 test BDK and KSN
+    uint8_t ksn[10] = { 0xFF, 0xFF, 0x98, 0x76, 0x54, 0x32, 0x10, 0xE0, 0x00, 0x01 };
+    uint8_t ipek[16];
+    infinea_dukpt_tdes_ipek(kTDESBDK, ksn, ipek);
+    expect("tdes ipek", ipek, "6AC292FAA1315B4D858AB3A3D7D5933A");
+    infinea_dukpt_tdes_key(ipek, ksn, INFINEA_DUKPT_PIN, out);
+    expect("tdes pin key", out, "042666B49184CF5C68DE9628D0397B36");
+    infinea_dukpt_tdes_key(ipek, ksn, INFINEA_DUKPT_DATA_VARIANT, out);
+    expect("tdes data variant", out, "042666B4917BCFA368DE9628D0C67BC9");
+    infinea_dukpt_tdes_key(ipek, ksn, INFINEA_DUKPT_DATA, out);
+    expect("tdes data key", out, "448D3F076D8304036A55A3D7E0055A78");
+    ksn[9] = 0x02;
+    infinea_dukpt_tdes_key(ipek, ksn, INFINEA_DUKPT_PIN, out);
+    expect("tdes pin key 2", out, "C46551CEF9FD244FAA9AD834130D3B38");
+
+    // X9.24-3 test BDK and initial key ID
+    static const uint8_t aes_ksn[12] = { 0x12, 0x34, 0x56, 0x78, 0x90, 0x12, 0x34, 0x56, 0x00, 0x00, 0x00, 0x01 };
+    uint8_t initial[16];
+    infinea_dukpt_aes_initial_key(kAESBDK, aes_ksn, initial);
+    expect("aes initial key", initial, "1273671EA26AC29AFA4D1084127652A1");
+    infinea_dukpt_aes_key(initial, aes_ksn, INFINEA_DUKPT_AES_PIN, out);
+    expect("aes pin key", out, "AF8CB133A78F8DC2D1359F18527593FB");
+}
+
+// Encrypts and decrypts transactions of one device, returns payloads per second
+static double round_trip(int aes, int usage, long transactions)
+{
+    static infinea_dukpt reader, host;
+    infinea_dukpt_init(&reader, aes ? kAESBDK : kTDESBDK, aes, usage);
+    infinea_dukpt_init(&host, aes ? kAESBDK : kTDESBDK, aes, usage);
+
+    size_t ksn_length = aes ? 12 : 10;
+    long payloads = transactions * PAYLOADS_PER_KSN;
+    uint8_t *cipher = malloc((size_t)payloads * PAYLOAD_LENGTH);
+    uint8_t *ksns = malloc((size_t)transactions * ksn_length);
+    uint8_t plain[PAYLOAD_LENGTH], decrypted[PAYLOAD_LENGTH];
+
+    for (long t = 0; t < transactions; t++) {
+        uint8_t *ksn = ksns + t * ksn_length;
+        memcpy(ksn, aes ? (const uint8_t *)"\x12\x34\x56\x78\x90\x12\x34\x56" : (const uint8_t *)"\xFF\xFF\x98\x76\x54\x32\x10\xE0", 8);
+        // Counters as a reader uses them, TDES skips values with more than 10 one bits
+        uint32_t counter = (uint32_t)t + 1;
+        if (aes) {
+            ksn[8] = (uint8_t)(counter >> 24);
+            ksn[9] = (uint8_t)(counter >> 16);
+            ksn[10] = (uint8_t)(counter >> 8);
+            ksn[11] = (uint8_t)counter;
+        }
+        else {
+            ksn[7] |= (uint8_t)((counter >> 16) & 0x1F);
+            ksn[8] = (uint8_t)(counter >> 8);
+            ksn[9] = (uint8_t)counter;
+        }
+        for (int p = 0; p < PAYLOADS_PER_KSN; p++) {
+            for (int i = 0; i < PAYLOAD_LENGTH; i++) {
+                plain[i] = (uint8_t)(t * 31 + p * 7 + i);
+            }
+            infinea_dukpt_encrypt(&reader, ksn, ksn_length, plain, PAYLOAD_LENGTH, cipher + (t * PAYLOADS_PER_KSN + p) * PAYLOAD_LENGTH);
+        }
+    }
+
+    double start = now_ms();
+    long mismatches = 0;
+    for (long t = 0; t < transactions; t++) {
+        for (int p = 0; p < PAYLOADS_PER_KSN; p++) {
+            if (!infinea_dukpt_decrypt(&host, ksns + t * ksn_length, ksn_length, cipher + (t * PAYLOADS_PER_KSN + p) * PAYLOAD_LENGTH,
+                                       PAYLOAD_LENGTH, decrypted)) {
+                mismatches++;
+                continue;
+            }
+            for (int i = 0; i < PAYLOAD_LENGTH; i++) {
+                if (decrypted[i] != (uint8_t)(t * 31 + p * 7 + i)) {
+                    mismatches++;
+                    break;
+                }
+            }
+        }
+    }
+    double elapsed = now_ms() - start;
+
+    printf("%-6s round trip      %s, %ld payloads, %llu key derivations, %llu cache hits\n", aes ? "aes" : "tdes",
+           mismatches ? "FAILED" : "ok", payloads, (unsigned long long)host.misses, (unsigned long long)host.hits);
+    if (mismatches) {
+        failures++;
+    }
+    free(cipher);
+    free(ksns);
+    return payloads / elapsed * 1e3;
+}
+
+int main(int argc, char **argv)
+{
+    long transactions = argc > 1 ? atol(argv[1]) : 20000;
+
+    check_vectors();
+    printf("tdes   throughput      %.0f payloads/s\n", round_trip(0, INFINEA_DUKPT_DATA, transactions));
+    printf("aes    throughput      %.0f payloads/s\n", round_trip(1, INFINEA_DUKPT_AES_DATA_ENCRYPT, transactions));
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
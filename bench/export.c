@@ -0,0 +1,113 @@
+/**
+ * Benchmark for the compressed batch export in src/core: compression ratio, throughput and a
+ * round-trip check over synthetic scan journal records.
+ *
+ * Build and run on any machine with a C compiler:
+ *   cc -O2 -std=c99 -Isrc/core bench/export.c src/core/InfineaExport.c -o export_bench && ./export_bench [records]
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include "InfineaExport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+} buffer;
+
+static int buffer_sink(const uint8_t *data, size_t length, void *context)
+{
+    buffer *b = context;
+    if (b->capacity - b->length < length) {
+        return -1;
+    }
+    memcpy(b->data + b->length, data, length);
+    b->length += length;
+    return 0;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Decodes the export and checks every record against the generator, returns the record count or -1
+static long verify(const buffer *file, int records)
+{
+    static uint8_t chunk[INFINEA_EXPORT_CHUNK_SIZE];
+    const uint8_t *p = file->data + 4;
+    const uint8_t *end = file->data + file->length;
+    long seen = 0;
+    char expected[128];
+
+    if (file->length < 4 || memcmp(file->data, "IJX1", 4) != 0) {
+        return -1;
+    }
+    while (p < end) {
+        uint32_t raw = get_u32(p);
+        uint32_t stored = get_u32(p + 4);
+        p += 8;
+        const uint8_t *bytes = p;
+        if (stored < raw) {
+            if (infinea_lz4_decompress(p, stored, chunk, sizeof(chunk)) != raw) {
+                return -1;
+            }
+            bytes = chunk;
+        }
+        p += stored;
+
+        for (size_t offset = 0; offset < raw;) {
+            uint32_t length = get_u32(bytes + offset + 9);
+            int n = snprintf(expected, sizeof(expected), "[\"barcodeData\",[\"0%011ld\",%ld]]", 400000000000L + seen * 7 % 9973, seen % 13);
+            if ((uint32_t)n != length || memcmp(bytes + offset + INFINEA_EXPORT_RECORD_HEADER, expected, length) != 0) {
+                return -1;
+            }
+            offset += INFINEA_EXPORT_RECORD_HEADER + length;
+            seen++;
+        }
+    }
+    return seen == records ? seen : -1;
+}
+
+int main(int argc, char **argv)
+{
+    int records = argc > 1 ? atoi(argv[1]) : 200000;
+    infinea_export_writer *writer = malloc(sizeof(*writer));
+    buffer file = { malloc((size_t)records * 64 + 1024), 0, (size_t)records * 64 + 1024 };
+    char record[128];
+
+    double start = now_ms();
+    infinea_export_begin(writer, buffer_sink, &file);
+    for (long i = 0; i < records; i++) {
+        int n = snprintf(record, sizeof(record), "[\"barcodeData\",[\"0%011ld\",%ld]]", 400000000000L + i * 7 % 9973, i % 13);
+        infinea_export_add(writer, INFINEA_EXPORT_JOURNAL, (uint64_t)i + 1, record, (size_t)n);
+    }
+    infinea_export_finish(writer);
+    double elapsed = now_ms() - start;
+
+    printf("records          %d\n", records);
+    printf("raw bytes        %llu\n", (unsigned long long)writer->raw_bytes);
+    printf("export bytes     %llu in %llu chunks\n", (unsigned long long)writer->written_bytes, (unsigned long long)writer->chunks);
+    printf("ratio            %.2fx\n", (double)writer->raw_bytes / writer->written_bytes);
+    printf("throughput       %.1f MB/s, %.0f records/s\n", writer->raw_bytes / elapsed / 1e3, records / elapsed * 1e3);
+
+    start = now_ms();
+    long verified = verify(&file, records);
+    printf("round trip       %s (%.1f ms)\n", verified == records ? "ok" : "FAILED", now_ms() - start);
+
+    free(file.data);
+    free(writer);
+    return verified == records ? 0 : 1;
+}
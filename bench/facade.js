@@ -0,0 +1,195 @@
+/**
+ * Headless benchmark for www/InfineaSDKCordova.js.
+ *
+ * Loads the JS facade in Node with cordova/exec replaced by a fake native side, then measures command
+ * round trips and event delivery through the batched event channel.
+ *
+ * Usage: node --expose-gc bench/facade.js [--latency ms] [--commands n] [--events n] [--batch n]
+ */
+'use strict';
+
+const Module = require('module');
+const path = require('path');
+const { performance, PerformanceObserver } = require('perf_hooks');
+
+const options = { latency: 0, commands: 10000, events: 200000, batch: 16 };
+for (let i = 2; i < process.argv.length; i += 2) {
+    const key = process.argv[i].replace(/^--/, '');
+    if (!(key in options)) {
+        console.error('Unknown option ' + process.argv[i]);
+        process.exit(1);
+    }
+    options[key] = Number(process.argv[i + 1]);
+}
+
+// ***** Fake native side ****
+let eventChannel = null;
+
+const nativeActions = {
+    registerEventChannel: function (success) {
+        eventChannel = success;
+    },
+    ping: function (success, error, args) {
+        success(args);
+    },
+    barcodeStartScan: function (success) {
+        success && success();
+    },
+    barcodeStopScan: function (success) {
+        success && success();
+    },
+    pogCommand: function (success, error, args) {
+        success && success(args[2] || new ArrayBuffer(0));
+    }
+};
+
+function fakeExec(success, error, service, action, args) {
+    const handler = nativeActions[action];
+    const run = function () {
+        if (handler) {
+            handler(success, error, args);
+        } else if (error) {
+            error('Unknown action ' + action);
+        }
+    };
+
+    if (options.latency > 0) {
+        setTimeout(run, options.latency);
+    } else {
+        setImmediate(run);
+    }
+}
+
+const readyHandlers = [];
+const stubs = {
+    'cordova/exec': fakeExec,
+    'cordova/channel': { onCordovaReady: { subscribe: function (fn) { readyHandlers.push(fn); } } },
+    'cordova/base64': {
+        toArrayBuffer: function (str) {
+            const buf = Buffer.from(str, 'base64');
+            return buf.buffer.slice(buf.byteOffset, buf.byteOffset + buf.length);
+        }
+    }
+};
+
+const originalRequire = Module.prototype.require;
+Module.prototype.require = function (id) {
+    return Object.prototype.hasOwnProperty.call(stubs, id) ? stubs[id] : originalRequire.apply(this, arguments);
+};
+
+global.window = {};
+const Infinea = require(path.join(__dirname, '..', 'www', 'InfineaSDKCordova.js'));
+global.window.Infinea = Infinea;
+readyHandlers.forEach(function (fn) { fn(); });
+
+// ***** Measurement ****
+const gcPauses = [];
+const observer = new PerformanceObserver(function (list) {
+    list.getEntries().forEach(function (entry) { gcPauses.push(entry.duration); });
+});
+observer.observe({ entryTypes: ['gc'] });
+
+function measure(name, ops, body, done) {
+    if (global.gc) {
+        global.gc();
+    }
+    observer.takeRecords();
+    gcPauses.length = 0;
+    const heapBefore = process.memoryUsage().heapUsed;
+    const start = performance.now();
+
+    body(function () {
+        const elapsed = performance.now() - start;
+        const heapAfter = process.memoryUsage().heapUsed;
+
+        // Let the observer collect the GC entries of this run. Entries still buffered would otherwise be counted
+        // against the next run
+        setImmediate(function () {
+            observer.takeRecords().forEach(function (entry) { gcPauses.push(entry.duration); });
+            const totalPause = gcPauses.reduce(function (a, b) { return a + b; }, 0);
+            console.log(name);
+            console.log('  ops/sec        ' + Math.round(ops * 1000 / elapsed));
+            console.log('  heap growth    ' + Math.round((heapAfter - heapBefore) / 1024) + ' KiB (' + ((heapAfter - heapBefore) / ops).toFixed(1) + ' B/op)');
+            console.log('  gc pauses      ' + gcPauses.length + ' totalling ' + totalPause.toFixed(2) + ' ms, max ' + (gcPauses.length ? Math.max.apply(null, gcPauses) : 0).toFixed(2) + ' ms');
+            done();
+        });
+    });
+}
+
+function benchCommands(done) {
+    measure('commands: barcodeStartScan round trips', options.commands, function (finish) {
+        let remaining = options.commands;
+        function next() {
+            if (remaining-- <= 0) {
+                finish();
+                return;
+            }
+            Infinea.barcodeStartScan(next, next);
+        }
+        next();
+    }, done);
+}
+
+function benchEvents(name, makeEvent, done) {
+    // Events are replayed in batches, the way native flushes them
+    const batch = [];
+    for (let i = 0; i < options.batch; i++) {
+        const event = makeEvent(i);
+        batch.push(event[0], event.length - 1);
+        for (let j = 1; j < event.length; j++) {
+            batch.push(event[j]);
+        }
+    }
+
+    measure(name, options.events, function (finish) {
+        for (let sent = 0; sent < options.events; sent += options.batch) {
+            eventChannel.apply(null, batch);
+        }
+        finish();
+    }, done);
+}
+
+let received = 0;
+Infinea.barcodeData = function (barcode, type) { received += barcode.length + type; };
+Infinea.pogEventData = function (solution, command, data) { received += data.byteLength; };
+
+// barcodeNSData the way an app decodes it, into new bytes per event, against the pooled event
+const hexBarcode = '30313233343536373839303132333435363738393031323334353637383930313233343536373839';
+Infinea.barcodeNSData = function (barcode, type) {
+    const bytes = new Uint8Array(barcode.length / 2);
+    for (let i = 0; i < bytes.length; i++) {
+        bytes[i] = parseInt(barcode.substr(2 * i, 2), 16);
+    }
+    received += bytes[0] + type;
+};
+function pooledBarcode(event) { received += event.data[0] + event.type; }
+
+const payload = new ArrayBuffer(64);
+const steps = [
+    benchCommands,
+    function (done) {
+        benchEvents('events: barcodeData', function (i) { return ['barcodeData', '0123456789012' + (i % 10), 1]; }, done);
+    },
+    function (done) {
+        benchEvents('events: pogEventData (64 byte ArrayBuffer)', function () { return ['pogEventData', 1, 2, payload]; }, done);
+    },
+    function (done) {
+        benchEvents('events: barcodeNSData (40 bytes, decoded per event)', function () { return ['barcodeNSData', hexBarcode, 1, 0, null, null, 'binary', null]; }, done);
+    },
+    function (done) {
+        Infinea.barcodeNSData = function () {};
+        Infinea.addEventHandler('barcodeNSData', pooledBarcode);
+        benchEvents('events: barcodeNSData (40 bytes, pooled event)', function () { return ['barcodeNSData', hexBarcode, 1, 0, null, null, 'binary', null]; }, done);
+    }
+];
+
+console.log('latency ' + options.latency + ' ms, ' + options.commands + ' commands, ' + options.events + ' events in batches of ' + options.batch +
+            (global.gc ? '' : ' (run with --expose-gc for stable heap numbers)'));
+
+(function run(i) {
+    if (i < steps.length) {
+        steps[i](function () { run(i + 1); });
+    } else {
+        observer.disconnect();
+    }
+})(0);
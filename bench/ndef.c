@@ -0,0 +1,206 @@
+/**
+ * Checks and microbenchmark for the NFC tag and NDEF kernels in src/core.
+ * Exits with a non-zero status if a known tag image does not parse as expected.
+ *
+ * Build and run on any machine with a C compiler:
+ *   cc -O2 -std=c99 -Isrc/core bench/ndef.c src/core/InfineaNDEF.c -o ndef_bench && ./ndef_bench
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include "InfineaNDEF.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 1000000
+
+static int failures = 0;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start, size_t sink)
+{
+    printf("%-28s %8.1f ns/op  (%zu)\n", name, (now_ns() - start) / ITERATIONS, sink);
+}
+
+static void fail(const char *what)
+{
+    printf("FAIL %s\n", what);
+    failures++;
+}
+
+// Pages 0-2 (UID, lock bytes), the capability container and a Smart Poster with a URI and a Text record
+static const uint8_t kType2Image[] = {
+    0x04, 0x11, 0x22, 0xB7, 0x33, 0x44, 0x55, 0x66, 0x77, 0x48, 0x00, 0x00,
+    0xE1, 0x10, 0x06, 0x00,
+    0x01, 0x03, 0xA0, 0x0C, 0x34,
+    0x03, 0x21,
+    0xD1, 0x02, 0x1C, 'S', 'p',
+    0x91, 0x01, 0x0C, 'U', 0x04, 'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'c', 'o', 'm',
+    0x51, 0x01, 0x08, 'T', 0x02, 'e', 'n', 'H', 'e', 'l', 'l', 'o',
+    0xFE,
+};
+
+int main(void)
+{
+    infinea_ndef_area area;
+    if (!infinea_ndef_type2_cc(kType2Image + 12, &area) || area.offset != 16 || area.size != 48 || !area.writable) {
+        fail("type 2 capability container");
+    }
+
+    // A reader starts with 16 bytes from page 3, i.e. 12 bytes of the area, and asks for the rest once
+    infinea_ndef_tlv tlv;
+    size_t needed = 0;
+    const uint8_t *data = kType2Image + area.offset;
+    size_t available = sizeof(kType2Image) - area.offset;
+    if (infinea_ndef_tlv_find(data, 12, area.size, &tlv, &needed) != INFINEA_NDEF_MORE || needed != 40) {
+        fail("tlv partial read");
+    }
+    if (infinea_ndef_tlv_find(data, available, area.size, &tlv, &needed) != INFINEA_NDEF_FOUND || tlv.tlv_offset != 5 || tlv.length != 33) {
+        fail("tlv find");
+    }
+
+    const uint8_t *message = data + tlv.value_offset;
+    infinea_ndef_record poster;
+    size_t offset = 0;
+    if (infinea_ndef_record_next(message, tlv.length, &offset, &poster) != 1 || !infinea_ndef_is_type(&poster, "Sp") || !poster.begin || !poster.end) {
+        fail("smart poster record");
+    }
+
+    infinea_ndef_record uri;
+    infinea_ndef_record text;
+    size_t inner = 0;
+    char expanded[64];
+    int utf16 = 1;
+    const uint8_t *language, *content;
+    size_t languageLength = 0, contentLength = 0;
+    if (infinea_ndef_record_next(poster.payload, poster.payload_length, &inner, &uri) != 1 || !infinea_ndef_is_type(&uri, "U") ||
+        infinea_ndef_uri(uri.payload, uri.payload_length, expanded) != 19 || strcmp(expanded, "https://example.com") != 0) {
+        fail("uri record");
+    }
+    if (infinea_ndef_record_next(poster.payload, poster.payload_length, &inner, &text) != 1 || !infinea_ndef_is_type(&text, "T") ||
+        !infinea_ndef_text(text.payload, text.payload_length, &utf16, &language, &languageLength, &content, &contentLength) ||
+        utf16 || languageLength != 2 || contentLength != 5 || memcmp(content, "Hello", 5) != 0) {
+        fail("text record");
+    }
+    if (infinea_ndef_record_next(poster.payload, poster.payload_length, &inner, &text) != 0) {
+        fail("end of message");
+    }
+
+    // Type 5 with the 8 byte capability container
+    static const uint8_t type5[] = { 0xE2, 0x40, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00 };
+    if (infinea_ndef_type5_cc(type5, sizeof(type5), &area) != 1 || area.offset != 8 || area.size != 2048 || !area.writable) {
+        fail("type 5 capability container");
+    }
+
+    // Truncated record
+    static const uint8_t truncated[] = { 0xD1, 0x01, 0x10, 'U', 0x04, 'x' };
+    offset = 0;
+    if (infinea_ndef_record_next(truncated, sizeof(truncated), &offset, &poster) != -1) {
+        fail("truncated record");
+    }
+
+    // Tag updates on the 48 byte area, 4 byte pages
+    uint8_t current[48], target[48], page[8];
+    infinea_tag_write writes[8];
+    size_t written = 0, skipped = 0;
+    memset(current, 0, sizeof(current));
+    memcpy(current, data, available);
+    memcpy(target, current, sizeof(target));
+    target[36] = 'a';
+    if (infinea_tag_plan(current, target, 48, 4, 5, 2, 0, writes, 8, &written, &skipped) != 1 || written != 1 || skipped != 11 || writes[0].offset != 36 || writes[0].empty) {
+        fail("tag plan in place");
+    }
+    if (infinea_tag_plan(current, current, 48, 4, 5, 2, 0, writes, 8, &written, &skipped) != 0 || written != 0) {
+        fail("tag plan unchanged");
+    }
+    // A longer text changes the TLV and record lengths: empty header, body, header
+    static const uint8_t longer[] = { 'e', 'n', 'H', 'e', 'l', 'l', 'o', '!' };
+    uint8_t edited[64];
+    memcpy(edited, data + tlv.value_offset, tlv.length);
+    edited[2] = 0x1D;
+    edited[23] = 0x09;
+    memcpy(edited + 25, longer, sizeof(longer));
+    memcpy(target, current, 5);
+    memset(target + 5, 0, sizeof(target) - 5);
+    if (infinea_ndef_tlv_encode(edited, tlv.length + 1, target + 5, sizeof(target) - 5) != 37) {
+        fail("tlv encode");
+    }
+    int count = infinea_tag_plan(current, target, 48, 4, 5, 2, 0, writes, 8, &written, &skipped);
+    if (count != 4 || written != 7 || skipped != 6 || !writes[0].empty || writes[0].offset != 4 || writes[1].offset != 8 || writes[2].offset != 28 ||
+        writes[2].length != 16 || writes[3].empty || writes[3].offset != 4) {
+        fail("tag plan header order");
+    }
+    infinea_tag_write_data(target, &writes[0], 5, page);
+    if (page[1] != 0x03 || page[2] != 0 || page[3] != 0xD1) {
+        fail("tag empty header");
+    }
+    if (infinea_tag_plan(current, target, 48, 4, 5, 2, 0, writes, 2, &written, &skipped) != -1) {
+        fail("tag plan capacity");
+    }
+    offset = 0;
+    if (infinea_ndef_record_next(target + 7, 34, &offset, &poster) != 1 || !infinea_ndef_is_type(&poster, "Sp") || offset != 34) {
+        fail("tag target message");
+    }
+
+    // FeliCa: two services and a block above 255 in frames of 4 blocks
+    static const infinea_felica_range ranges[] = { { 0x090F, 0, 3 }, { 0x000B, 0, 1 }, { 0x090F, 300, 2 } };
+    static const uint8_t frame1[] = { 0x02, 0x0F, 0x09, 0x0B, 0x00, 0x04, 0x80, 0x00, 0x80, 0x01, 0x80, 0x02, 0x81, 0x00 };
+    static const uint8_t frame2[] = { 0x01, 0x0F, 0x09, 0x02, 0x00, 0x2C, 0x01, 0x00, 0x2D, 0x01 };
+    uint8_t frame[1 + 2 * INFINEA_FELICA_MAX_SERVICES + 1 + (3 + INFINEA_FELICA_BLOCK) * INFINEA_FELICA_MAX_BLOCKS];
+    infinea_felica_cursor cursor = { 0, 0, 0 };
+    size_t blocks = 0;
+    if (infinea_felica_encode(ranges, 3, &cursor, 4, 16, NULL, frame, &blocks) != sizeof(frame1) || blocks != 4 || memcmp(frame, frame1, sizeof(frame1)) != 0 ||
+        infinea_felica_encode(ranges, 3, &cursor, 4, 16, NULL, frame, &blocks) != sizeof(frame2) || blocks != 2 || memcmp(frame, frame2, sizeof(frame2)) != 0 ||
+        infinea_felica_encode(ranges, 3, &cursor, 4, 16, NULL, frame, &blocks) != 0) {
+        fail("felica read frames");
+    }
+    // One service per frame, as on FeliCa Lite, with write data following the block list
+    uint8_t blockData[6 * INFINEA_FELICA_BLOCK];
+    for (size_t i = 0; i < sizeof(blockData); i++) {
+        blockData[i] = (uint8_t)(i / INFINEA_FELICA_BLOCK);
+    }
+    memset(&cursor, 0, sizeof(cursor));
+    int frames = 0;
+    size_t length;
+    while ((length = infinea_felica_encode(ranges, 3, &cursor, 4, 1, blockData, frame, &blocks)) > 0) {
+        frames++;
+        if (frames == 2 && (blocks != 1 || length != 1 + 2 + 1 + 2 + 16 || frame[1] != 0x0B || frame[6] != 3)) {
+            fail("felica write frame");
+        }
+    }
+    if (frames != 3 || cursor.ordinal != 6) {
+        fail("felica write frames");
+    }
+
+    uint8_t response[4 + 2 * INFINEA_FELICA_BLOCK] = { 0x07, 0x00, 0x00, 0x02 };
+    uint8_t status[2];
+    const uint8_t *blockRead = NULL;
+    static const uint8_t rejected[] = { 0x07, 0x01, 0xA2 };
+    if (infinea_felica_parse(response, sizeof(response), 0, 2, status, &blockRead) != 1 || blockRead != response + 4 ||
+        infinea_felica_parse(rejected, sizeof(rejected), 0, 2, status, &blockRead) != 0 || status[1] != 0xA2 ||
+        infinea_felica_parse(response, sizeof(response) - 1, 0, 2, status, &blockRead) != -1) {
+        fail("felica response");
+    }
+
+    size_t sink = 0;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        infinea_ndef_tlv_find(data, available, 48, &tlv, &needed);
+        size_t o = 0;
+        infinea_ndef_record record;
+        while (infinea_ndef_record_next(data + tlv.value_offset, tlv.length, &o, &record) == 1) {
+            sink += record.payload_length;
+        }
+    }
+    report("tlv + records", start, sink);
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
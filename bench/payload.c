@@ -0,0 +1,157 @@
+/**
+ * Checks and microbenchmark for the platform-neutral payload kernels in src/core.
+ * Exits with a non-zero status if a kernel does not produce the reference output.
+ *
+ * Build and run on any machine with a C compiler:
+ *   cc -O2 -std=c99 -Isrc/core bench/payload.c src/core/InfineaPayload.c -o payload_bench && ./payload_bench
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include "InfineaPayload.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 1000000
+
+static int failures = 0;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start, size_t bytes, size_t sink)
+{
+    double elapsed = now_ns() - start;
+    printf("%-28s %8.1f ns/op %10.1f MB/s  (%zu)\n", name, elapsed / ITERATIONS, bytes * (double)ITERATIONS / elapsed * 1e3, sink);
+}
+
+static void fail(const char *what)
+{
+    printf("FAIL %s\n", what);
+    failures++;
+}
+
+static int span_is(infinea_span span, const char *expected)
+{
+    return span.length == strlen(expected) && memcmp(span.data, expected, span.length) == 0;
+}
+
+static void check_reference(void)
+{
+    char text[64];
+    uint8_t bytes[16];
+
+    static const uint8_t raw[] = { 0x00, 0x7F, 0xA5, 0xFF, '0' };
+    if (infinea_hex_encode(raw, sizeof(raw), text) != 10 || strcmp(text, "007fa5ff30") != 0) {
+        fail("hex encode");
+    }
+    if (infinea_hex_decode("00 7F a5ff30", 12, bytes) != 5 || memcmp(bytes, raw, 5) != 0) {
+        fail("hex decode");
+    }
+    if (infinea_hex_decode("0g", 2, bytes) != SIZE_MAX || infinea_hex_decode("abc", 3, bytes) != SIZE_MAX) {
+        fail("hex decode invalid");
+    }
+    if (infinea_decimal_list(raw, sizeof(raw), text) != 16 || strcmp(text, "0,127,165,255,48") != 0) {
+        fail("decimal list");
+    }
+    if (infinea_json_escape("a\"b\\\n\x01", 6, text) != 14 || strcmp(text, "a\\\"b\\\\\\n\\u0001") != 0) {
+        fail("json escape");
+    }
+
+    // Nested template, 2 byte tags, 0x00 padding and a long form length
+    static const uint8_t tlv[] = { 0x00, 0x6F, 0x0B, 0xA5, 0x09, 0x9F, 0x38, 0x02, 0x9F, 0x66, 0x50, 0x81, 0x01, 0x41 };
+    infinea_tlv element;
+    if (infinea_tlv_find(tlv, sizeof(tlv), 0x9F38, &element) != 1 || element.length != 2 || element.value != tlv + 8) {
+        fail("tlv find nested");
+    }
+    if (infinea_tlv_find(tlv, sizeof(tlv), 0x50, &element) != 1 || element.length != 1 || element.value[0] != 0x41) {
+        fail("tlv find long length");
+    }
+    if (infinea_tlv_find(tlv, sizeof(tlv), 0x84, &element) != 0 || infinea_tlv_find(tlv, sizeof(tlv) - 1, 0x50, &element) != -1) {
+        fail("tlv find missing or truncated");
+    }
+
+    static const char track1[] = "%B4111111111111111^DOE/JOHN^2512101000000000000?";
+    infinea_track track;
+    if (!infinea_track1_parse(track1, sizeof(track1) - 1, &track) || !span_is(track.pan, "4111111111111111") || !span_is(track.name, "DOE/JOHN") ||
+        !span_is(track.expiration, "2512") || !span_is(track.service_code, "101") || !span_is(track.discretionary, "000000000000")) {
+        fail("track 1 parse");
+    }
+    static const char track2[] = ";4111111111111111=25121010000000000000?";
+    if (!infinea_track2_parse(track2, sizeof(track2) - 1, &track) || !span_is(track.pan, "4111111111111111") ||
+        !span_is(track.expiration, "2512") || !span_is(track.service_code, "101") || !span_is(track.discretionary, "0000000000000")) {
+        fail("track 2 parse");
+    }
+    if (infinea_track1_parse("%B4111^DOE", 10, &track) || infinea_track2_parse(";4111111111111111?", 18, &track)) {
+        fail("track parse malformed");
+    }
+}
+
+int main(void)
+{
+    check_reference();
+
+    static const uint8_t barcode[] = "012345678905ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const char track1[] = "%B4111111111111111^DOE/JOHN^2512101000000000000?";
+    static const char track2[] = ";4111111111111111=25121010000000000000?";
+    static const uint8_t tlv[] = { 0x6F, 0x1A, 0x84, 0x07, 0xA0, 0x00, 0x00, 0x00, 0x03, 0x10, 0x10, 0xA5, 0x0F,
+                                   0x50, 0x04, 0x56, 0x49, 0x53, 0x41, 0x9F, 0x38, 0x06, 0x9F, 0x66, 0x04, 0x9F, 0x02, 0x06 };
+    char text[sizeof(barcode) * 6 + 1];
+    uint8_t bytes[sizeof(barcode)];
+    size_t length = sizeof(barcode) - 1;
+    size_t sink = 0;
+    double start;
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_hex_encode(barcode, length, text);
+    }
+    report("hex encode", start, length, sink);
+
+    size_t hexLength = infinea_hex_encode(barcode, length, text);
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_hex_decode(text, hexLength, bytes);
+    }
+    report("hex decode", start, length, sink);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_decimal_list(barcode, length, text);
+    }
+    report("decimal list", start, length, sink);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += infinea_json_escape((const char *)barcode, length, text);
+    }
+    report("json escape", start, length, sink);
+
+    infinea_tlv element;
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += (size_t)infinea_tlv_find(tlv, sizeof(tlv), 0x9F38, &element) + element.length;
+    }
+    report("tlv find 9F38", start, sizeof(tlv), sink);
+
+    infinea_track track;
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += (size_t)infinea_track1_parse(track1, sizeof(track1) - 1, &track) + track.pan.length;
+    }
+    report("track 1 parse", start, sizeof(track1) - 1, sink);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += (size_t)infinea_track2_parse(track2, sizeof(track2) - 1, &track) + track.pan.length;
+    }
+    report("track 2 parse", start, sizeof(track2) - 1, sink);
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,795 @@
+/********* InfineaBarcode.c Barcode payload kernels *******/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "InfineaBarcode.h"
+
+#include <string.h>
+#include <strings.h>
+
+int infinea_gtin_check_digit(const char *digits, size_t length)
+{
+    unsigned sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned digit = (unsigned)(digits[length - 1 - i] - '0');
+        if (digit > 9) {
+            return -1;
+        }
+        // Weights alternate 3, 1 starting next to the check digit
+        sum += (i & 1) ? digit : digit * 3;
+    }
+    return (int)((10 - sum % 10) % 10);
+}
+
+static uint64_t digits_value(const char *digits, size_t length)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; i++) {
+        value = value * 10 + (uint64_t)(digits[i] - '0');
+    }
+    return value;
+}
+
+// Expands number system + 6 UPC-E digits into the first 11 digits of the UPC-A
+static int upce_expand(char ns, const char *body, char *upca)
+{
+    if (ns != '0' && ns != '1') {
+        return 0;
+    }
+    upca[0] = ns;
+    memset(upca + 1, '0', 10);
+    switch (body[5]) {
+        case '0': case '1': case '2':
+            upca[1] = body[0];
+            upca[2] = body[1];
+            upca[3] = body[5];
+            memcpy(upca + 8, body + 2, 3);
+            break;
+        case '3':
+            memcpy(upca + 1, body, 3);
+            memcpy(upca + 9, body + 3, 2);
+            break;
+        case '4':
+            memcpy(upca + 1, body, 4);
+            upca[10] = body[4];
+            break;
+        default:
+            memcpy(upca + 1, body, 5);
+            upca[10] = body[5];
+            break;
+    }
+    return 1;
+}
+
+// check is the scanned check digit, or 0 to compute it
+static int upce_gtin14(char ns, const char *body, char check, uint64_t *gtin)
+{
+    char upca[12];
+    if (!upce_expand(ns, body, upca)) {
+        return 0;
+    }
+    int digit = infinea_gtin_check_digit(upca, 11);
+    if (check && check - '0' != digit) {
+        return 0;
+    }
+    upca[11] = (char)('0' + digit);
+    *gtin = digits_value(upca, 12);
+    return 1;
+}
+
+int infinea_gtin14(const char *code, size_t length, int upce, uint64_t *gtin)
+{
+    if (length == 0 || length > 14) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (code[i] < '0' || code[i] > '9') {
+            return 0;
+        }
+    }
+
+    if (!upce && (length == 8 || length >= 11)) {
+        // Left padding with zeros keeps the check digit weights, so every length validates the same way
+        if (infinea_gtin_check_digit(code, length - 1) == code[length - 1] - '0') {
+            *gtin = digits_value(code, length);
+            return 1;
+        }
+        if (length != 8) {
+            return 0;
+        }
+    }
+
+    switch (length) {
+        case 6:
+            return upce_gtin14('0', code, 0, gtin);
+        case 7:
+            // Zero strip removes the number system, otherwise the check digit is missing
+            return upce_gtin14('0', code, code[6], gtin) || upce_gtin14(code[0], code + 1, 0, gtin);
+        case 8:
+            return upce_gtin14(code[0], code + 1, code[7], gtin);
+    }
+    return 0;
+}
+
+size_t infinea_gtin14_batch(const char *codes, size_t length, char separator, uint64_t *out, size_t capacity)
+{
+    size_t count = 0;
+    size_t start = 0;
+    while (start < length && count < capacity) {
+        const char *end = memchr(codes + start, separator, length - start);
+        size_t entryLength = end ? (size_t)(end - (codes + start)) : length - start;
+        // Tolerate CRLF line endings
+        if (entryLength > 0 && codes[start + entryLength - 1] == '\r') {
+            entryLength--;
+        }
+        if (entryLength > 0) {
+            uint64_t gtin = 0;
+            out[count++] = infinea_gtin14(codes + start, entryLength, 0, &gtin) ? gtin : 0;
+        }
+        start += (end ? (size_t)(end - (codes + start)) : length - start) + 1;
+    }
+    return count;
+}
+
+int infinea_gtin14_scan(const char *code, size_t length, infinea_gtin_symbology symbology, uint64_t *gtin)
+{
+    switch (symbology) {
+        case INFINEA_GTIN_UPC:
+            if (length >= 14) {
+                return 0;
+            }
+            // A UPC-A is never shorter than 11 digits, so an 8 digit UPC scan is not read as EAN-8
+            return infinea_gtin14(code, length, length <= 8, gtin);
+        case INFINEA_GTIN_UPCE:
+            return infinea_gtin14(code, length, 1, gtin);
+        case INFINEA_GTIN_EAN13:
+            if (length >= 14) {
+                return 0;
+            }
+            return infinea_gtin14(code, length, 0, gtin);
+        case INFINEA_GTIN_EAN8:
+        case INFINEA_GTIN_ITF14:
+            return infinea_gtin14(code, length, 0, gtin);
+    }
+    return 0;
+}
+
+static int is_text_control(uint8_t b)
+{
+    return b == '\t' || b == '\r' || b == '\n' || b == 0x1D || b == 0x1E || b == 0x04;
+}
+
+static int utf8_valid(const uint8_t *data, size_t length)
+{
+    size_t i = 0;
+    while (i < length) {
+        uint8_t b = data[i];
+        size_t extra;
+        uint32_t min;
+        if (b < 0x80) {
+            i++;
+            continue;
+        }
+        else if ((b & 0xE0) == 0xC0) { extra = 1; min = 0x80; }
+        else if ((b & 0xF0) == 0xE0) { extra = 2; min = 0x800; }
+        else if ((b & 0xF8) == 0xF0) { extra = 3; min = 0x10000; }
+        else return 0;
+
+        if (length - i <= extra) {
+            return 0;
+        }
+        uint32_t code = b & (0x3F >> extra);
+        for (size_t k = 1; k <= extra; k++) {
+            if ((data[i + k] & 0xC0) != 0x80) {
+                return 0;
+            }
+            code = (code << 6) | (data[i + k] & 0x3F);
+        }
+        // Overlong forms, surrogates and values past U+10FFFF
+        if (code < min || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF) {
+            return 0;
+        }
+        i += extra + 1;
+    }
+    return 1;
+}
+
+// Structurally valid Shift-JIS with more double byte characters than half width katakana
+static int shift_jis_likely(const uint8_t *data, size_t length)
+{
+    size_t doubles = 0;
+    size_t katakana = 0;
+    size_t i = 0;
+    while (i < length) {
+        uint8_t b = data[i];
+        if (b < 0x80) {
+            i++;
+        }
+        else if (b >= 0xA1 && b <= 0xDF) {
+            katakana++;
+            i++;
+        }
+        else if ((b >= 0x81 && b <= 0x9F) || (b >= 0xE0 && b <= 0xFC)) {
+            if (i + 1 >= length) {
+                return 0;
+            }
+            uint8_t trail = data[i + 1];
+            if (trail < 0x40 || trail == 0x7F || trail > 0xFC) {
+                return 0;
+            }
+            doubles++;
+            i += 2;
+        }
+        else {
+            return 0;
+        }
+    }
+    return doubles > 0 && doubles >= katakana;
+}
+
+infinea_charset infinea_charset_detect(const uint8_t *data, size_t length)
+{
+    if (length >= 2 && length % 2 == 0 && data[0] == 0xFE && data[1] == 0xFF) {
+        return INFINEA_CHARSET_UTF16BE;
+    }
+
+    int ascii = 1;
+    int c1 = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t b = data[i];
+        if ((b < 0x20 && !is_text_control(b)) || b == 0x7F) {
+            return INFINEA_CHARSET_BINARY;
+        }
+        if (b >= 0x80) {
+            ascii = 0;
+            c1 |= b <= 0x9F;
+        }
+    }
+
+    if (ascii) {
+        return INFINEA_CHARSET_ASCII;
+    }
+    if (utf8_valid(data, length)) {
+        return INFINEA_CHARSET_UTF8;
+    }
+    if (shift_jis_likely(data, length)) {
+        return INFINEA_CHARSET_SHIFT_JIS;
+    }
+    return c1 ? INFINEA_CHARSET_BINARY : INFINEA_CHARSET_ISO8859_1;
+}
+
+infinea_charset infinea_charset_for_eci(int32_t eci)
+{
+    switch (eci) {
+        case 1: case 3: return INFINEA_CHARSET_ISO8859_1;
+        case 20: return INFINEA_CHARSET_SHIFT_JIS;
+        case 25: return INFINEA_CHARSET_UTF16BE;
+        case 26: return INFINEA_CHARSET_UTF8;
+        case 27: case 170: return INFINEA_CHARSET_ASCII;
+        case 899: return INFINEA_CHARSET_BINARY;
+    }
+    return INFINEA_CHARSET_ECI;
+}
+
+static int eci_escape(const uint8_t *data, size_t length, size_t i, int32_t *eci)
+{
+    if (length - i < 7) {
+        return 0;
+    }
+    int32_t value = 0;
+    for (size_t k = 1; k <= 6; k++) {
+        if (data[i + k] < '0' || data[i + k] > '9') {
+            return 0;
+        }
+        value = value * 10 + (data[i + k] - '0');
+    }
+    *eci = value;
+    return 1;
+}
+
+size_t infinea_text_segments(const uint8_t *data, size_t length, int eci_escapes, uint8_t *payload, size_t *payload_length,
+                             infinea_text_segment *segments, size_t capacity)
+{
+    size_t count = 0;
+    size_t out = 0;
+    size_t start = 0;
+    int32_t eci = -1;
+
+    for (size_t i = 0; i < length;) {
+        if (eci_escapes && data[i] == '\\') {
+            int32_t next;
+            if (i + 1 < length && data[i + 1] == '\\') {
+                payload[out++] = '\\';
+                i += 2;
+                continue;
+            }
+            if (eci_escape(data, length, i, &next)) {
+                if (out > start) {
+                    if (count == capacity) {
+                        return 0;
+                    }
+                    segments[count++] = (infinea_text_segment){ INFINEA_CHARSET_BINARY, eci, start, out - start };
+                }
+                eci = next;
+                start = out;
+                i += 7;
+                continue;
+            }
+        }
+        payload[out++] = data[i++];
+    }
+
+    if (out > start || count == 0) {
+        if (count == capacity) {
+            return 0;
+        }
+        segments[count++] = (infinea_text_segment){ INFINEA_CHARSET_BINARY, eci, start, out - start };
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        infinea_text_segment *segment = &segments[k];
+        segment->charset = segment->eci < 0 ? infinea_charset_detect(payload + segment->offset, segment->length)
+                                            : infinea_charset_for_eci(segment->eci);
+    }
+    *payload_length = out;
+    return count;
+}
+
+void infinea_assembler_init(infinea_assembler *assembler, uint8_t *arena, size_t capacity)
+{
+    memset(assembler, 0, sizeof(*assembler));
+    assembler->arena = arena;
+    assembler->capacity = capacity;
+}
+
+// Removes a payload and compacts the arena behind its parts
+static void assembler_remove(infinea_assembler *assembler, size_t slot)
+{
+    infinea_assembly_file *file = &assembler->files[slot];
+    for (unsigned part = 0; part < file->total; part++) {
+        if (!(file->have & (1u << part))) {
+            continue;
+        }
+        size_t offset = file->offset[part];
+        size_t length = file->length[part];
+        memmove(assembler->arena + offset, assembler->arena + offset + length, assembler->used - offset - length);
+        assembler->used -= length;
+        for (size_t i = 0; i < assembler->count; i++) {
+            infinea_assembly_file *other = &assembler->files[i];
+            for (unsigned k = 0; k < other->total; k++) {
+                if ((other->have & (1u << k)) && other->offset[k] > offset) {
+                    other->offset[k] -= length;
+                }
+            }
+        }
+    }
+    assembler->files[slot] = assembler->files[--assembler->count];
+}
+
+size_t infinea_assembler_expire(infinea_assembler *assembler, uint64_t now_ms, uint64_t ttl_ms)
+{
+    size_t dropped = 0;
+    for (size_t i = assembler->count; i-- > 0;) {
+        if (now_ms - assembler->files[i].started_ms > ttl_ms) {
+            assembler_remove(assembler, i);
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+const infinea_assembly_file *infinea_assembler_find(const infinea_assembler *assembler, uint32_t key)
+{
+    for (size_t i = 0; i < assembler->count; i++) {
+        if (assembler->files[i].key == key) {
+            return &assembler->files[i];
+        }
+    }
+    return NULL;
+}
+
+uint8_t infinea_assembler_parity(const infinea_assembler *assembler, const infinea_assembly_file *file, const uint8_t *data, size_t length)
+{
+    uint8_t parity = 0;
+    for (size_t i = 0; i < length; i++) {
+        parity ^= data[i];
+    }
+    for (unsigned part = 0; file && part < file->total; part++) {
+        if (file->have & (1u << part)) {
+            const uint8_t *held = assembler->arena + file->offset[part];
+            for (size_t i = 0; i < file->length[part]; i++) {
+                parity ^= held[i];
+            }
+        }
+    }
+    return parity;
+}
+
+int infinea_assembler_add(infinea_assembler *assembler, uint32_t key, unsigned index, unsigned total,
+                          const uint8_t *data, size_t length, uint64_t now_ms,
+                          uint8_t *out, size_t out_capacity, size_t *out_length)
+{
+    if (total == 0 || total > INFINEA_ASSEMBLY_PARTS || index >= total) {
+        return INFINEA_ASSEMBLY_ERROR;
+    }
+
+    infinea_assembly_file *file = (infinea_assembly_file *)infinea_assembler_find(assembler, key);
+    if (file && file->total != total) {
+        assembler_remove(assembler, (size_t)(file - assembler->files));
+        file = NULL;
+    }
+    if (file && (file->have & (1u << index))) {
+        return INFINEA_ASSEMBLY_DUPLICATE;
+    }
+
+    if (!file) {
+        if (assembler->count == INFINEA_ASSEMBLY_FILES) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < assembler->count; i++) {
+                if (assembler->files[i].started_ms < assembler->files[oldest].started_ms) {
+                    oldest = i;
+                }
+            }
+            assembler_remove(assembler, oldest);
+        }
+        file = &assembler->files[assembler->count++];
+        memset(file, 0, sizeof(*file));
+        file->key = key;
+        file->total = (uint8_t)total;
+        file->started_ms = now_ms;
+    }
+
+    // Completion copies straight from the new part, so it only needs arena space if more parts are missing
+    size_t total_length = length;
+    for (unsigned part = 0; part < total; part++) {
+        if (file->have & (1u << part)) {
+            total_length += file->length[part];
+        }
+    }
+
+    if (file->received + 1u == total) {
+        if (total_length > out_capacity) {
+            assembler_remove(assembler, (size_t)(file - assembler->files));
+            return INFINEA_ASSEMBLY_ERROR;
+        }
+        uint8_t *p = out;
+        for (unsigned part = 0; part < total; part++) {
+            if (part == index) {
+                memcpy(p, data, length);
+                p += length;
+            }
+            else {
+                memcpy(p, assembler->arena + file->offset[part], file->length[part]);
+                p += file->length[part];
+            }
+        }
+        *out_length = (size_t)(p - out);
+        assembler_remove(assembler, (size_t)(file - assembler->files));
+        return INFINEA_ASSEMBLY_COMPLETE;
+    }
+
+    if (assembler->capacity - assembler->used < length) {
+        if (file->received == 0) {
+            assembler_remove(assembler, (size_t)(file - assembler->files));
+        }
+        return INFINEA_ASSEMBLY_ERROR;
+    }
+    memcpy(assembler->arena + assembler->used, data, length);
+    file->offset[index] = assembler->used;
+    file->length[index] = length;
+    file->have |= 1u << index;
+    file->received++;
+    assembler->used += length;
+    return INFINEA_ASSEMBLY_PENDING;
+}
+
+size_t infinea_qr_append_header(const uint8_t *data, size_t length, unsigned *index, unsigned *total, uint32_t *parity)
+{
+    if (length < 2) {
+        return 0;
+    }
+    unsigned position = data[0] >> 4;
+    unsigned count = (data[0] & 0x0F) + 1u;
+    // A single symbol is never sent with a header
+    if (count < 2 || position >= count) {
+        return 0;
+    }
+    *index = position;
+    *total = count;
+    *parity = data[1];
+    return 2;
+}
+
+// Number of digits in AIs starting with the given two digits, 0 if unassigned
+static size_t gs1_ai_length(const char *ai)
+{
+    int prefix = (ai[0] - '0') * 10 + (ai[1] - '0');
+    switch (prefix) {
+        case 0: case 1: case 2: case 3: case 10: case 11: case 12: case 13: case 15: case 16: case 17:
+        case 20: case 21: case 22: case 30: case 37:
+            return 2;
+        case 23: case 24: case 25: case 40: case 41: case 42: case 71:
+            return 3;
+        case 31: case 32: case 33: case 34: case 35: case 36: case 39: case 43:
+        case 70: case 72: case 80: case 81: case 82:
+            return 4;
+    }
+    return prefix >= 90 && prefix <= 99 ? 2 : 0;
+}
+
+// Length of the value for AIs with a predefined length, 0 for variable length AIs
+static size_t gs1_fixed_length(const char *ai)
+{
+    int prefix = (ai[0] - '0') * 10 + (ai[1] - '0');
+    switch (prefix) {
+        case 0: return 18;
+        case 1: case 2: case 3: return 14;
+        case 11: case 12: case 13: case 15: case 16: case 17: return 6;
+        case 20: return 2;
+        case 31: case 32: case 33: case 34: case 35: case 36: return 6;
+        case 41: return 13;
+    }
+    return 0;
+}
+
+static int gs1_is_ai(const char *text, size_t length)
+{
+    if (length < 2 || length > 4) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return 0;
+        }
+    }
+    return gs1_ai_length(text) == length;
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Validates the check digit of AIs that carry one, over digits starting at offset
+static int gs1_check(const char *ai, infinea_span value)
+{
+    size_t offset = 0;
+    size_t digits = 0;
+    if (!strcmp(ai, "00") || !strcmp(ai, "8017") || !strcmp(ai, "8018")) {
+        digits = 18;
+    }
+    else if (!strcmp(ai, "01") || !strcmp(ai, "02")) {
+        // Digital Link allows GTIN-8, 12 and 13 without padding
+        digits = value.length;
+        if (digits != 8 && digits != 12 && digits != 13 && digits != 14) {
+            return -1;
+        }
+    }
+    else if (!strncmp(ai, "41", 2) || !strcmp(ai, "253") || !strcmp(ai, "255")) {
+        digits = 13;
+    }
+    else if (!strcmp(ai, "8006")) {
+        digits = 14;
+    }
+    else if (!strcmp(ai, "8003")) {
+        // A leading zero, then a GTIN-13 style asset type and an optional serial
+        offset = 1;
+        digits = 13;
+    }
+    else {
+        return 0;
+    }
+    if (value.length < offset + digits) {
+        return -1;
+    }
+    const char *p = value.data + offset;
+    return infinea_gtin_check_digit(p, digits - 1) == p[digits - 1] - '0' ? 1 : -1;
+}
+
+static void gs1_element(infinea_gs1_element *element, const char *ai, size_t ai_length, const char *value, size_t length, int uri)
+{
+    memcpy(element->ai, ai, ai_length);
+    element->ai[ai_length] = '\0';
+    element->value.data = value;
+    element->value.length = length;
+    element->escaped = uri && memchr(value, '%', length) != NULL;
+    element->check = gs1_check(element->ai, element->value);
+}
+
+size_t infinea_gs1_parse(const char *data, size_t length, infinea_gs1_element *elements, size_t capacity)
+{
+    size_t i = 0;
+    if (length >= 3 && data[0] == ']') {
+        static const char *identifiers[] = { "]C1", "]d2", "]Q3", "]e0", "]J1" };
+        int gs1 = 0;
+        for (size_t k = 0; k < sizeof(identifiers) / sizeof(identifiers[0]); k++) {
+            gs1 |= !memcmp(data, identifiers[k], 3);
+        }
+        if (!gs1) {
+            return 0;
+        }
+        i = 3;
+    }
+
+    size_t count = 0;
+    while (i < length) {
+        // FNC1 in first position or as a separator
+        if (data[i] == 0x1D) {
+            i++;
+            continue;
+        }
+        const char *ai = data + i;
+        if (length - i < 2 || count == capacity || ai[0] < '0' || ai[0] > '9' || ai[1] < '0' || ai[1] > '9') {
+            return 0;
+        }
+        size_t ai_length = gs1_ai_length(ai);
+        if (ai_length == 0 || length - i < ai_length || !gs1_is_ai(ai, ai_length)) {
+            return 0;
+        }
+        i += ai_length;
+
+        size_t value_length = gs1_fixed_length(ai);
+        if (value_length) {
+            if (length - i < value_length) {
+                return 0;
+            }
+        }
+        else {
+            const char *end = memchr(data + i, 0x1D, length - i);
+            value_length = end ? (size_t)(end - (data + i)) : length - i;
+        }
+        if (value_length == 0) {
+            return 0;
+        }
+        gs1_element(&elements[count++], ai, ai_length, data + i, value_length, 0);
+        i += value_length;
+    }
+    return count;
+}
+
+// Digital Link short names of the primary keys and common qualifiers
+static const char *gs1_short_name(const char *name, size_t length)
+{
+    static const char *names[][2] = {
+        { "gtin", "01" }, { "itip", "8006" }, { "cpid", "8010" }, { "gmn", "8013" }, { "gln", "414" }, { "party", "417" },
+        { "gsrnp", "8017" }, { "gsrn", "8018" }, { "gcn", "255" }, { "sscc", "00" }, { "gdti", "253" }, { "ginc", "401" },
+        { "gsin", "402" }, { "grai", "8003" }, { "giai", "8004" }, { "cpv", "22" }, { "lot", "10" }, { "ser", "21" }, { "glnx", "254" },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i][0]) == length && !memcmp(names[i][0], name, length)) {
+            return names[i][1];
+        }
+    }
+    return NULL;
+}
+
+// Resolves a Digital Link path or query key to an AI, returns its length or 0 if the key is not an AI
+static size_t gs1_key_ai(const char *key, size_t length, const char **ai)
+{
+    if (gs1_is_ai(key, length)) {
+        *ai = key;
+        return length;
+    }
+    *ai = gs1_short_name(key, length);
+    return *ai ? strlen(*ai) : 0;
+}
+
+static int gs1_is_primary_key(const char *ai, size_t length)
+{
+    static const char *keys[] = { "01", "00", "253", "255", "401", "402", "414", "417", "8003", "8004", "8006", "8010", "8013", "8017", "8018" };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strlen(keys[i]) == length && !memcmp(keys[i], ai, length)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t infinea_gs1_digital_link(const char *uri, size_t length, infinea_gs1_element *elements, size_t capacity)
+{
+    size_t i;
+    // The scheme is case insensitive
+    if (length >= 8 && !strncasecmp(uri, "https://", 8)) {
+        i = 8;
+    }
+    else if (length >= 7 && !strncasecmp(uri, "http://", 7)) {
+        i = 7;
+    }
+    else {
+        return 0;
+    }
+
+    const char *end = memchr(uri + i, '#', length - i);
+    length = end ? (size_t)(end - uri) : length;
+    const char *query = memchr(uri + i, '?', length - i);
+    size_t path_end = query ? (size_t)(query - uri) : length;
+    const char *path = memchr(uri + i, '/', path_end - i);
+    if (!path) {
+        return 0;
+    }
+
+    // Path segments, the AI pairs start at the first primary key that leaves an even number of segments
+    enum { MAX_SEGMENTS = 32 };
+    infinea_span segments[MAX_SEGMENTS];
+    size_t segment_count = 0;
+    for (size_t p = (size_t)(path - uri) + 1; p <= path_end;) {
+        const char *slash = memchr(uri + p, '/', path_end - p);
+        size_t segment_end = slash ? (size_t)(slash - uri) : path_end;
+        if (segment_count == MAX_SEGMENTS) {
+            return 0;
+        }
+        segments[segment_count].data = uri + p;
+        segments[segment_count].length = segment_end - p;
+        segment_count++;
+        p = segment_end + 1;
+    }
+    // A trailing slash leaves an empty last segment
+    if (segment_count > 0 && segments[segment_count - 1].length == 0) {
+        segment_count--;
+    }
+
+    size_t first = segment_count;
+    for (size_t s = 0; s + 1 < segment_count; s++) {
+        const char *ai;
+        size_t ai_length = gs1_key_ai(segments[s].data, segments[s].length, &ai);
+        if (ai_length && gs1_is_primary_key(ai, ai_length) && (segment_count - s) % 2 == 0) {
+            first = s;
+            break;
+        }
+    }
+    if (first == segment_count) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t s = first; s < segment_count; s += 2) {
+        const char *ai;
+        size_t ai_length = gs1_key_ai(segments[s].data, segments[s].length, &ai);
+        if (!ai_length || segments[s + 1].length == 0 || count == capacity) {
+            return 0;
+        }
+        gs1_element(&elements[count++], ai, ai_length, segments[s + 1].data, segments[s + 1].length, 1);
+    }
+
+    if (query) {
+        for (size_t p = (size_t)(query - uri) + 1; p < length;) {
+            const char *amp = memchr(uri + p, '&', length - p);
+            size_t param_end = amp ? (size_t)(amp - uri) : length;
+            const char *equals = memchr(uri + p, '=', param_end - p);
+            if (equals) {
+                const char *ai;
+                size_t ai_length = gs1_key_ai(uri + p, (size_t)(equals - (uri + p)), &ai);
+                size_t value_length = param_end - (size_t)(equals - uri) - 1;
+                if (ai_length && value_length > 0) {
+                    if (count == capacity) {
+                        return 0;
+                    }
+                    gs1_element(&elements[count++], ai, ai_length, equals + 1, value_length, 1);
+                }
+            }
+            p = param_end + 1;
+        }
+    }
+    return count;
+}
+
+size_t infinea_percent_decode(const char *data, size_t length, char *out)
+{
+    size_t written = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '%' && length - i >= 3) {
+            int high = hex_nibble(data[i + 1]);
+            int low = hex_nibble(data[i + 2]);
+            if (high >= 0 && low >= 0) {
+                out[written++] = (char)((high << 4) | low);
+                i += 2;
+                continue;
+            }
+        }
+        out[written++] = data[i];
+    }
+    return written;
+}
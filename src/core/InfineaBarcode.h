@@ -0,0 +1,241 @@
+/********* InfineaBarcode.h Barcode payload kernels *******/
+//
+// Interpretation of decoded barcode contents: GTIN normalisation for retail symbologies,
+// character set segmentation of 2D payloads, reassembly of multi-part symbols and GS1 element strings
+// and Digital Link URIs.
+// Plain C99 with no platform dependencies, functions never allocate.
+
+#ifndef INFINEA_BARCODE_H
+#define INFINEA_BARCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "InfineaPayload.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ GS1 mod 10 check digit of the given digits, which exclude the check digit itself
+ @return the check digit 0-9, or -1 if the input contains a non-digit
+ */
+int infinea_gtin_check_digit(const char *digits, size_t length);
+
+/**
+ Normalises a retail scan to a GTIN-14 and validates its check digit.
+ Accepts EAN-8, UPC-A (12 digits, or 11 with the leading 0 stripped), EAN-13, ITF-14/DUN-14 and UPC-E
+ (6 digits, 7 with the number system stripped, or 8 with number system and check digit), which is expanded to UPC-A.
+ 8 digits are read as EAN-8 first, then as UPC-E if the EAN-8 check digit does not match.
+ @param upce nonzero if the symbology is known to be UPC-E
+ @param gtin receives the GTIN-14 as an integer, e.g. 00012345678905 as 12345678905
+ @return 1 on success, 0 if the code is not a valid GTIN
+ */
+int infinea_gtin14(const char *code, size_t length, int upce, uint64_t *gtin);
+
+/**
+ Normalises a list of codes separated by separator, e.g. a catalogue import. Empty entries are skipped.
+ @param out receives one GTIN-14 per entry, 0 for entries that are not valid GTINs
+ @return number of entries, at most capacity
+ */
+size_t infinea_gtin14_batch(const char *codes, size_t length, char separator, uint64_t *out, size_t capacity);
+
+/**
+ Retail symbologies a scan can be reported as, for infinea_gtin14_scan
+ */
+typedef enum {
+    /** UPC-A or UPC-E, when the scanner reports both as one type */
+    INFINEA_GTIN_UPC = 0,
+    INFINEA_GTIN_UPCE,
+    INFINEA_GTIN_EAN8,
+    INFINEA_GTIN_EAN13,
+    /** ITF-14 and DUN-14 */
+    INFINEA_GTIN_ITF14,
+} infinea_gtin_symbology;
+
+/**
+ Normalises a scan of a known symbology to a GTIN-14, like infinea_gtin14 but without readings the symbology cannot
+ produce: 6-8 digits of a UPC scan are always UPC-E, and UPC and EAN-13 scans of 14 digits are rejected.
+ @return 1 on success, 0 if the code is not a valid GTIN for the symbology
+ */
+int infinea_gtin14_scan(const char *code, size_t length, infinea_gtin_symbology symbology, uint64_t *gtin);
+
+/**
+ Character sets of barcode payload segments
+ */
+typedef enum {
+    /** Not text, keep the raw bytes */
+    INFINEA_CHARSET_BINARY = 0,
+    INFINEA_CHARSET_ASCII,
+    INFINEA_CHARSET_UTF8,
+    INFINEA_CHARSET_UTF16BE,
+    INFINEA_CHARSET_ISO8859_1,
+    INFINEA_CHARSET_SHIFT_JIS,
+    /** Designated by an ECI the kernels do not classify, e.g. ISO-8859-5 or Big5; decode by the segment's ECI */
+    INFINEA_CHARSET_ECI,
+} infinea_charset;
+
+/**
+ A run of payload bytes in one character set, offset is into the unescaped payload
+ */
+typedef struct {
+    infinea_charset charset;
+    /** ECI designator, -1 if the charset was detected */
+    int32_t eci;
+    size_t offset;
+    size_t length;
+} infinea_text_segment;
+
+/**
+ Guesses the character set of bytes that carry no ECI: ASCII, valid UTF-8, structurally valid Shift-JIS with
+ more double byte characters than half width katakana, ISO-8859-1 without C0/C1 controls, otherwise binary.
+ Tab, CR, LF and the GS1 separators GS, RS and EOT count as text.
+ */
+infinea_charset infinea_charset_detect(const uint8_t *data, size_t length);
+
+/**
+ Character set designated by an ECI value
+ */
+infinea_charset infinea_charset_for_eci(int32_t eci);
+
+/**
+ Splits a barcode payload into character set segments.
+ With eci_escapes, AIM ECI escape sequences (backslash and 6 digits) switch the character set of the following bytes and
+ doubled backslashes are unescaped; without it the payload is a single segment. Segments without an ECI are detected.
+ @param payload receives the unescaped bytes, at least length bytes
+ @param segments receives up to capacity segments, at least 1
+ @param payload_length receives the number of unescaped bytes
+ @return number of segments, 0 if capacity was too small
+ */
+size_t infinea_text_segments(const uint8_t *data, size_t length, int eci_escapes, uint8_t *payload, size_t *payload_length,
+                             infinea_text_segment *segments, size_t capacity);
+
+#define INFINEA_ASSEMBLY_FILES 8
+#define INFINEA_ASSEMBLY_PARTS 32
+
+/**
+ Parts of one multi-part payload, offsets are into the assembler arena
+ */
+typedef struct {
+    uint32_t key;
+    uint8_t total;
+    uint8_t received;
+    uint32_t have;
+    uint64_t started_ms;
+    size_t offset[INFINEA_ASSEMBLY_PARTS];
+    size_t length[INFINEA_ASSEMBLY_PARTS];
+} infinea_assembly_file;
+
+/**
+ Reassembles Structured Append (QR) and Macro PDF417 style payloads scanned in any order.
+ Part data is copied into a caller-owned arena; up to INFINEA_ASSEMBLY_FILES payloads can be pending at once.
+ */
+typedef struct {
+    uint8_t *arena;
+    size_t capacity;
+    size_t used;
+    size_t count;
+    infinea_assembly_file files[INFINEA_ASSEMBLY_FILES];
+} infinea_assembler;
+
+/**
+ Results of infinea_assembler_add
+ */
+enum {
+    /** The part was stored, more parts are missing */
+    INFINEA_ASSEMBLY_PENDING = 0,
+    /** The payload is complete and was written to out */
+    INFINEA_ASSEMBLY_COMPLETE = 1,
+    /** The part was already scanned and is ignored */
+    INFINEA_ASSEMBLY_DUPLICATE = 2,
+    /** Invalid index or total, or the part does not fit into the arena or out */
+    INFINEA_ASSEMBLY_ERROR = -1,
+};
+
+void infinea_assembler_init(infinea_assembler *assembler, uint8_t *arena, size_t capacity);
+
+/**
+ Drops payloads started more than ttl_ms before now_ms
+ @return number of payloads dropped
+ */
+size_t infinea_assembler_expire(infinea_assembler *assembler, uint64_t now_ms, uint64_t ttl_ms);
+
+/**
+ Adds a part. A part with a known key but a different total starts the payload over.
+ When the pending payloads are full, the oldest is dropped.
+ @param key identifies the payload, e.g. the QR parity or a Macro PDF417 file ID hash
+ @param index zero based part index, below total
+ @param total number of parts, 1 to INFINEA_ASSEMBLY_PARTS
+ @param out receives the parts in index order when the payload completes
+ @param out_length receives the payload length on completion
+ @return one of INFINEA_ASSEMBLY_PENDING, COMPLETE, DUPLICATE or ERROR
+ */
+int infinea_assembler_add(infinea_assembler *assembler, uint32_t key, unsigned index, unsigned total,
+                          const uint8_t *data, size_t length, uint64_t now_ms,
+                          uint8_t *out, size_t out_capacity, size_t *out_length);
+
+/**
+ Finds a pending payload
+ @return the payload state, NULL if no part with that key is pending
+ */
+const infinea_assembly_file *infinea_assembler_find(const infinea_assembler *assembler, uint32_t key);
+
+/**
+ XORs the bytes of the parts held for a payload and of one more part, e.g. to check a QR Structured Append parity
+ before the last part completes the payload
+ @param file pending payload from infinea_assembler_find, may be NULL
+ @return the XOR of all bytes
+ */
+uint8_t infinea_assembler_parity(const infinea_assembler *assembler, const infinea_assembly_file *file, const uint8_t *data, size_t length);
+
+/**
+ Reads a QR Structured Append header passed through in front of the symbol data: one byte with the symbol position
+ in the high nibble and the total minus one in the low nibble, followed by the parity byte
+ @param index receives the zero based position
+ @param total receives the number of symbols, 2 to 16
+ @param parity receives the parity of the whole message, which identifies it
+ @return length of the header, 0 if the data does not start with a Structured Append header
+ */
+size_t infinea_qr_append_header(const uint8_t *data, size_t length, unsigned *index, unsigned *total, uint32_t *parity);
+
+/**
+ One GS1 element, value points into the parsed payload
+ */
+typedef struct {
+    /** Application identifier, NUL terminated */
+    char ai[5];
+    infinea_span value;
+    /** The value contains %XX escapes, decode it with infinea_percent_decode */
+    int escaped;
+    /** 1 if the check digit is valid, -1 if it is not, 0 if the AI has none */
+    int check;
+} infinea_gs1_element;
+
+/**
+ Parses a GS1 element string, e.g. from GS1-128, GS1 DataMatrix or GS1 QR. A leading symbology identifier (]C1, ]d2, ]Q3, ]e0, ]J1)
+ and FNC1 characters (GS) are handled; predefined length AIs need no separator.
+ @return number of elements, 0 if the data is not a GS1 element string or has more than capacity elements
+ */
+size_t infinea_gs1_parse(const char *data, size_t length, infinea_gs1_element *elements, size_t capacity);
+
+/**
+ Parses a GS1 Digital Link URI (http or https, any domain and path prefix), e.g. https://id.gs1.org/01/09506000134352/10/ABC?17=251231.
+ Path and query AIs produce the same elements as infinea_gs1_parse, in path then query order. Short names such as gtin, lot and ser
+ are accepted. Query parameters that are not AIs are ignored.
+ @return number of elements, 0 if the data is not a Digital Link URI or has more than capacity elements
+ */
+size_t infinea_gs1_digital_link(const char *uri, size_t length, infinea_gs1_element *elements, size_t capacity);
+
+/**
+ Decodes %XX escapes
+ @param out buffer of at least length bytes
+ @return number of bytes written
+ */
+size_t infinea_percent_decode(const char *data, size_t length, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,536 @@
+/********* InfineaDUKPT.c DUKPT key derivation and decryption for testing *******/
+
+#include "InfineaDUKPT.h"
+
+#include <string.h>
+
+// DES permutations, bit 1 is the most significant bit of the input
+static const uint8_t kDESInitial[64] = {
+    58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4, 62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
+    57, 49, 41, 33, 25, 17, 9, 1, 59, 51, 43, 35, 27, 19, 11, 3, 61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7,
+};
+
+static const uint8_t kDESFinal[64] = {
+    40, 8, 48, 16, 56, 24, 64, 32, 39, 7, 47, 15, 55, 23, 63, 31, 38, 6, 46, 14, 54, 22, 62, 30, 37, 5, 45, 13, 53, 21, 61, 29,
+    36, 4, 44, 12, 52, 20, 60, 28, 35, 3, 43, 11, 51, 19, 59, 27, 34, 2, 42, 10, 50, 18, 58, 26, 33, 1, 41, 9, 49, 17, 57, 25,
+};
+
+static const uint8_t kDESChoice1[56] = {
+    57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18, 10, 2, 59, 51, 43, 35, 27, 19, 11, 3, 60, 52, 44, 36,
+    63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22, 14, 6, 61, 53, 45, 37, 29, 21, 13, 5, 28, 20, 12, 4,
+};
+
+static const uint8_t kDESChoice2[48] = {
+    14, 17, 11, 24, 1, 5, 3, 28, 15, 6, 21, 10, 23, 19, 12, 4, 26, 8, 16, 7, 27, 20, 13, 2,
+    41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48, 44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32,
+};
+
+static const uint8_t kDESShifts[16] = { 1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1 };
+
+// S-boxes combined with the P permutation, indexed by the 6 expanded bits of each box
+static const uint32_t kDESSP[8][64] = {
+    {
+        0x00808200, 0x00000000, 0x00008000, 0x00808202, 0x00808002, 0x00008202, 0x00000002, 0x00008000,
+        0x00000200, 0x00808200, 0x00808202, 0x00000200, 0x00800202, 0x00808002, 0x00800000, 0x00000002,
+        0x00000202, 0x00800200, 0x00800200, 0x00008200, 0x00008200, 0x00808000, 0x00808000, 0x00800202,
+        0x00008002, 0x00800002, 0x00800002, 0x00008002, 0x00000000, 0x00000202, 0x00008202, 0x00800000,
+        0x00008000, 0x00808202, 0x00000002, 0x00808000, 0x00808200, 0x00800000, 0x00800000, 0x00000200,
+        0x00808002, 0x00008000, 0x00008200, 0x00800002, 0x00000200, 0x00000002, 0x00800202, 0x00008202,
+        0x00808202, 0x00008002, 0x00808000, 0x00800202, 0x00800002, 0x00000202, 0x00008202, 0x00808200,
+        0x00000202, 0x00800200, 0x00800200, 0x00000000, 0x00008002, 0x00008200, 0x00000000, 0x00808002,
+    },
+    {
+        0x40084010, 0x40004000, 0x00004000, 0x00084010, 0x00080000, 0x00000010, 0x40080010, 0x40004010,
+        0x40000010, 0x40084010, 0x40084000, 0x40000000, 0x40004000, 0x00080000, 0x00000010, 0x40080010,
+        0x00084000, 0x00080010, 0x40004010, 0x00000000, 0x40000000, 0x00004000, 0x00084010, 0x40080000,
+        0x00080010, 0x40000010, 0x00000000, 0x00084000, 0x00004010, 0x40084000, 0x40080000, 0x00004010,
+        0x00000000, 0x00084010, 0x40080010, 0x00080000, 0x40004010, 0x40080000, 0x40084000, 0x00004000,
+        0x40080000, 0x40004000, 0x00000010, 0x40084010, 0x00084010, 0x00000010, 0x00004000, 0x40000000,
+        0x00004010, 0x40084000, 0x00080000, 0x40000010, 0x00080010, 0x40004010, 0x40000010, 0x00080010,
+        0x00084000, 0x00000000, 0x40004000, 0x00004010, 0x40000000, 0x40080010, 0x40084010, 0x00084000,
+    },
+    {
+        0x00000104, 0x04010100, 0x00000000, 0x04010004, 0x04000100, 0x00000000, 0x00010104, 0x04000100,
+        0x00010004, 0x04000004, 0x04000004, 0x00010000, 0x04010104, 0x00010004, 0x04010000, 0x00000104,
+        0x04000000, 0x00000004, 0x04010100, 0x00000100, 0x00010100, 0x04010000, 0x04010004, 0x00010104,
+        0x04000104, 0x00010100, 0x00010000, 0x04000104, 0x00000004, 0x04010104, 0x00000100, 0x04000000,
+        0x04010100, 0x04000000, 0x00010004, 0x00000104, 0x00010000, 0x04010100, 0x04000100, 0x00000000,
+        0x00000100, 0x00010004, 0x04010104, 0x04000100, 0x04000004, 0x00000100, 0x00000000, 0x04010004,
+        0x04000104, 0x00010000, 0x04000000, 0x04010104, 0x00000004, 0x00010104, 0x00010100, 0x04000004,
+        0x04010000, 0x04000104, 0x00000104, 0x04010000, 0x00010104, 0x00000004, 0x04010004, 0x00010100,
+    },
+    {
+        0x80401000, 0x80001040, 0x80001040, 0x00000040, 0x00401040, 0x80400040, 0x80400000, 0x80001000,
+        0x00000000, 0x00401000, 0x00401000, 0x80401040, 0x80000040, 0x00000000, 0x00400040, 0x80400000,
+        0x80000000, 0x00001000, 0x00400000, 0x80401000, 0x00000040, 0x00400000, 0x80001000, 0x00001040,
+        0x80400040, 0x80000000, 0x00001040, 0x00400040, 0x00001000, 0x00401040, 0x80401040, 0x80000040,
+        0x00400040, 0x80400000, 0x00401000, 0x80401040, 0x80000040, 0x00000000, 0x00000000, 0x00401000,
+        0x00001040, 0x00400040, 0x80400040, 0x80000000, 0x80401000, 0x80001040, 0x80001040, 0x00000040,
+        0x80401040, 0x80000040, 0x80000000, 0x00001000, 0x80400000, 0x80001000, 0x00401040, 0x80400040,
+        0x80001000, 0x00001040, 0x00400000, 0x80401000, 0x00000040, 0x00400000, 0x00001000, 0x00401040,
+    },
+    {
+        0x00000080, 0x01040080, 0x01040000, 0x21000080, 0x00040000, 0x00000080, 0x20000000, 0x01040000,
+        0x20040080, 0x00040000, 0x01000080, 0x20040080, 0x21000080, 0x21040000, 0x00040080, 0x20000000,
+        0x01000000, 0x20040000, 0x20040000, 0x00000000, 0x20000080, 0x21040080, 0x21040080, 0x01000080,
+        0x21040000, 0x20000080, 0x00000000, 0x21000000, 0x01040080, 0x01000000, 0x21000000, 0x00040080,
+        0x00040000, 0x21000080, 0x00000080, 0x01000000, 0x20000000, 0x01040000, 0x21000080, 0x20040080,
+        0x01000080, 0x20000000, 0x21040000, 0x01040080, 0x20040080, 0x00000080, 0x01000000, 0x21040000,
+        0x21040080, 0x00040080, 0x21000000, 0x21040080, 0x01040000, 0x00000000, 0x20040000, 0x21000000,
+        0x00040080, 0x01000080, 0x20000080, 0x00040000, 0x00000000, 0x20040000, 0x01040080, 0x20000080,
+    },
+    {
+        0x10000008, 0x10200000, 0x00002000, 0x10202008, 0x10200000, 0x00000008, 0x10202008, 0x00200000,
+        0x10002000, 0x00202008, 0x00200000, 0x10000008, 0x00200008, 0x10002000, 0x10000000, 0x00002008,
+        0x00000000, 0x00200008, 0x10002008, 0x00002000, 0x00202000, 0x10002008, 0x00000008, 0x10200008,
+        0x10200008, 0x00000000, 0x00202008, 0x10202000, 0x00002008, 0x00202000, 0x10202000, 0x10000000,
+        0x10002000, 0x00000008, 0x10200008, 0x00202000, 0x10202008, 0x00200000, 0x00002008, 0x10000008,
+        0x00200000, 0x10002000, 0x10000000, 0x00002008, 0x10000008, 0x10202008, 0x00202000, 0x10200000,
+        0x00202008, 0x10202000, 0x00000000, 0x10200008, 0x00000008, 0x00002000, 0x10200000, 0x00202008,
+        0x00002000, 0x00200008, 0x10002008, 0x00000000, 0x10202000, 0x10000000, 0x00200008, 0x10002008,
+    },
+    {
+        0x00100000, 0x02100001, 0x02000401, 0x00000000, 0x00000400, 0x02000401, 0x00100401, 0x02100400,
+        0x02100401, 0x00100000, 0x00000000, 0x02000001, 0x00000001, 0x02000000, 0x02100001, 0x00000401,
+        0x02000400, 0x00100401, 0x00100001, 0x02000400, 0x02000001, 0x02100000, 0x02100400, 0x00100001,
+        0x02100000, 0x00000400, 0x00000401, 0x02100401, 0x00100400, 0x00000001, 0x02000000, 0x00100400,
+        0x02000000, 0x00100400, 0x00100000, 0x02000401, 0x02000401, 0x02100001, 0x02100001, 0x00000001,
+        0x00100001, 0x02000000, 0x02000400, 0x00100000, 0x02100400, 0x00000401, 0x00100401, 0x02100400,
+        0x00000401, 0x02000001, 0x02100401, 0x02100000, 0x00100400, 0x00000000, 0x00000001, 0x02100401,
+        0x00000000, 0x00100401, 0x02100000, 0x00000400, 0x02000001, 0x02000400, 0x00000400, 0x00100001,
+    },
+    {
+        0x08000820, 0x00000800, 0x00020000, 0x08020820, 0x08000000, 0x08000820, 0x00000020, 0x08000000,
+        0x00020020, 0x08020000, 0x08020820, 0x00020800, 0x08020800, 0x00020820, 0x00000800, 0x00000020,
+        0x08020000, 0x08000020, 0x08000800, 0x00000820, 0x00020800, 0x00020020, 0x08020020, 0x08020800,
+        0x00000820, 0x00000000, 0x00000000, 0x08020020, 0x08000020, 0x08000800, 0x00020820, 0x00020000,
+        0x00020820, 0x00020000, 0x08020800, 0x00000800, 0x00000020, 0x08020020, 0x00000800, 0x00020820,
+        0x08000800, 0x00000020, 0x08000020, 0x08020000, 0x08020020, 0x08000000, 0x00020000, 0x08000820,
+        0x00000000, 0x08020820, 0x00020020, 0x08000020, 0x08020000, 0x08000800, 0x08000820, 0x00000000,
+        0x08020820, 0x00020800, 0x00020800, 0x00000820, 0x00000820, 0x00020020, 0x08000000, 0x08020800,
+    },
+};
+
+static const uint8_t kAESSbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16,
+};
+
+static const uint8_t kAESInverseSbox[256] = {
+    0x52, 0x09, 0x6A, 0xD5, 0x30, 0x36, 0xA5, 0x38, 0xBF, 0x40, 0xA3, 0x9E, 0x81, 0xF3, 0xD7, 0xFB,
+    0x7C, 0xE3, 0x39, 0x82, 0x9B, 0x2F, 0xFF, 0x87, 0x34, 0x8E, 0x43, 0x44, 0xC4, 0xDE, 0xE9, 0xCB,
+    0x54, 0x7B, 0x94, 0x32, 0xA6, 0xC2, 0x23, 0x3D, 0xEE, 0x4C, 0x95, 0x0B, 0x42, 0xFA, 0xC3, 0x4E,
+    0x08, 0x2E, 0xA1, 0x66, 0x28, 0xD9, 0x24, 0xB2, 0x76, 0x5B, 0xA2, 0x49, 0x6D, 0x8B, 0xD1, 0x25,
+    0x72, 0xF8, 0xF6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xD4, 0xA4, 0x5C, 0xCC, 0x5D, 0x65, 0xB6, 0x92,
+    0x6C, 0x70, 0x48, 0x50, 0xFD, 0xED, 0xB9, 0xDA, 0x5E, 0x15, 0x46, 0x57, 0xA7, 0x8D, 0x9D, 0x84,
+    0x90, 0xD8, 0xAB, 0x00, 0x8C, 0xBC, 0xD3, 0x0A, 0xF7, 0xE4, 0x58, 0x05, 0xB8, 0xB3, 0x45, 0x06,
+    0xD0, 0x2C, 0x1E, 0x8F, 0xCA, 0x3F, 0x0F, 0x02, 0xC1, 0xAF, 0xBD, 0x03, 0x01, 0x13, 0x8A, 0x6B,
+    0x3A, 0x91, 0x11, 0x41, 0x4F, 0x67, 0xDC, 0xEA, 0x97, 0xF2, 0xCF, 0xCE, 0xF0, 0xB4, 0xE6, 0x73,
+    0x96, 0xAC, 0x74, 0x22, 0xE7, 0xAD, 0x35, 0x85, 0xE2, 0xF9, 0x37, 0xE8, 0x1C, 0x75, 0xDF, 0x6E,
+    0x47, 0xF1, 0x1A, 0x71, 0x1D, 0x29, 0xC5, 0x89, 0x6F, 0xB7, 0x62, 0x0E, 0xAA, 0x18, 0xBE, 0x1B,
+    0xFC, 0x56, 0x3E, 0x4B, 0xC6, 0xD2, 0x79, 0x20, 0x9A, 0xDB, 0xC0, 0xFE, 0x78, 0xCD, 0x5A, 0xF4,
+    0x1F, 0xDD, 0xA8, 0x33, 0x88, 0x07, 0xC7, 0x31, 0xB1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xEC, 0x5F,
+    0x60, 0x51, 0x7F, 0xA9, 0x19, 0xB5, 0x4A, 0x0D, 0x2D, 0xE5, 0x7A, 0x9F, 0x93, 0xC9, 0x9C, 0xEF,
+    0xA0, 0xE0, 0x3B, 0x4D, 0xAE, 0x2A, 0xF5, 0xB0, 0xC8, 0xEB, 0xBB, 0x3C, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2B, 0x04, 0x7E, 0xBA, 0x77, 0xD6, 0x26, 0xE1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0C, 0x7D,
+};
+
+static uint64_t load64(const uint8_t *bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static void store64(uint64_t value, uint8_t *bytes)
+{
+    for (int i = 7; i >= 0; i--) {
+        bytes[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static uint64_t des_permute(uint64_t in, const uint8_t *table, int count, int width)
+{
+    uint64_t out = 0;
+    for (int i = 0; i < count; i++) {
+        out = (out << 1) | ((in >> (width - table[i])) & 1);
+    }
+    return out;
+}
+
+static void des_schedule(uint64_t key, uint64_t subkeys[16])
+{
+    uint64_t cd = des_permute(key, kDESChoice1, 56, 64);
+    uint32_t c = (uint32_t)(cd >> 28) & 0xFFFFFFF;
+    uint32_t d = (uint32_t)cd & 0xFFFFFFF;
+    for (int i = 0; i < 16; i++) {
+        int shift = kDESShifts[i];
+        c = ((c << shift) | (c >> (28 - shift))) & 0xFFFFFFF;
+        d = ((d << shift) | (d >> (28 - shift))) & 0xFFFFFFF;
+        subkeys[i] = des_permute(((uint64_t)c << 28) | d, kDESChoice2, 48, 56);
+    }
+}
+
+static uint64_t des_block(const uint64_t subkeys[16], uint64_t block, int decrypt)
+{
+    uint64_t permuted = des_permute(block, kDESInitial, 64, 64);
+    uint32_t l = (uint32_t)(permuted >> 32);
+    uint32_t r = (uint32_t)permuted;
+    for (int i = 0; i < 16; i++) {
+        uint64_t k = subkeys[decrypt ? 15 - i : i];
+        // The expansion as 34 bits, each box takes 6 of them at a 4 bit stride
+        uint64_t x = ((uint64_t)(r & 1) << 33) | ((uint64_t)r << 1) | (r >> 31);
+        uint32_t f = 0;
+        for (int j = 0; j < 8; j++) {
+            f |= kDESSP[j][((x >> (28 - 4 * j)) ^ (k >> (42 - 6 * j))) & 0x3F];
+        }
+        uint32_t t = l ^ f;
+        l = r;
+        r = t;
+    }
+    return des_permute(((uint64_t)r << 32) | l, kDESFinal, 64, 64);
+}
+
+void infinea_tdes_init(infinea_tdes_key *key, const uint8_t bytes[16])
+{
+    des_schedule(load64(bytes), key->subkeys[0]);
+    des_schedule(load64(bytes + 8), key->subkeys[1]);
+}
+
+void infinea_tdes_encrypt(const infinea_tdes_key *key, const uint8_t in[8], uint8_t out[8])
+{
+    uint64_t block = des_block(key->subkeys[0], load64(in), 0);
+    block = des_block(key->subkeys[1], block, 1);
+    store64(des_block(key->subkeys[0], block, 0), out);
+}
+
+void infinea_tdes_decrypt(const infinea_tdes_key *key, const uint8_t in[8], uint8_t out[8])
+{
+    uint64_t block = des_block(key->subkeys[0], load64(in), 1);
+    block = des_block(key->subkeys[1], block, 0);
+    store64(des_block(key->subkeys[0], block, 1), out);
+}
+
+static uint8_t aes_xtime(uint8_t a)
+{
+    return (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1B : 0));
+}
+
+static uint8_t aes_multiply(uint8_t a, uint8_t b)
+{
+    uint8_t product = 0;
+    while (b) {
+        if (b & 1) {
+            product ^= a;
+        }
+        a = aes_xtime(a);
+        b >>= 1;
+    }
+    return product;
+}
+
+void infinea_aes128_init(infinea_aes128_key *key, const uint8_t bytes[16])
+{
+    uint8_t *w = key->round_keys;
+    uint8_t rcon = 1;
+    memcpy(w, bytes, 16);
+    for (int i = 16; i < 176; i += 4) {
+        uint8_t t[4] = { w[i - 4], w[i - 3], w[i - 2], w[i - 1] };
+        if (i % 16 == 0) {
+            uint8_t first = t[0];
+            t[0] = kAESSbox[t[1]] ^ rcon;
+            t[1] = kAESSbox[t[2]];
+            t[2] = kAESSbox[t[3]];
+            t[3] = kAESSbox[first];
+            rcon = aes_xtime(rcon);
+        }
+        for (int j = 0; j < 4; j++) {
+            w[i + j] = w[i - 16 + j] ^ t[j];
+        }
+    }
+}
+
+void infinea_aes128_encrypt(const infinea_aes128_key *key, const uint8_t in[16], uint8_t out[16])
+{
+    uint8_t s[16], t[16];
+    for (int i = 0; i < 16; i++) {
+        s[i] = in[i] ^ key->round_keys[i];
+    }
+    for (int round = 1; round <= 10; round++) {
+        // SubBytes and ShiftRows, the state is column major
+        for (int i = 0; i < 16; i++) {
+            t[i] = kAESSbox[s[(i + 4 * (i % 4)) % 16]];
+        }
+        if (round < 10) {
+            for (int c = 0; c < 16; c += 4) {
+                uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                t[c] ^= all ^ aes_xtime(a0 ^ a1);
+                t[c + 1] ^= all ^ aes_xtime(a1 ^ a2);
+                t[c + 2] ^= all ^ aes_xtime(a2 ^ a3);
+                t[c + 3] ^= all ^ aes_xtime(a3 ^ a0);
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            s[i] = t[i] ^ key->round_keys[16 * round + i];
+        }
+    }
+    memcpy(out, s, 16);
+}
+
+void infinea_aes128_decrypt(const infinea_aes128_key *key, const uint8_t in[16], uint8_t out[16])
+{
+    uint8_t s[16], t[16];
+    for (int i = 0; i < 16; i++) {
+        s[i] = in[i] ^ key->round_keys[160 + i];
+    }
+    for (int round = 9; round >= 0; round--) {
+        // InvShiftRows and InvSubBytes
+        for (int i = 0; i < 16; i++) {
+            t[(i + 4 * (i % 4)) % 16] = kAESInverseSbox[s[i]];
+        }
+        for (int i = 0; i < 16; i++) {
+            t[i] ^= key->round_keys[16 * round + i];
+        }
+        if (round > 0) {
+            for (int c = 0; c < 16; c += 4) {
+                uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+                t[c] = aes_multiply(a0, 14) ^ aes_multiply(a1, 11) ^ aes_multiply(a2, 13) ^ aes_multiply(a3, 9);
+                t[c + 1] = aes_multiply(a0, 9) ^ aes_multiply(a1, 14) ^ aes_multiply(a2, 11) ^ aes_multiply(a3, 13);
+                t[c + 2] = aes_multiply(a0, 13) ^ aes_multiply(a1, 9) ^ aes_multiply(a2, 14) ^ aes_multiply(a3, 11);
+                t[c + 3] = aes_multiply(a0, 11) ^ aes_multiply(a1, 13) ^ aes_multiply(a2, 9) ^ aes_multiply(a3, 14);
+            }
+        }
+        memcpy(s, t, 16);
+    }
+    memcpy(out, s, 16);
+}
+
+#define DUKPT_KEY_MASK 0xC0C0C0C000000000ULL
+
+void infinea_dukpt_tdes_ipek(const uint8_t bdk[16], const uint8_t ksn[10], uint8_t ipek[16])
+{
+    uint8_t base[8], masked[16];
+    memcpy(base, ksn, 8);
+    base[7] &= 0xE0;
+
+    infinea_tdes_key key;
+    infinea_tdes_init(&key, bdk);
+    infinea_tdes_encrypt(&key, base, ipek);
+
+    store64(load64(bdk) ^ DUKPT_KEY_MASK, masked);
+    store64(load64(bdk + 8) ^ DUKPT_KEY_MASK, masked + 8);
+    infinea_tdes_init(&key, masked);
+    infinea_tdes_encrypt(&key, base, ipek + 8);
+}
+
+// Non-reversible key generation process of X9.24-1
+static void dukpt_tdes_generate(uint64_t *left, uint64_t *right, uint64_t reg)
+{
+    uint64_t subkeys[16];
+    des_schedule(*left, subkeys);
+    uint64_t new_right = des_block(subkeys, reg ^ *right, 0) ^ *right;
+
+    uint64_t masked_left = *left ^ DUKPT_KEY_MASK;
+    uint64_t masked_right = *right ^ DUKPT_KEY_MASK;
+    des_schedule(masked_left, subkeys);
+    *left = des_block(subkeys, reg ^ masked_right, 0) ^ masked_right;
+    *right = new_right;
+}
+
+void infinea_dukpt_tdes_key(const uint8_t ipek[16], const uint8_t ksn[10], int variant, uint8_t key[16])
+{
+    uint64_t left = load64(ipek), right = load64(ipek + 8);
+    uint64_t reg = load64(ksn + 2) & ~0x1FFFFFULL;
+    uint32_t counter = ((uint32_t)(ksn[7] & 0x1F) << 16) | ((uint32_t)ksn[8] << 8) | ksn[9];
+    for (uint32_t bit = 0x100000; bit; bit >>= 1) {
+        if (counter & bit) {
+            reg |= bit;
+            dukpt_tdes_generate(&left, &right, reg);
+        }
+    }
+
+    uint64_t variant_mask = variant == INFINEA_DUKPT_PIN ? 0xFFULL : variant == INFINEA_DUKPT_MAC ? 0xFF00ULL : 0xFF0000ULL;
+    store64(left ^ variant_mask, key);
+    store64(right ^ variant_mask, key + 8);
+    if (variant == INFINEA_DUKPT_DATA) {
+        infinea_tdes_key variant_key;
+        infinea_tdes_init(&variant_key, key);
+        infinea_tdes_encrypt(&variant_key, key, key);
+        infinea_tdes_encrypt(&variant_key, key + 8, key + 8);
+    }
+}
+
+// Derivation data of X9.24-3 for an AES-128 key
+static void dukpt_aes_derivation(uint8_t data[16], uint16_t usage, const uint8_t initial_key_id[8], uint32_t counter, int initial)
+{
+    data[0] = 0x01;
+    data[1] = 0x01;
+    data[2] = (uint8_t)(usage >> 8);
+    data[3] = (uint8_t)usage;
+    data[4] = 0x00;
+    data[5] = 0x02;
+    data[6] = 0x00;
+    data[7] = 0x80;
+    if (initial) {
+        memcpy(data + 8, initial_key_id, 8);
+        return;
+    }
+    memcpy(data + 8, initial_key_id + 4, 4);
+    data[12] = (uint8_t)(counter >> 24);
+    data[13] = (uint8_t)(counter >> 16);
+    data[14] = (uint8_t)(counter >> 8);
+    data[15] = (uint8_t)counter;
+}
+
+void infinea_dukpt_aes_initial_key(const uint8_t bdk[16], const uint8_t initial_key_id[8], uint8_t key[16])
+{
+    uint8_t data[16];
+    infinea_aes128_key schedule;
+    dukpt_aes_derivation(data, 0x8001, initial_key_id, 0, 1);
+    infinea_aes128_init(&schedule, bdk);
+    infinea_aes128_encrypt(&schedule, data, key);
+}
+
+void infinea_dukpt_aes_key(const uint8_t initial_key[16], const uint8_t ksn[12], uint16_t usage, uint8_t key[16])
+{
+    uint8_t derivation_key[16], data[16];
+    infinea_aes128_key schedule;
+    uint32_t counter = ((uint32_t)ksn[8] << 24) | ((uint32_t)ksn[9] << 16) | ((uint32_t)ksn[10] << 8) | ksn[11];
+    uint32_t working = 0;
+    memcpy(derivation_key, initial_key, 16);
+    for (uint32_t mask = 0x80000000u; mask; mask >>= 1) {
+        if (counter & mask) {
+            working |= mask;
+            dukpt_aes_derivation(data, 0x8000, ksn, working, 0);
+            infinea_aes128_init(&schedule, derivation_key);
+            infinea_aes128_encrypt(&schedule, data, derivation_key);
+        }
+    }
+    dukpt_aes_derivation(data, usage, ksn, counter, 0);
+    infinea_aes128_init(&schedule, derivation_key);
+    infinea_aes128_encrypt(&schedule, data, key);
+}
+
+void infinea_dukpt_init(infinea_dukpt *dukpt, const uint8_t bdk[16], int aes, int usage)
+{
+    memset(dukpt, 0, sizeof(*dukpt));
+    memcpy(dukpt->bdk, bdk, 16);
+    dukpt->aes = aes != 0;
+    dukpt->usage = usage;
+}
+
+static infinea_dukpt_entry *dukpt_entry(infinea_dukpt *dukpt, const uint8_t *ksn, size_t ksn_length)
+{
+    if (ksn_length != (dukpt->aes ? 12u : 10u)) {
+        return NULL;
+    }
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < ksn_length; i++) {
+        hash = (hash ^ ksn[i]) * 16777619u;
+    }
+    infinea_dukpt_entry *entry = &dukpt->entries[hash % INFINEA_DUKPT_CACHE];
+    if (entry->valid && !memcmp(entry->ksn, ksn, ksn_length)) {
+        dukpt->hits++;
+        return entry;
+    }
+    dukpt->misses++;
+
+    // The initial key covers every transaction of a device
+    uint8_t initial_id[8];
+    memcpy(initial_id, ksn, 8);
+    if (!dukpt->aes) {
+        initial_id[7] &= 0xE0;
+    }
+    if (!dukpt->initial_valid || memcmp(dukpt->initial_id, initial_id, 8) != 0) {
+        if (dukpt->aes) {
+            infinea_dukpt_aes_initial_key(dukpt->bdk, initial_id, dukpt->initial_key);
+        }
+        else {
+            infinea_dukpt_tdes_ipek(dukpt->bdk, ksn, dukpt->initial_key);
+        }
+        memcpy(dukpt->initial_id, initial_id, 8);
+        dukpt->initial_valid = 1;
+    }
+
+    uint8_t key[16];
+    if (dukpt->aes) {
+        infinea_dukpt_aes_key(dukpt->initial_key, ksn, (uint16_t)dukpt->usage, key);
+        infinea_aes128_init(&entry->key.aes, key);
+    }
+    else {
+        infinea_dukpt_tdes_key(dukpt->initial_key, ksn, dukpt->usage, key);
+        infinea_tdes_init(&entry->key.tdes, key);
+    }
+    memset(key, 0, sizeof(key));
+    memcpy(entry->ksn, ksn, ksn_length);
+    entry->valid = 1;
+    return entry;
+}
+
+int infinea_dukpt_decrypt(infinea_dukpt *dukpt, const uint8_t *ksn, size_t ksn_length, const uint8_t *data, size_t length, uint8_t *out)
+{
+    size_t block = dukpt->aes ? 16 : 8;
+    infinea_dukpt_entry *entry = length % block == 0 ? dukpt_entry(dukpt, ksn, ksn_length) : NULL;
+    if (!entry) {
+        return 0;
+    }
+
+    uint8_t previous[16] = { 0 }, cipher[16], plain[16];
+    for (size_t offset = 0; offset < length; offset += block) {
+        memcpy(cipher, data + offset, block);
+        if (dukpt->aes) {
+            infinea_aes128_decrypt(&entry->key.aes, cipher, plain);
+        }
+        else {
+            infinea_tdes_decrypt(&entry->key.tdes, cipher, plain);
+        }
+        for (size_t i = 0; i < block; i++) {
+            out[offset + i] = plain[i] ^ previous[i];
+        }
+        memcpy(previous, cipher, block);
+    }
+    return 1;
+}
+
+int infinea_dukpt_encrypt(infinea_dukpt *dukpt, const uint8_t *ksn, size_t ksn_length, const uint8_t *data, size_t length, uint8_t *out)
+{
+    size_t block = dukpt->aes ? 16 : 8;
+    infinea_dukpt_entry *entry = length % block == 0 ? dukpt_entry(dukpt, ksn, ksn_length) : NULL;
+    if (!entry) {
+        return 0;
+    }
+
+    uint8_t chain[16] = { 0 };
+    for (size_t offset = 0; offset < length; offset += block) {
+        for (size_t i = 0; i < block; i++) {
+            chain[i] ^= data[offset + i];
+        }
+        if (dukpt->aes) {
+            infinea_aes128_encrypt(&entry->key.aes, chain, chain);
+        }
+        else {
+            infinea_tdes_encrypt(&entry->key.tdes, chain, chain);
+        }
+        memcpy(out + offset, chain, block);
+    }
+    return 1;
+}
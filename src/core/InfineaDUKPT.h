@@ -0,0 +1,142 @@
+/********* InfineaDUKPT.h DUKPT key derivation and decryption for testing *******/
+//
+// Host side of ANSI X9.24 DUKPT: TDES DUKPT (X9.24-1 2009) and AES-128 DUKPT (X9.24-3 2017) key derivation from a
+// base derivation key, and CBC decryption of reader output with keys cached per KSN. Meant for load tests and simulators
+// with test BDKs, production keys belong in an HSM.
+// Plain C99 with no platform dependencies, functions never allocate.
+
+#ifndef INFINEA_DUKPT_H
+#define INFINEA_DUKPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Two key TDES (K1 K2 K1) key schedule
+ */
+typedef struct {
+    uint64_t subkeys[2][16];
+} infinea_tdes_key;
+
+void infinea_tdes_init(infinea_tdes_key *key, const uint8_t bytes[16]);
+void infinea_tdes_encrypt(const infinea_tdes_key *key, const uint8_t in[8], uint8_t out[8]);
+void infinea_tdes_decrypt(const infinea_tdes_key *key, const uint8_t in[8], uint8_t out[8]);
+
+/**
+ AES-128 key schedule
+ */
+typedef struct {
+    uint8_t round_keys[176];
+} infinea_aes128_key;
+
+void infinea_aes128_init(infinea_aes128_key *key, const uint8_t bytes[16]);
+void infinea_aes128_encrypt(const infinea_aes128_key *key, const uint8_t in[16], uint8_t out[16]);
+void infinea_aes128_decrypt(const infinea_aes128_key *key, const uint8_t in[16], uint8_t out[16]);
+
+/**
+ TDES DUKPT key variants
+ */
+enum {
+    INFINEA_DUKPT_PIN = 0,
+    INFINEA_DUKPT_MAC = 1,
+    /** Data encryption, request or both ways, with the one-way function of X9.24-1 2009 */
+    INFINEA_DUKPT_DATA = 2,
+    /** Data encryption variant without the one-way function, as used by older readers */
+    INFINEA_DUKPT_DATA_VARIANT = 3,
+};
+
+/**
+ AES DUKPT key usages of the derivation data
+ */
+enum {
+    INFINEA_DUKPT_AES_PIN = 0x1000,
+    INFINEA_DUKPT_AES_MAC = 0x2000,
+    INFINEA_DUKPT_AES_DATA_ENCRYPT = 0x3000,
+    INFINEA_DUKPT_AES_DATA_DECRYPT = 0x3001,
+    INFINEA_DUKPT_AES_DATA = 0x3002,
+};
+
+/**
+ Initial PIN encryption key of a TDES DUKPT device
+ @param ksn 10 byte key serial number, the transaction counter is ignored
+ */
+void infinea_dukpt_tdes_ipek(const uint8_t bdk[16], const uint8_t ksn[10], uint8_t ipek[16]);
+
+/**
+ TDES DUKPT working key for the transaction counter in the KSN
+ @param variant one of INFINEA_DUKPT_PIN, MAC, DATA or DATA_VARIANT
+ */
+void infinea_dukpt_tdes_key(const uint8_t ipek[16], const uint8_t ksn[10], int variant, uint8_t key[16]);
+
+/**
+ Initial key of an AES-128 DUKPT device
+ @param initial_key_id the first 8 bytes of the 12 byte KSN: BDK ID and derivation ID
+ */
+void infinea_dukpt_aes_initial_key(const uint8_t bdk[16], const uint8_t initial_key_id[8], uint8_t key[16]);
+
+/**
+ AES-128 DUKPT working key for the transaction counter in the KSN
+ @param ksn 12 byte key serial number
+ @param usage one of the INFINEA_DUKPT_AES_ key usages
+ */
+void infinea_dukpt_aes_key(const uint8_t initial_key[16], const uint8_t ksn[12], uint16_t usage, uint8_t key[16]);
+
+#define INFINEA_DUKPT_CACHE 64
+
+/**
+ A derived working key ready for use
+ */
+typedef struct {
+    uint8_t ksn[12];
+    int valid;
+    union {
+        infinea_tdes_key tdes;
+        infinea_aes128_key aes;
+    } key;
+} infinea_dukpt_entry;
+
+/**
+ Decrypts payloads of one BDK. Working keys are cached per KSN and the initial key per device, so payloads of one
+ transaction and transactions of one device derive their keys once.
+ */
+typedef struct {
+    uint8_t bdk[16];
+    int aes;
+    int usage;
+    uint8_t initial_id[8];
+    uint8_t initial_key[16];
+    int initial_valid;
+    uint64_t hits;
+    uint64_t misses;
+    infinea_dukpt_entry entries[INFINEA_DUKPT_CACHE];
+} infinea_dukpt;
+
+/**
+ @param aes nonzero for AES-128 DUKPT with 12 byte KSNs, zero for TDES DUKPT with 10 byte KSNs
+ @param usage a TDES variant or an AES key usage
+ */
+void infinea_dukpt_init(infinea_dukpt *dukpt, const uint8_t bdk[16], int aes, int usage);
+
+/**
+ Decrypts CBC data with a zero IV, the way readers encrypt track and tag data
+ @param length a multiple of the block size, 8 for TDES and 16 for AES
+ @param out buffer of at least length bytes, may be data
+ @return 1 on success, 0 if the KSN or length is invalid
+ */
+int infinea_dukpt_decrypt(infinea_dukpt *dukpt, const uint8_t *ksn, size_t ksn_length, const uint8_t *data, size_t length, uint8_t *out);
+
+/**
+ Encrypts like a reader would, for simulators and round trip tests
+ @return 1 on success, 0 if the KSN or length is invalid
+ */
+int infinea_dukpt_encrypt(infinea_dukpt *dukpt, const uint8_t *ksn, size_t ksn_length, const uint8_t *data, size_t length, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
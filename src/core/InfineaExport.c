@@ -0,0 +1,264 @@
+/********* InfineaExport.c Compressed batch export *******/
+
+#include "InfineaExport.h"
+
+#include <string.h>
+
+#define HASH_LOG 12
+#define MIN_MATCH 4
+// LZ4 block rules: the last 5 bytes are literals and the last match starts at least 12 bytes before the end
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash32(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+static uint8_t *write_length(uint8_t *op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+size_t infinea_lz4_compress(const uint8_t *data, size_t length, uint8_t *out, size_t capacity)
+{
+    uint32_t table[1 << HASH_LOG];
+    const uint8_t *ip = data;
+    const uint8_t *anchor = data;
+    const uint8_t *end = data + length;
+    uint8_t *op = out;
+    uint8_t *oend = out + capacity;
+
+    if (length > MF_LIMIT) {
+        const uint8_t *mflimit = end - MF_LIMIT;
+        const uint8_t *matchlimit = end - LAST_LITERALS;
+        memset(table, 0, sizeof(table));
+
+        while (ip <= mflimit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = hash32(sequence);
+            const uint8_t *ref = data + table[h];
+            table[h] = (uint32_t)(ip - data);
+
+            if (ref >= ip || ip - ref > 65535 || read32(ref) != sequence) {
+                // Skip faster through incompressible data
+                ip += 1 + ((size_t)(ip - anchor) >> 6);
+                continue;
+            }
+
+            const uint8_t *mp = ip + MIN_MATCH;
+            const uint8_t *rp = ref + MIN_MATCH;
+            while (mp < matchlimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            size_t literals = (size_t)(ip - anchor);
+            size_t matchLength = (size_t)(mp - ip) - MIN_MATCH;
+            if ((size_t)(oend - op) < 1 + literals + literals / 255 + 1 + 2 + matchLength / 255 + 1) {
+                return 0;
+            }
+
+            uint8_t *token = op++;
+            *token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+            if (literals >= 15) {
+                op = write_length(op, literals - 15);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            size_t offset = (size_t)(ip - ref);
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+
+            *token |= (uint8_t)(matchLength >= 15 ? 15 : matchLength);
+            if (matchLength >= 15) {
+                op = write_length(op, matchLength - 15);
+            }
+
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    size_t literals = (size_t)(end - anchor);
+    if ((size_t)(oend - op) < 1 + literals + literals / 255 + 1) {
+        return 0;
+    }
+    uint8_t *token = op++;
+    *token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) {
+        op = write_length(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return (size_t)(op - out);
+}
+
+static int read_length(const uint8_t **ip, const uint8_t *end, size_t *length)
+{
+    uint8_t b;
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return 0;
+}
+
+size_t infinea_lz4_decompress(const uint8_t *data, size_t length, uint8_t *out, size_t capacity)
+{
+    const uint8_t *ip = data;
+    const uint8_t *end = data + length;
+    uint8_t *op = out;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && read_length(&ip, end, &literals) != 0) {
+            return SIZE_MAX;
+        }
+        if ((size_t)(end - ip) < literals || capacity - (size_t)(op - out) < literals) {
+            return SIZE_MAX;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return SIZE_MAX;
+        }
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out)) {
+            return SIZE_MAX;
+        }
+
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && read_length(&ip, end, &matchLength) != 0) {
+            return SIZE_MAX;
+        }
+        matchLength += MIN_MATCH;
+        if (capacity - (size_t)(op - out) < matchLength) {
+            return SIZE_MAX;
+        }
+
+        // Byte copy, matches may overlap their own output
+        const uint8_t *match = op - offset;
+        while (matchLength--) {
+            *op++ = *match++;
+        }
+    }
+
+    return (size_t)(op - out);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static int emit(infinea_export_writer *writer, const uint8_t *data, size_t length)
+{
+    writer->written_bytes += length;
+    return writer->sink(data, length, writer->context);
+}
+
+static int emit_chunk_header(infinea_export_writer *writer, size_t raw, size_t stored)
+{
+    uint8_t header[8];
+    put_u32(header, (uint32_t)raw);
+    put_u32(header + 4, (uint32_t)stored);
+    writer->chunks++;
+    return emit(writer, header, sizeof(header));
+}
+
+static int flush_chunk(infinea_export_writer *writer)
+{
+    if (writer->used == 0) {
+        return 0;
+    }
+
+    size_t raw = writer->used;
+    size_t compressed = infinea_lz4_compress(writer->chunk, raw, writer->compressed, sizeof(writer->compressed));
+    writer->used = 0;
+
+    int status;
+    if (compressed > 0 && compressed < raw) {
+        if ((status = emit_chunk_header(writer, raw, compressed)) != 0) return status;
+        return emit(writer, writer->compressed, compressed);
+    }
+    if ((status = emit_chunk_header(writer, raw, raw)) != 0) return status;
+    return emit(writer, writer->chunk, raw);
+}
+
+int infinea_export_begin(infinea_export_writer *writer, infinea_export_sink sink, void *context)
+{
+    writer->sink = sink;
+    writer->context = context;
+    writer->used = 0;
+    writer->records = 0;
+    writer->raw_bytes = 0;
+    writer->written_bytes = 0;
+    writer->chunks = 0;
+    return emit(writer, (const uint8_t *)"IJX1", 4);
+}
+
+int infinea_export_add(infinea_export_writer *writer, uint8_t kind, uint64_t seq, const void *data, size_t length)
+{
+    uint8_t header[INFINEA_EXPORT_RECORD_HEADER];
+    header[0] = kind;
+    put_u64(header + 1, seq);
+    put_u32(header + 9, (uint32_t)length);
+
+    size_t total = sizeof(header) + length;
+    writer->records++;
+    writer->raw_bytes += total;
+
+    int status;
+    if (total > INFINEA_EXPORT_CHUNK_SIZE) {
+        // Oversized record, stored in a chunk of its own
+        if ((status = flush_chunk(writer)) != 0) return status;
+        if ((status = emit_chunk_header(writer, total, total)) != 0) return status;
+        if ((status = emit(writer, header, sizeof(header))) != 0) return status;
+        return emit(writer, data, length);
+    }
+
+    if (INFINEA_EXPORT_CHUNK_SIZE - writer->used < total && (status = flush_chunk(writer)) != 0) {
+        return status;
+    }
+    memcpy(writer->chunk + writer->used, header, sizeof(header));
+    memcpy(writer->chunk + writer->used + sizeof(header), data, length);
+    writer->used += total;
+    return 0;
+}
+
+int infinea_export_finish(infinea_export_writer *writer)
+{
+    return flush_chunk(writer);
+}
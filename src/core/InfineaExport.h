@@ -0,0 +1,94 @@
+/********* InfineaExport.h Compressed batch export *******/
+//
+// Streams records into length-prefixed binary chunks compressed with LZ4 (block format).
+//
+// File layout, little endian:
+//   "IJX1"
+//   chunk*: u32 raw length, u32 stored length, stored bytes
+//           stored bytes are an LZ4 block when stored length < raw length, raw bytes otherwise
+//   record (inside raw chunk bytes): u8 kind, u64 sequence, u32 payload length, payload
+// Records never span chunks; a record larger than a chunk gets a stored chunk of its own.
+
+#ifndef INFINEA_EXPORT_H
+#define INFINEA_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INFINEA_EXPORT_CHUNK_SIZE (64 * 1024)
+#define INFINEA_EXPORT_RECORD_HEADER 13
+
+/**
+ Record kinds
+ */
+enum {
+    /** Scan journal entry, payload is the journaled JSON */
+    INFINEA_EXPORT_JOURNAL = 1,
+    /** Telemetry snapshot, payload is JSON */
+    INFINEA_EXPORT_TELEMETRY = 2,
+};
+
+/**
+ Worst case LZ4 block size for length input bytes
+ */
+#define INFINEA_LZ4_BOUND(length) ((length) + (length) / 255 + 16)
+
+/**
+ Compresses into an LZ4 block
+ @return compressed size, 0 if it does not fit into capacity
+ */
+size_t infinea_lz4_compress(const uint8_t *data, size_t length, uint8_t *out, size_t capacity);
+
+/**
+ Decompresses an LZ4 block
+ @return decompressed size, SIZE_MAX if the block is malformed or does not fit into capacity
+ */
+size_t infinea_lz4_decompress(const uint8_t *data, size_t length, uint8_t *out, size_t capacity);
+
+/**
+ Receives output bytes, returns 0 on success
+ */
+typedef int (*infinea_export_sink)(const uint8_t *data, size_t length, void *context);
+
+/**
+ Export writer state. About 130KB, allocate it on the heap.
+ */
+typedef struct {
+    infinea_export_sink sink;
+    void *context;
+    size_t used;
+    uint64_t records;
+    uint64_t raw_bytes;
+    uint64_t written_bytes;
+    uint64_t chunks;
+    uint8_t chunk[INFINEA_EXPORT_CHUNK_SIZE];
+    uint8_t compressed[INFINEA_LZ4_BOUND(INFINEA_EXPORT_CHUNK_SIZE)];
+} infinea_export_writer;
+
+/**
+ Starts an export, writing the file header to sink
+ @return 0 on success, the sink's error otherwise
+ */
+int infinea_export_begin(infinea_export_writer *writer, infinea_export_sink sink, void *context);
+
+/**
+ Adds a record, flushing a compressed chunk when the current one is full
+ @return 0 on success, the sink's error otherwise
+ */
+int infinea_export_add(infinea_export_writer *writer, uint8_t kind, uint64_t seq, const void *data, size_t length);
+
+/**
+ Flushes the last chunk
+ @return 0 on success, the sink's error otherwise
+ */
+int infinea_export_finish(infinea_export_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,401 @@
+/********* InfineaJournal.c Append-only event journal *******/
+
+// pread, ftruncate and fsync under -std=c99; F_FULLFSYNC is a Darwin extension hidden by strict POSIX
+#define _POSIX_C_SOURCE 200809L
+#if defined(__APPLE__)
+#define _DARWIN_C_SOURCE
+#endif
+
+#include "InfineaJournal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 17
+// Acknowledged records are dropped once the journal is at least this big and twice its size after the last compaction
+#define COMPACT_MIN_SIZE (64 * 1024)
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length)
+{
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// Reads the whole file, caller frees
+static uint8_t *read_all(int fd, size_t *length)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+
+    uint8_t *buffer = malloc(st.st_size > 0 ? (size_t)st.st_size : 1);
+    if (!buffer) {
+        return NULL;
+    }
+
+    size_t total = 0;
+    while (total < (size_t)st.st_size) {
+        ssize_t n = pread(fd, buffer + total, (size_t)st.st_size - total, (off_t)total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+    *length = total;
+    return buffer;
+}
+
+// Walks valid records, returns the byte size of the valid prefix
+typedef void (*record_visitor)(uint64_t seq, uint8_t kind, const uint8_t *data, size_t length, void *context);
+
+static size_t walk(const uint8_t *buffer, size_t size, record_visitor visitor, void *context)
+{
+    size_t offset = 0;
+    while (size - offset >= HEADER_SIZE) {
+        const uint8_t *p = buffer + offset;
+        uint32_t length = get_u32(p);
+        if (size - offset - HEADER_SIZE < length) {
+            break;
+        }
+        if (crc32_update(0, p + 8, 9 + (size_t)length) != get_u32(p + 4)) {
+            break;
+        }
+        visitor(get_u64(p + 8), p[16], p + HEADER_SIZE, length, context);
+        offset += HEADER_SIZE + length;
+    }
+    return offset;
+}
+
+static void recover_visitor(uint64_t seq, uint8_t kind, const uint8_t *data, size_t length, void *context)
+{
+    infinea_journal *journal = context;
+    if (kind == INFINEA_JOURNAL_ACK && length == 8) {
+        uint64_t acked = get_u64(data);
+        if (acked > journal->acked_seq) {
+            journal->acked_seq = acked;
+        }
+    }
+    if (kind == INFINEA_JOURNAL_ENTRY && seq > journal->last_entry_seq) {
+        journal->last_entry_seq = seq;
+    }
+    if (seq >= journal->next_seq) {
+        journal->next_seq = seq + 1;
+    }
+}
+
+static int write_record(infinea_journal *journal, uint64_t seq, uint8_t kind, const void *data, size_t length)
+{
+    if (journal->broken) {
+        errno = EIO;
+        return -1;
+    }
+    if (length > UINT32_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    put_u32(header, (uint32_t)length);
+    put_u64(header + 8, seq);
+    header[16] = kind;
+    put_u32(header + 4, crc32_update(crc32_update(0, header + 8, 9), data, length));
+
+    struct iovec parts[2] = { { header, HEADER_SIZE }, { (void *)data, length } };
+    size_t total = HEADER_SIZE + length;
+    ssize_t written;
+    do {
+        written = writev(journal->fd, parts, 2);
+    } while (written < 0 && errno == EINTR);
+
+    if (written != (ssize_t)total) {
+        // Cut off the partial record so later appends stay reachable
+        int saved = written >= 0 ? EIO : errno;
+        if (written > 0 && ftruncate(journal->fd, (off_t)journal->size) != 0) {
+            // Records appended after the torn one would be lost on the next open, refuse them until then
+            saved = errno;
+            journal->broken = 1;
+        }
+        errno = saved;
+        return -1;
+    }
+    journal->size += total;
+    return 0;
+}
+
+int infinea_journal_open(infinea_journal *journal, const char *path)
+{
+    memset(journal, 0, sizeof(*journal));
+    journal->next_seq = 1;
+
+    journal->path = strdup(path);
+    if (!journal->path) {
+        journal->fd = -1;
+        return -1;
+    }
+    journal->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (journal->fd < 0) {
+        free(journal->path);
+        journal->path = NULL;
+        return -1;
+    }
+
+    size_t size = 0;
+    uint8_t *buffer = read_all(journal->fd, &size);
+    if (!buffer) {
+        infinea_journal_close(journal);
+        return -1;
+    }
+    journal->size = walk(buffer, size, recover_visitor, journal);
+    journal->compacted_size = journal->size;
+    free(buffer);
+
+    if (journal->size < size && ftruncate(journal->fd, (off_t)journal->size) != 0) {
+        infinea_journal_close(journal);
+        return -1;
+    }
+    if (journal->acked_seq >= journal->next_seq) {
+        journal->next_seq = journal->acked_seq + 1;
+    }
+    return 0;
+}
+
+uint64_t infinea_journal_append(infinea_journal *journal, const void *data, size_t length)
+{
+    uint64_t seq = journal->next_seq;
+    if (write_record(journal, seq, INFINEA_JOURNAL_ENTRY, data, length) != 0) {
+        return 0;
+    }
+    journal->next_seq++;
+    journal->last_entry_seq = seq;
+    return seq;
+}
+
+int infinea_journal_sync(const infinea_journal *journal)
+{
+#ifdef F_FULLFSYNC
+    // Apple platforms only flush to the drive's cache with fsync
+    if (fcntl(journal->fd, F_FULLFSYNC) == 0) {
+        return 0;
+    }
+#endif
+    return fsync(journal->fd);
+}
+
+struct compact_context {
+    uint64_t acked_seq;
+    uint8_t *out;
+    size_t size;
+};
+
+// Keeps the unacknowledged entries, the ack record that replaces the rest is written after them
+static void compact_visitor(uint64_t seq, uint8_t kind, const uint8_t *data, size_t length, void *context)
+{
+    struct compact_context *compact = context;
+    if (kind == INFINEA_JOURNAL_ENTRY && seq > compact->acked_seq) {
+        memcpy(compact->out + compact->size, data - HEADER_SIZE, HEADER_SIZE + length);
+        compact->size += HEADER_SIZE + length;
+    }
+}
+
+// Rewrites the journal as its unacknowledged entries and one ack record, then renames it over the old one. The old
+// file stays in place until the new one is complete, so a crash at any point keeps every entry and the sequence.
+static int compact(infinea_journal *journal)
+{
+    size_t size = 0;
+    uint8_t *buffer = read_all(journal->fd, &size);
+    if (!buffer) {
+        return -1;
+    }
+    if (size > journal->size) {
+        size = (size_t)journal->size;
+    }
+    uint8_t *out = malloc(size + 1);
+    if (!out) {
+        free(buffer);
+        errno = ENOMEM;
+        return -1;
+    }
+    struct compact_context context = { journal->acked_seq, out, 0 };
+    walk(buffer, size, compact_visitor, &context);
+    free(buffer);
+
+    size_t pathLength = strlen(journal->path);
+    char *temp = malloc(pathLength + 5);
+    if (!temp) {
+        free(out);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(temp, journal->path, pathLength);
+    memcpy(temp + pathLength, ".tmp", 5);
+
+    int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    int status = fd >= 0 ? 0 : -1;
+    infinea_journal compacted = *journal;
+    compacted.fd = fd;
+    compacted.size = 0;
+    if (status == 0) {
+        size_t written = 0;
+        while (written < context.size) {
+            ssize_t n = write(fd, out + written, context.size - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                status = -1;
+                break;
+            }
+            written += (size_t)n;
+        }
+        compacted.size = written;
+    }
+    free(out);
+
+    // The ack record carries the last sequence number used, so sequences keep increasing after the rewrite
+    uint8_t payload[8];
+    put_u64(payload, journal->acked_seq);
+    if (status == 0 && write_record(&compacted, journal->next_seq - 1, INFINEA_JOURNAL_ACK, payload, sizeof(payload)) != 0) {
+        status = -1;
+    }
+    if (status == 0 && infinea_journal_sync(&compacted) != 0) {
+        status = -1;
+    }
+    if (status == 0 && rename(temp, journal->path) != 0) {
+        status = -1;
+    }
+
+    if (status != 0) {
+        int saved = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        unlink(temp);
+        free(temp);
+        errno = saved;
+        return -1;
+    }
+    free(temp);
+
+    close(journal->fd);
+    journal->fd = fd;
+    journal->size = compacted.size;
+    journal->compacted_size = compacted.size;
+    return 0;
+}
+
+int infinea_journal_ack(infinea_journal *journal, uint64_t seq)
+{
+    if (seq <= journal->acked_seq) {
+        return 0;
+    }
+    if (seq >= journal->next_seq) {
+        seq = journal->next_seq - 1;
+    }
+
+    uint8_t payload[8];
+    put_u64(payload, seq);
+    if (write_record(journal, journal->next_seq++, INFINEA_JOURNAL_ACK, payload, sizeof(payload)) != 0) {
+        return -1;
+    }
+    journal->acked_seq = seq;
+    if (infinea_journal_sync(journal) != 0) {
+        return -1;
+    }
+
+    // The ack is durable either way, a failed compaction is retried with the next one
+    int everything = seq >= journal->last_entry_seq;
+    if ((everything && journal->size > HEADER_SIZE + 8) ||
+        (journal->size >= COMPACT_MIN_SIZE && journal->size >= 2 * journal->compacted_size)) {
+        compact(journal);
+    }
+    return 0;
+}
+
+struct replay_context {
+    const infinea_journal *journal;
+    infinea_journal_visitor visitor;
+    void *context;
+    long count;
+};
+
+static void replay_visitor(uint64_t seq, uint8_t kind, const uint8_t *data, size_t length, void *context)
+{
+    struct replay_context *replay = context;
+    if (kind == INFINEA_JOURNAL_ENTRY && seq > replay->journal->acked_seq) {
+        replay->visitor(seq, data, length, replay->context);
+        replay->count++;
+    }
+}
+
+long infinea_journal_replay(const infinea_journal *journal, infinea_journal_visitor visitor, void *context)
+{
+    size_t size = 0;
+    uint8_t *buffer = read_all(journal->fd, &size);
+    if (!buffer) {
+        return -1;
+    }
+
+    struct replay_context replay = { journal, visitor, context, 0 };
+    walk(buffer, size < journal->size ? size : (size_t)journal->size, replay_visitor, &replay);
+    free(buffer);
+    return replay.count;
+}
+
+void infinea_journal_close(infinea_journal *journal)
+{
+    if (journal->fd >= 0) {
+        infinea_journal_sync(journal);
+        close(journal->fd);
+        journal->fd = -1;
+    }
+    free(journal->path);
+    journal->path = NULL;
+}
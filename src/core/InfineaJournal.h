@@ -0,0 +1,89 @@
+/********* InfineaJournal.h Append-only event journal *******/
+//
+// Records are appended with a single write() each, so they survive the app being killed as soon as
+// infinea_journal_append returns; infinea_journal_sync makes them survive power loss too. Callers batch
+// syncs (group commit). POSIX only, no platform dependencies.
+//
+// Record layout, little endian: u32 payload length, u32 CRC-32 of the rest, u64 sequence, u8 kind, payload.
+// A torn record at the tail is dropped on open. Acknowledged records are compacted away by rewriting the journal to a
+// temporary file and renaming it over the old one.
+
+#ifndef INFINEA_JOURNAL_H
+#define INFINEA_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Record kinds
+ */
+enum {
+    /** Acknowledges all entries up to the sequence number in the payload */
+    INFINEA_JOURNAL_ACK = 0,
+    /** Application entry */
+    INFINEA_JOURNAL_ENTRY = 1,
+};
+
+typedef struct {
+    int fd;
+    /** Sequence number the next entry will get, starting at 1 */
+    uint64_t next_seq;
+    /** Highest acknowledged sequence number, 0 if none */
+    uint64_t acked_seq;
+    /** Sequence number of the last entry, 0 if none */
+    uint64_t last_entry_seq;
+    /** Byte size of the valid journal */
+    uint64_t size;
+    /** Byte size after the last compaction or open */
+    uint64_t compacted_size;
+    /** Set when a torn record could not be cut off, appends fail until the journal is reopened */
+    int broken;
+    /** Path of the journal, owned */
+    char *path;
+} infinea_journal;
+
+/**
+ Opens or creates the journal, recovering sequence and acknowledgement state and truncating a torn tail
+ @return 0 on success, -1 on error with errno set
+ */
+int infinea_journal_open(infinea_journal *journal, const char *path);
+
+/**
+ Appends an entry
+ @return the entry's sequence number, 0 on error with errno set
+ */
+uint64_t infinea_journal_append(infinea_journal *journal, const void *data, size_t length);
+
+/**
+ Flushes appended records to stable storage. Only touches the file descriptor, so it may run on another
+ thread concurrently with infinea_journal_append.
+ @return 0 on success, -1 on error with errno set
+ */
+int infinea_journal_sync(const infinea_journal *journal);
+
+/**
+ Acknowledges all entries up to and including seq. When nothing is left unacknowledged, or the journal has doubled
+ since it was last compacted, acknowledged records are dropped.
+ @return 0 on success, -1 on error with errno set
+ */
+int infinea_journal_ack(infinea_journal *journal, uint64_t seq);
+
+typedef void (*infinea_journal_visitor)(uint64_t seq, const uint8_t *data, size_t length, void *context);
+
+/**
+ Calls visitor for every unacknowledged entry in sequence order. Reads the journal into a temporary heap buffer.
+ @return number of entries visited, -1 on error with errno set
+ */
+long infinea_journal_replay(const infinea_journal *journal, infinea_journal_visitor visitor, void *context);
+
+void infinea_journal_close(infinea_journal *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
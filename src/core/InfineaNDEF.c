@@ -0,0 +1,402 @@
+/********* InfineaNDEF.c NFC Forum tag and NDEF kernels *******/
+
+#include "InfineaNDEF.h"
+
+#include <string.h>
+
+#define TLV_NULL 0x00
+#define TLV_NDEF 0x03
+#define TLV_TERMINATOR 0xFE
+
+int infinea_ndef_type2_cc(const uint8_t *cc, infinea_ndef_area *area)
+{
+    if (cc[0] != 0xE1 || (cc[1] >> 4) != 1 || cc[2] == 0) {
+        return 0;
+    }
+    area->offset = 16;
+    area->size = (size_t)cc[2] * 8;
+    area->writable = (cc[3] & 0x0F) == 0;
+    return 1;
+}
+
+int infinea_ndef_type5_cc(const uint8_t *cc, size_t length, infinea_ndef_area *area)
+{
+    if (length < 4) {
+        return -1;
+    }
+    if ((cc[0] != 0xE1 && cc[0] != 0xE2) || (cc[1] >> 6) != 1) {
+        return 0;
+    }
+    area->writable = (cc[1] & 0x03) == 0;
+    if (cc[2] != 0) {
+        area->offset = 4;
+        area->size = (size_t)cc[2] * 8;
+        return 1;
+    }
+    if (length < 8) {
+        return -1;
+    }
+    area->offset = 8;
+    area->size = (((size_t)cc[6] << 8) | cc[7]) * 8;
+    return area->size > 0;
+}
+
+int infinea_ndef_tlv_find(const uint8_t *data, size_t length, size_t area_size, infinea_ndef_tlv *tlv, size_t *needed)
+{
+    size_t i = 0;
+    while (i < area_size) {
+        if (i >= length) {
+            *needed = i + 4;
+            return INFINEA_NDEF_MORE;
+        }
+        uint8_t tag = data[i];
+        if (tag == TLV_NULL) {
+            i++;
+            continue;
+        }
+        if (tag == TLV_TERMINATOR) {
+            return INFINEA_NDEF_NONE;
+        }
+
+        // Length is one byte, or 0xFF and two bytes big endian
+        if (i + 2 > length) {
+            *needed = i + 4;
+            return INFINEA_NDEF_MORE;
+        }
+        size_t value_length = data[i + 1];
+        size_t header = 2;
+        if (value_length == 0xFF) {
+            if (i + 4 > length) {
+                *needed = i + 4;
+                return INFINEA_NDEF_MORE;
+            }
+            value_length = ((size_t)data[i + 2] << 8) | data[i + 3];
+            header = 4;
+        }
+        if (i + header + value_length > area_size) {
+            return INFINEA_NDEF_MALFORMED;
+        }
+
+        if (tag == TLV_NDEF) {
+            tlv->tlv_offset = i;
+            tlv->value_offset = i + header;
+            tlv->length = value_length;
+            if (i + header + value_length > length) {
+                *needed = i + header + value_length;
+                return INFINEA_NDEF_MORE;
+            }
+            return INFINEA_NDEF_FOUND;
+        }
+        i += header + value_length;
+    }
+    return INFINEA_NDEF_NONE;
+}
+
+int infinea_ndef_record_next(const uint8_t *message, size_t length, size_t *offset, infinea_ndef_record *record)
+{
+    size_t i = *offset;
+    if (i >= length) {
+        return 0;
+    }
+
+    uint8_t flags = message[i++];
+    int short_record = (flags & 0x10) != 0;
+    int has_id = (flags & 0x08) != 0;
+    size_t header = 1 + (short_record ? 1 : 4) + (has_id ? 1 : 0);
+    if (length - i < header) {
+        return -1;
+    }
+
+    size_t type_length = message[i++];
+    size_t payload_length;
+    if (short_record) {
+        payload_length = message[i++];
+    }
+    else {
+        payload_length = ((size_t)message[i] << 24) | ((size_t)message[i + 1] << 16) | ((size_t)message[i + 2] << 8) | message[i + 3];
+        i += 4;
+    }
+    size_t id_length = has_id ? message[i++] : 0;
+
+    if (length - i < type_length || length - i - type_length < id_length || length - i - type_length - id_length < payload_length) {
+        return -1;
+    }
+
+    record->tnf = flags & 0x07;
+    record->begin = (flags & 0x80) != 0;
+    record->end = (flags & 0x40) != 0;
+    record->chunked = (flags & 0x20) != 0;
+    record->type = message + i;
+    record->type_length = type_length;
+    i += type_length;
+    record->id = message + i;
+    record->id_length = id_length;
+    i += id_length;
+    record->payload = message + i;
+    record->payload_length = payload_length;
+    i += payload_length;
+
+    *offset = i;
+    return 1;
+}
+
+int infinea_ndef_is_type(const infinea_ndef_record *record, const char *type)
+{
+    size_t length = strlen(type);
+    return record->tnf == INFINEA_TNF_WELL_KNOWN && record->type_length == length && !memcmp(record->type, type, length);
+}
+
+static const char *const kURIPrefixes[] = {
+    "", "http://www.", "https://www.", "http://", "https://", "tel:", "mailto:", "ftp://anonymous:anonymous@", "ftp://ftp.",
+    "ftps://", "sftp://", "smb://", "nfs://", "ftp://", "dav://", "news:", "telnet://", "imap:", "rtsp://", "urn:", "pop:",
+    "sip:", "sips:", "tftp:", "btspp://", "btl2cap://", "btgoep://", "tcpobex://", "irdaobex://", "file://", "urn:epc:id:",
+    "urn:epc:tag:", "urn:epc:pat:", "urn:epc:raw:", "urn:epc:", "urn:nfc:",
+};
+
+size_t infinea_ndef_uri(const uint8_t *payload, size_t length, char *out)
+{
+    size_t written = 0;
+    if (length > 0) {
+        const char *prefix = payload[0] < sizeof(kURIPrefixes) / sizeof(kURIPrefixes[0]) ? kURIPrefixes[payload[0]] : "";
+        written = strlen(prefix);
+        memcpy(out, prefix, written);
+        memcpy(out + written, payload + 1, length - 1);
+        written += length - 1;
+    }
+    out[written] = '\0';
+    return written;
+}
+
+int infinea_ndef_text(const uint8_t *payload, size_t length, int *utf16,
+                      const uint8_t **language, size_t *language_length, const uint8_t **text, size_t *text_length)
+{
+    if (length == 0) {
+        return 0;
+    }
+    size_t code_length = payload[0] & 0x3F;
+    if (length - 1 < code_length) {
+        return 0;
+    }
+    *utf16 = (payload[0] & 0x80) != 0;
+    *language = payload + 1;
+    *language_length = code_length;
+    *text = payload + 1 + code_length;
+    *text_length = length - 1 - code_length;
+    return 1;
+}
+
+size_t infinea_ndef_tlv_encode(const uint8_t *message, size_t length, uint8_t *out, size_t capacity)
+{
+    if (length > 0xFFFE) {
+        return 0;
+    }
+    size_t header = length < 0xFF ? 2 : 4;
+    if (capacity < header + length + 1) {
+        return 0;
+    }
+    out[0] = TLV_NDEF;
+    if (header == 2) {
+        out[1] = (uint8_t)length;
+    }
+    else {
+        out[1] = 0xFF;
+        out[2] = (uint8_t)(length >> 8);
+        out[3] = (uint8_t)length;
+    }
+    memcpy(out + header, message, length);
+    out[header + length] = TLV_TERMINATOR;
+    return header + length + 1;
+}
+
+static int tlv_length_is_zero(const uint8_t *data, size_t length, size_t offset)
+{
+    if (offset + 2 > length || data[offset] != TLV_NDEF) {
+        return 0;
+    }
+    if (data[offset + 1] != 0xFF) {
+        return data[offset + 1] == 0;
+    }
+    return offset + 4 <= length && data[offset + 2] == 0 && data[offset + 3] == 0;
+}
+
+static int tag_add_write(infinea_tag_write *writes, size_t capacity, size_t *count, size_t offset, size_t length, int empty)
+{
+    if (*count == capacity) {
+        return 0;
+    }
+    writes[*count].offset = offset;
+    writes[*count].length = length;
+    writes[*count].empty = empty;
+    (*count)++;
+    return 1;
+}
+
+int infinea_tag_plan(const uint8_t *current, const uint8_t *target, size_t length, size_t unit,
+                     size_t header_offset, size_t header_length, int invalidate,
+                     infinea_tag_write *writes, size_t capacity, size_t *units_written, size_t *units_skipped)
+{
+    size_t units = length / unit;
+    size_t header_first = units, header_last = units;
+    if (header_length > 0 && header_offset + header_length <= length) {
+        header_first = header_offset / unit;
+        header_last = (header_offset + header_length + unit - 1) / unit;
+    }
+
+    int header_changed = 0, body_changed = 0;
+    for (size_t u = 0; u < units; u++) {
+        if (memcmp(current + u * unit, target + u * unit, unit) != 0) {
+            if (u >= header_first && u < header_last) {
+                header_changed = 1;
+            }
+            else {
+                body_changed = 1;
+            }
+        }
+    }
+
+    size_t count = 0;
+    *units_written = 0;
+    *units_skipped = units;
+    int empty = body_changed && (header_changed || invalidate) && header_first < units &&
+                !tlv_length_is_zero(current, length, header_offset);
+    if (empty) {
+        if (!tag_add_write(writes, capacity, &count, header_first * unit, (header_last - header_first) * unit, 1)) {
+            return -1;
+        }
+        *units_written += header_last - header_first;
+    }
+
+    // Changed units outside the header in address order, consecutive ones in one command
+    size_t run = 0, run_length = 0;
+    for (size_t u = 0; u <= units; u++) {
+        int changed = u < units && (u < header_first || u >= header_last) &&
+                      memcmp(current + u * unit, target + u * unit, unit) != 0;
+        if (changed) {
+            if (run_length == 0) {
+                run = u;
+            }
+            run_length++;
+            continue;
+        }
+        if (run_length > 0) {
+            if (!tag_add_write(writes, capacity, &count, run * unit, run_length * unit, 0)) {
+                return -1;
+            }
+            *units_written += run_length;
+            *units_skipped -= run_length;
+            run_length = 0;
+        }
+    }
+
+    if (header_changed || empty) {
+        if (!tag_add_write(writes, capacity, &count, header_first * unit, (header_last - header_first) * unit, 0)) {
+            return -1;
+        }
+        *units_written += header_last - header_first;
+        *units_skipped -= header_last - header_first;
+    }
+    return (int)count;
+}
+
+void infinea_tag_write_data(const uint8_t *target, const infinea_tag_write *write, size_t header_offset, uint8_t *out)
+{
+    memcpy(out, target + write->offset, write->length);
+    if (!write->empty || header_offset < write->offset) {
+        return;
+    }
+    size_t i = header_offset - write->offset + 1;
+    if (i < write->length && out[i] != 0xFF) {
+        out[i] = 0;
+    }
+    else if (i + 2 < write->length) {
+        out[i + 1] = 0;
+        out[i + 2] = 0;
+    }
+}
+
+size_t infinea_felica_encode(const infinea_felica_range *ranges, size_t count, infinea_felica_cursor *cursor,
+                             size_t max_blocks, size_t max_services, const uint8_t *write_data, uint8_t *out, size_t *blocks)
+{
+    uint16_t services[INFINEA_FELICA_MAX_SERVICES];
+    uint8_t elements[3 * INFINEA_FELICA_MAX_BLOCKS];
+    size_t service_count = 0, elements_length = 0, first = cursor->ordinal;
+    *blocks = 0;
+    if (max_blocks > INFINEA_FELICA_MAX_BLOCKS) {
+        max_blocks = INFINEA_FELICA_MAX_BLOCKS;
+    }
+    if (max_services > INFINEA_FELICA_MAX_SERVICES) {
+        max_services = INFINEA_FELICA_MAX_SERVICES;
+    }
+
+    while (cursor->range < count && *blocks < max_blocks) {
+        const infinea_felica_range *range = &ranges[cursor->range];
+        if (cursor->block >= range->count) {
+            cursor->range++;
+            cursor->block = 0;
+            continue;
+        }
+
+        size_t index = 0;
+        while (index < service_count && services[index] != range->service) {
+            index++;
+        }
+        if (index == service_count) {
+            if (service_count == max_services) {
+                break;
+            }
+            services[service_count++] = range->service;
+        }
+
+        unsigned block = range->start + (unsigned)cursor->block;
+        if (block < 256) {
+            elements[elements_length++] = 0x80 | (uint8_t)index;
+            elements[elements_length++] = (uint8_t)block;
+        }
+        else {
+            elements[elements_length++] = (uint8_t)index;
+            elements[elements_length++] = (uint8_t)block;
+            elements[elements_length++] = (uint8_t)(block >> 8);
+        }
+        (*blocks)++;
+        cursor->block++;
+        cursor->ordinal++;
+    }
+    if (*blocks == 0) {
+        return 0;
+    }
+
+    size_t i = 0;
+    out[i++] = (uint8_t)service_count;
+    for (size_t s = 0; s < service_count; s++) {
+        out[i++] = (uint8_t)services[s];
+        out[i++] = (uint8_t)(services[s] >> 8);
+    }
+    out[i++] = (uint8_t)*blocks;
+    memcpy(out + i, elements, elements_length);
+    i += elements_length;
+    if (write_data) {
+        memcpy(out + i, write_data + first * INFINEA_FELICA_BLOCK, *blocks * INFINEA_FELICA_BLOCK);
+        i += *blocks * INFINEA_FELICA_BLOCK;
+    }
+    return i;
+}
+
+int infinea_felica_parse(const uint8_t *response, size_t length, int write, size_t blocks, uint8_t status[2], const uint8_t **data)
+{
+    if (length < 3 || response[0] != (write ? 0x09 : 0x07)) {
+        return -1;
+    }
+    status[0] = response[1];
+    status[1] = response[2];
+    if (status[0] != 0) {
+        return 0;
+    }
+    if (write) {
+        return 1;
+    }
+    if (length < 4 || response[3] != blocks || length - 4 < blocks * INFINEA_FELICA_BLOCK) {
+        return -1;
+    }
+    *data = response + 4;
+    return 1;
+}
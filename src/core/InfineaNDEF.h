@@ -0,0 +1,217 @@
+/********* InfineaNDEF.h NFC Forum tag and NDEF kernels *******/
+//
+// Capability containers of Type 2 (Mifare Ultralight, NTAG) and Type 5 (ISO 15693) tags, the TLV area,
+// NDEF records, diffed tag updates and FeliCa (Type 3) block commands. Plain C99 with no platform dependencies, functions never allocate and records
+// point into the parsed buffer.
+
+#ifndef INFINEA_NDEF_H
+#define INFINEA_NDEF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ The TLV area of a tag, offset is the byte address in tag memory
+ */
+typedef struct {
+    size_t offset;
+    size_t size;
+    int writable;
+} infinea_ndef_area;
+
+/**
+ Reads a Type 2 capability container (page 3, 4 bytes). The TLV area starts at page 4.
+ @return 1 if the tag is NDEF formatted, 0 otherwise
+ */
+int infinea_ndef_type2_cc(const uint8_t *cc, infinea_ndef_area *area);
+
+/**
+ Reads a Type 5 capability container at the start of block 0, 4 bytes or 8 bytes if the memory size does not fit one byte
+ @return 1 if the tag is NDEF formatted, 0 otherwise, -1 if length is too short for the container
+ */
+int infinea_ndef_type5_cc(const uint8_t *cc, size_t length, infinea_ndef_area *area);
+
+/**
+ Location of the NDEF Message TLV, offsets are relative to the start of the TLV area
+ */
+typedef struct {
+    size_t tlv_offset;
+    size_t value_offset;
+    size_t length;
+} infinea_ndef_tlv;
+
+/**
+ Results of infinea_ndef_tlv_find
+ */
+enum {
+    /** No NDEF Message TLV before the terminator or the end of the area */
+    INFINEA_NDEF_NONE = 0,
+    /** Found, the whole message is within the data */
+    INFINEA_NDEF_FOUND = 1,
+    /** Read at least *needed bytes of the area and call again */
+    INFINEA_NDEF_MORE = 2,
+    INFINEA_NDEF_MALFORMED = -1,
+};
+
+/**
+ Finds the first NDEF Message TLV, skipping NULL, Lock Control, Memory Control and proprietary TLVs.
+ Works on a prefix of the area, so a reader can fetch the header first and the rest in one more read.
+ @param data the first bytes of the TLV area
+ @param area_size size of the whole TLV area
+ @param needed receives the number of area bytes needed when more data is required
+ @return one of INFINEA_NDEF_NONE, FOUND, MORE or MALFORMED
+ */
+int infinea_ndef_tlv_find(const uint8_t *data, size_t length, size_t area_size, infinea_ndef_tlv *tlv, size_t *needed);
+
+/**
+ Type Name Formats
+ */
+enum {
+    INFINEA_TNF_EMPTY = 0,
+    INFINEA_TNF_WELL_KNOWN = 1,
+    INFINEA_TNF_MIME = 2,
+    INFINEA_TNF_ABSOLUTE_URI = 3,
+    INFINEA_TNF_EXTERNAL = 4,
+    INFINEA_TNF_UNKNOWN = 5,
+    INFINEA_TNF_UNCHANGED = 6,
+};
+
+/**
+ One NDEF record, the fields point into the parsed message
+ */
+typedef struct {
+    uint8_t tnf;
+    /** Message begin, message end and chunk flags */
+    int begin;
+    int end;
+    int chunked;
+    const uint8_t *type;
+    size_t type_length;
+    const uint8_t *id;
+    size_t id_length;
+    const uint8_t *payload;
+    size_t payload_length;
+} infinea_ndef_record;
+
+/**
+ Reads the record at *offset and advances *offset past it
+ @return 1 if a record was read, 0 at the end of the message, -1 if the message is malformed
+ */
+int infinea_ndef_record_next(const uint8_t *message, size_t length, size_t *offset, infinea_ndef_record *record);
+
+/**
+ Returns nonzero if the record is the NFC Forum well-known type, e.g. "U", "T" or "Sp"
+ */
+int infinea_ndef_is_type(const infinea_ndef_record *record, const char *type);
+
+/**
+ Expands a URI record payload with its abbreviated prefix
+ @param out buffer of at least payload length + 26 bytes, NUL terminated on return
+ @return length of the URI, excluding the terminator
+ */
+size_t infinea_ndef_uri(const uint8_t *payload, size_t length, char *out);
+
+/**
+ Splits a Text record payload
+ @param utf16 receives nonzero if the text is UTF-16, UTF-8 otherwise
+ @return 1 on success, 0 if the payload is malformed
+ */
+int infinea_ndef_text(const uint8_t *payload, size_t length, int *utf16,
+                      const uint8_t **language, size_t *language_length, const uint8_t **text, size_t *text_length);
+
+/**
+ Wraps an NDEF message in an NDEF Message TLV followed by a Terminator TLV
+ @return number of bytes written, 0 if capacity is too small
+ */
+size_t infinea_ndef_tlv_encode(const uint8_t *message, size_t length, uint8_t *out, size_t capacity);
+
+/**
+ One write command of a tag update, offset and length are in bytes of the image and multiples of the unit
+ */
+typedef struct {
+    size_t offset;
+    size_t length;
+    /** Write the target bytes with the NDEF TLV length set to 0, see infinea_tag_write_data */
+    int empty;
+} infinea_tag_write;
+
+/**
+ Plans the write commands that turn a tag memory image into the target image, skipping units (pages or blocks) that
+ already hold the target bytes and joining consecutive changed units into one command.
+ When the NDEF TLV header is given, the units holding it are written last, so an early pull leaves the old length or
+ a complete new message. If the header and other units change, or always with invalidate, the header units are first
+ written with a zero length, so an early pull leaves an empty message instead of a mix of old and new records.
+ @param length image length, a multiple of unit
+ @param header_offset offset of the NDEF TLV in the target image
+ @param header_length 2 or 4 bytes of TLV tag and length, 0 to write in address order
+ @param units_written receives the number of unit writes, header units written twice count twice
+ @param units_skipped receives the number of units that are not written
+ @return number of write commands, -1 if capacity is too small
+ */
+int infinea_tag_plan(const uint8_t *current, const uint8_t *target, size_t length, size_t unit,
+                     size_t header_offset, size_t header_length, int invalidate,
+                     infinea_tag_write *writes, size_t capacity, size_t *units_written, size_t *units_skipped);
+
+/**
+ Copies the bytes of a planned write from the target image
+ @param header_offset offset of the NDEF TLV in the target image, as passed to infinea_tag_plan
+ @param out buffer of at least write->length bytes
+ */
+void infinea_tag_write_data(const uint8_t *target, const infinea_tag_write *write, size_t header_offset, uint8_t *out);
+
+/**
+ A range of FeliCa blocks in one service
+ */
+typedef struct {
+    /** Service code as in the FeliCa specification, sent little endian */
+    uint16_t service;
+    uint16_t start;
+    uint16_t count;
+} infinea_felica_range;
+
+/**
+ Position in a list of ranges, start with all zeros
+ */
+typedef struct {
+    size_t range;
+    size_t block;
+    /** Blocks encoded so far over all ranges, indexes the write data */
+    size_t ordinal;
+} infinea_felica_cursor;
+
+#define INFINEA_FELICA_BLOCK 16
+#define INFINEA_FELICA_MAX_SERVICES 16
+#define INFINEA_FELICA_MAX_BLOCKS 15
+
+/**
+ Encodes the parameters of the next Read Without Encryption (0x06) or Write Without Encryption (0x08) command,
+ without the command code and IDm: service list, block list and for writes the block data.
+ Takes blocks from the cursor on until max_blocks blocks or max_services services are in the frame; 2 byte block list
+ elements are used for blocks below 256.
+ @param write_data NULL for reads, otherwise 16 bytes for every block of all ranges, in range order
+ @param out buffer of at least 1 + 2 * max_services + 1 + 3 * max_blocks bytes, plus 16 * max_blocks for writes
+ @param blocks receives the number of blocks in the frame
+ @return length of the parameters, 0 when all ranges are encoded
+ */
+size_t infinea_felica_encode(const infinea_felica_range *ranges, size_t count, infinea_felica_cursor *cursor,
+                             size_t max_blocks, size_t max_services, const uint8_t *write_data, uint8_t *out, size_t *blocks);
+
+/**
+ Checks a Read or Write Without Encryption response: response code, status flags and for reads the block count and data
+ @param response response code followed by the response parameters, without the IDm
+ @param blocks number of blocks requested, 0 for writes
+ @param status receives status flag 1 and 2
+ @param data receives a pointer to the block data of reads
+ @return 1 on success, 0 if the card reported an error in status, -1 if the response is malformed
+ */
+int infinea_felica_parse(const uint8_t *response, size_t length, int write, size_t blocks, uint8_t status[2], const uint8_t **data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
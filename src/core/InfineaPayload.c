@@ -0,0 +1,236 @@
+/********* InfineaPayload.c Platform-neutral payload kernels *******/
+
+#include "InfineaPayload.h"
+
+#include <string.h>
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+size_t infinea_hex_encode(const uint8_t *data, size_t length, char *out)
+{
+    char *p = out;
+    for (size_t i = 0; i < length; i++) {
+        *p++ = kHexDigits[data[i] >> 4];
+        *p++ = kHexDigits[data[i] & 0x0F];
+    }
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+size_t infinea_hex_decode(const char *hex, size_t length, uint8_t *out)
+{
+    size_t written = 0;
+    int high = -1;
+    for (size_t i = 0; i < length; i++) {
+        if (hex[i] == ' ') {
+            continue;
+        }
+        int value = hex_value(hex[i]);
+        if (value < 0) {
+            return SIZE_MAX;
+        }
+        if (high < 0) {
+            high = value;
+        } else {
+            out[written++] = (uint8_t)((high << 4) | value);
+            high = -1;
+        }
+    }
+    return high < 0 ? written : SIZE_MAX;
+}
+
+size_t infinea_decimal_list(const uint8_t *data, size_t length, char *out)
+{
+    char *p = out;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t b = data[i];
+        if (i > 0) {
+            *p++ = ',';
+        }
+        if (b >= 100) {
+            *p++ = (char)('0' + b / 100);
+            *p++ = (char)('0' + b / 10 % 10);
+        } else if (b >= 10) {
+            *p++ = (char)('0' + b / 10);
+        }
+        *p++ = (char)('0' + b % 10);
+    }
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+size_t infinea_json_escape(const char *text, size_t length, char *out)
+{
+    char *p = out;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        switch (c) {
+            case '"':  *p++ = '\\'; *p++ = '"'; break;
+            case '\\': *p++ = '\\'; *p++ = '\\'; break;
+            case '\n': *p++ = '\\'; *p++ = 'n'; break;
+            case '\r': *p++ = '\\'; *p++ = 'r'; break;
+            case '\t': *p++ = '\\'; *p++ = 't'; break;
+            default:
+                if (c < 0x20) {
+                    *p++ = '\\'; *p++ = 'u'; *p++ = '0'; *p++ = '0';
+                    *p++ = kHexDigits[c >> 4];
+                    *p++ = kHexDigits[c & 0x0F];
+                } else {
+                    *p++ = (char)c;
+                }
+                break;
+        }
+    }
+    *p = '\0';
+    return (size_t)(p - out);
+}
+
+int infinea_tlv_next(const uint8_t *data, size_t length, size_t *offset, infinea_tlv *tlv)
+{
+    size_t i = *offset;
+    while (i < length && data[i] == 0x00) {
+        i++;
+    }
+    if (i >= length) {
+        *offset = i;
+        return 0;
+    }
+
+    // Tag, multi-byte when the low 5 bits of the first byte are all set
+    uint32_t tag = data[i];
+    tlv->constructed = (data[i] & 0x20) != 0;
+    if ((data[i++] & 0x1F) == 0x1F) {
+        do {
+            if (i >= length || tag > 0xFFFFFF) {
+                return -1;
+            }
+            tag = (tag << 8) | data[i];
+        } while (data[i++] & 0x80);
+    }
+
+    // Length, short form or 0x81..0x84 long form
+    if (i >= length) {
+        return -1;
+    }
+    size_t valueLength = data[i++];
+    if (valueLength & 0x80) {
+        size_t count = valueLength & 0x7F;
+        if (count == 0 || count > 4 || length - i < count) {
+            return -1;
+        }
+        valueLength = 0;
+        while (count--) {
+            valueLength = (valueLength << 8) | data[i++];
+        }
+    }
+    if (length - i < valueLength) {
+        return -1;
+    }
+
+    tlv->tag = tag;
+    tlv->value = data + i;
+    tlv->length = valueLength;
+    *offset = i + valueLength;
+    return 1;
+}
+
+int infinea_tlv_find(const uint8_t *data, size_t length, uint32_t tag, infinea_tlv *tlv)
+{
+    size_t offset = 0;
+    infinea_tlv element;
+    int status;
+    while ((status = infinea_tlv_next(data, length, &offset, &element)) == 1) {
+        if (element.tag == tag) {
+            *tlv = element;
+            return 1;
+        }
+        if (element.constructed) {
+            status = infinea_tlv_find(element.value, element.length, tag, tlv);
+            if (status != 0) {
+                return status;
+            }
+        }
+    }
+    return status;
+}
+
+// Returns the index of c in [from, length), or length if not present
+static size_t find_char(const char *s, size_t from, size_t length, char c)
+{
+    const char *found = from < length ? memchr(s + from, c, length - from) : NULL;
+    return found ? (size_t)(found - s) : length;
+}
+
+static infinea_span make_span(const char *s, size_t from, size_t to)
+{
+    infinea_span span = { s + from, to > from ? to - from : 0 };
+    return span;
+}
+
+// Splits YYMM SSS discretionary starting at from
+static int parse_tail(const char *track, size_t from, size_t end, char separator, infinea_track *out)
+{
+    // Expiration and service code may be omitted with a field separator in their place
+    if (from < end && track[from] == separator) {
+        out->discretionary = make_span(track, from + 1, end);
+        return 1;
+    }
+    if (from > end || end - from < 7) {
+        return 0;
+    }
+    out->expiration = make_span(track, from, from + 4);
+    out->service_code = make_span(track, from + 4, from + 7);
+    out->discretionary = make_span(track, from + 7, end);
+    return 1;
+}
+
+int infinea_track1_parse(const char *track, size_t length, infinea_track *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    size_t start = 0;
+    if (start < length && track[start] == '%') start++;
+    if (start >= length || track[start] != 'B') {
+        return 0;
+    }
+    start++;
+
+    size_t end = find_char(track, start, length, '?');
+    size_t panEnd = find_char(track, start, end, '^');
+    if (panEnd >= end || panEnd == start) {
+        return 0;
+    }
+    size_t nameEnd = find_char(track, panEnd + 1, end, '^');
+    if (nameEnd >= end) {
+        return 0;
+    }
+
+    out->pan = make_span(track, start, panEnd);
+    out->name = make_span(track, panEnd + 1, nameEnd);
+    return parse_tail(track, nameEnd + 1, end, '^', out);
+}
+
+int infinea_track2_parse(const char *track, size_t length, infinea_track *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    size_t start = 0;
+    if (start < length && track[start] == ';') start++;
+
+    size_t end = find_char(track, start, length, '?');
+    size_t panEnd = find_char(track, start, end, '=');
+    if (panEnd >= end || panEnd == start) {
+        return 0;
+    }
+
+    out->pan = make_span(track, start, panEnd);
+    return parse_tail(track, panEnd + 1, end, '=', out);
+}
@@ -0,0 +1,102 @@
+/********* InfineaPayload.h Platform-neutral payload kernels *******/
+//
+// Byte-level encoding and parsing used by the plugin's event path. Plain C99 with no platform
+// dependencies so it can be built and profiled anywhere. Functions never allocate; callers
+// provide output buffers sized as documented.
+
+#ifndef INFINEA_PAYLOAD_H
+#define INFINEA_PAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ A view into caller-owned bytes
+ */
+typedef struct {
+    const char *data;
+    size_t length;
+} infinea_span;
+
+/**
+ Encodes bytes as lowercase hex
+ @param out buffer of at least 2 * length + 1 bytes, NUL terminated on return
+ @return number of characters written, excluding the terminator
+ */
+size_t infinea_hex_encode(const uint8_t *data, size_t length, char *out);
+
+/**
+ Decodes hex, upper or lower case. Spaces are skipped.
+ @param out buffer of at least length / 2 bytes
+ @return number of bytes written, or SIZE_MAX if the input is not valid hex
+ */
+size_t infinea_hex_decode(const char *hex, size_t length, uint8_t *out);
+
+/**
+ Writes bytes as a comma separated list of unsigned decimals, e.g. "48,49,50"
+ @param out buffer of at least 4 * length + 1 bytes, NUL terminated on return
+ @return number of characters written, excluding the terminator
+ */
+size_t infinea_decimal_list(const uint8_t *data, size_t length, char *out);
+
+/**
+ Escapes UTF-8 text for use inside a double quoted JavaScript/JSON string literal
+ @param out buffer of at least 6 * length + 1 bytes, NUL terminated on return
+ @return number of characters written, excluding the terminator
+ */
+size_t infinea_json_escape(const char *text, size_t length, char *out);
+
+/**
+ A single BER-TLV element, value points into the parsed buffer
+ */
+typedef struct {
+    uint32_t tag;
+    int constructed;
+    const uint8_t *value;
+    size_t length;
+} infinea_tlv;
+
+/**
+ Reads the BER-TLV element at *offset and advances *offset past it. 0x00 padding between elements is skipped.
+ @return 1 if an element was read, 0 at the end of data, -1 if the data is malformed
+ */
+int infinea_tlv_next(const uint8_t *data, size_t length, size_t *offset, infinea_tlv *tlv);
+
+/**
+ Finds the first element with the given tag, descending into constructed elements
+ @return 1 if found, 0 if not, -1 if the data is malformed
+ */
+int infinea_tlv_find(const uint8_t *data, size_t length, uint32_t tag, infinea_tlv *tlv);
+
+/**
+ Magnetic stripe track fields, spans point into the parsed track
+ */
+typedef struct {
+    infinea_span pan;
+    infinea_span name;
+    infinea_span expiration;
+    infinea_span service_code;
+    infinea_span discretionary;
+} infinea_track;
+
+/**
+ Parses ISO 7813 track 1 (%B PAN ^ NAME ^ YYMM SSS ...?), sentinels optional
+ @return 1 on success, 0 if the track is not in the expected format
+ */
+int infinea_track1_parse(const char *track, size_t length, infinea_track *out);
+
+/**
+ Parses ISO 7813 track 2 (;PAN = YYMM SSS ...?), sentinels optional
+ @return 1 on success, 0 if the track is not in the expected format
+ */
+int infinea_track2_parse(const char *track, size_t length, infinea_track *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,88 +1,3600 @@
 /********* InfineaSDKCordova.m Cordova Plugin Implementation *******/
 
 #import <WebKit/WebKit.h>
+#import <CommonCrypto/CommonDigest.h>
 #import <Cordova/CDV.h>
 #import <InfineaSDK/InfineaSDK.h>
+#import "InfineaPayload.h"
+#import "InfineaJournal.h"
+#import "InfineaExport.h"
+#import "InfineaBarcode.h"
+#import "InfineaNDEF.h"
+#ifdef INFINEA_TEST_DUKPT
+#import "InfineaDUKPT.h"
+#endif
 
-@interface InfineaSDKCordova : CDVPlugin <IPCDTDeviceDelegate>
+// Name of the WKScriptMessageHandler used by the direct command channel
+static NSString * const kScriptMessageHandlerName = @"infinea";
+// Callback ids of commands that arrived over the direct channel
+static NSString * const kDirectCallbackPrefix = @"InfineaDirect";
+
+// Forwards script messages without the user content controller retaining the plugin
+@interface InfineaScriptMessageProxy : NSObject <WKScriptMessageHandler>
+
+@property (weak, nonatomic) id<WKScriptMessageHandler> target;
+
+@end
+
+@implementation InfineaScriptMessageProxy
+
+- (void)userContentController:(WKUserContentController *)userContentController didReceiveScriptMessage:(WKScriptMessage *)message
+{
+    [self.target userContentController:userContentController didReceiveScriptMessage:message];
+}
+
+@end
+
+// Payload helpers, thin wrappers around the kernels in InfineaPayload
+static NSString *InfineaHexString(NSData *data)
+{
+    if (!data) {
+        return @"";
+    }
+    NSMutableData *buffer = [NSMutableData dataWithLength:data.length * 2 + 1];
+    size_t length = infinea_hex_encode(data.bytes, data.length, buffer.mutableBytes);
+    return [[NSString alloc] initWithBytes:buffer.bytes length:length encoding:NSASCIIStringEncoding];
+}
+
+static NSData *InfineaHexData(id hex)
+{
+    if (![hex isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    const char *chars = [hex UTF8String];
+    size_t length = strlen(chars);
+    NSMutableData *data = [NSMutableData dataWithLength:length / 2];
+    size_t decoded = infinea_hex_decode(chars, length, data.mutableBytes);
+    if (decoded == SIZE_MAX) {
+        return nil;
+    }
+    data.length = decoded;
+    return data;
+}
+
+// Escapes a string for a double quoted JS literal in callback:
+static NSString *InfineaEscapedString(NSString *string)
+{
+    if (!string) {
+        return @"";
+    }
+    const char *utf8 = string.UTF8String;
+    size_t utf8Length = strlen(utf8);
+    NSMutableData *buffer = [NSMutableData dataWithLength:utf8Length * 6 + 1];
+    size_t length = infinea_json_escape(utf8, utf8Length, buffer.mutableBytes);
+    return [[NSString alloc] initWithBytes:buffer.bytes length:length encoding:NSUTF8StringEncoding];
+}
+
+static NSString *InfineaSpanString(infinea_span span)
+{
+    return [[NSString alloc] initWithBytes:span.data length:span.length encoding:NSASCIIStringEncoding] ?: @"";
+}
+
+static NSString *InfineaJSONString(id object)
+{
+    NSData *json = [NSJSONSerialization dataWithJSONObject:object options:0 error:nil];
+    return json ? [[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding] : @"null";
+}
+
+// Apple VAS result TLV: every 0xE8 template becomes one pass of tag (uppercase hex) to value (hex)
+static NSDictionary *InfineaVASPasses(int result, NSData *data)
+{
+    NSMutableArray *passes = [NSMutableArray new];
+    size_t offset = 0;
+    infinea_tlv tlv;
+    int status;
+    while ((status = infinea_tlv_next(data.bytes, data.length, &offset, &tlv)) == 1) {
+        if (tlv.tag != 0xE8 || !tlv.constructed) {
+            continue;
+        }
+        NSMutableDictionary *pass = [NSMutableDictionary new];
+        size_t inner = 0;
+        infinea_tlv element;
+        while ((status = infinea_tlv_next(tlv.value, tlv.length, &inner, &element)) == 1) {
+            pass[[NSString stringWithFormat:@"%X", element.tag]] = InfineaHexString([NSData dataWithBytes:element.value length:element.length]);
+        }
+        [passes addObject:pass];
+        if (status < 0) {
+            break;
+        }
+    }
+    
+    NSMutableDictionary *vas = [@{@"result": @(result), @"passes": passes} mutableCopy];
+    // Keep what could not be parsed so nothing from the tap is lost
+    if (status < 0) {
+        vas[@"raw"] = InfineaHexString(data);
+    }
+    return vas;
+}
+
+// Parsed track 1 or track 2 fields, empty if neither track parses
+static NSDictionary *InfineaTrackFields(NSString *track1, NSString *track2)
+{
+    infinea_track track;
+    const char *data = track1.UTF8String;
+    BOOL parsed = data && infinea_track1_parse(data, strlen(data), &track);
+    if (!parsed) {
+        data = track2.UTF8String;
+        parsed = data && infinea_track2_parse(data, strlen(data), &track);
+    }
+    if (!parsed) {
+        return @{};
+    }
+    
+    return @{@"pan": InfineaSpanString(track.pan),
+             @"name": InfineaSpanString(track.name),
+             @"expiration": InfineaSpanString(track.expiration),
+             @"serviceCode": InfineaSpanString(track.service_code),
+             @"discretionary": InfineaSpanString(track.discretionary)
+             };
+}
+
+// Track fields as they may be stored: the PAN with only the first 6 and last 4 digits, expiration and service code.
+// Track data and the cardholder name never go to the journal
+static NSDictionary *InfineaJournalTrackFields(NSDictionary *fields)
+{
+    NSString *pan = fields[@"pan"];
+    if (pan.length == 0) {
+        return @{};
+    }
+    NSMutableString *masked = [pan mutableCopy];
+    if (pan.length > 10) {
+        [masked replaceCharactersInRange:NSMakeRange(6, pan.length - 10) withString:[@"" stringByPaddingToLength:pan.length - 10 withString:@"*" startingAtIndex:0]];
+    }
+    else {
+        masked = [[@"" stringByPaddingToLength:pan.length withString:@"*" startingAtIndex:0] mutableCopy];
+    }
+    return @{@"pan": masked, @"expiration": fields[@"expiration"] ?: @"", @"serviceCode": fields[@"serviceCode"] ?: @""};
+}
+
+// GTIN-14 of a retail scan as a JS literal, "null" for other symbologies or invalid codes.
+// Types below BAR_EX_RESERVED1 are the same in BARCODES and BARCODES_EX, so this works in either type mode
+static NSString *InfineaGTINLiteral(const char *code, size_t length, int type)
+{
+    size_t addOn = 0;
+    infinea_gtin_symbology symbology;
+    switch (type) {
+        case BAR_EX_UPCE_2: symbology = INFINEA_GTIN_UPCE; addOn = 2; break;
+        case BAR_EX_UPCE_5: symbology = INFINEA_GTIN_UPCE; addOn = 5; break;
+        case BAR_EX_UPCE: symbology = INFINEA_GTIN_UPCE; break;
+        case BAR_EX_UPCA_2: symbology = INFINEA_GTIN_UPC; addOn = 2; break;
+        case BAR_EX_UPCA_5: symbology = INFINEA_GTIN_UPC; addOn = 5; break;
+        case BAR_EX_EAN13_2: symbology = INFINEA_GTIN_EAN13; addOn = 2; break;
+        case BAR_EX_EAN13_5: symbology = INFINEA_GTIN_EAN13; addOn = 5; break;
+        case BAR_EX_EAN8_2: symbology = INFINEA_GTIN_EAN8; addOn = 2; break;
+        case BAR_EX_EAN8_5: symbology = INFINEA_GTIN_EAN8; addOn = 5; break;
+        case BAR_UPC: symbology = INFINEA_GTIN_UPC; break;
+        case BAR_EAN8: symbology = INFINEA_GTIN_EAN8; break;
+        case BAR_EAN13: symbology = INFINEA_GTIN_EAN13; break;
+        case BAR_ITF14: case BAR_DUN14: symbology = INFINEA_GTIN_ITF14; break;
+        default: return @"null";
+    }
+    
+    uint64_t gtin;
+    if (!code || length <= addOn || !infinea_gtin14_scan(code, length - addOn, symbology, &gtin)) {
+        return @"null";
+    }
+    return [NSString stringWithFormat:@"%llu", gtin];
+}
+
+// GS1 elements of a scan as a JSON literal, from GS1 Digital Link URIs in QR and DataMatrix codes or from
+// GS1 element strings, "null" if the scan carries neither
+static NSString *InfineaGS1Literal(const char *code, size_t length, int type)
+{
+    if (!code) {
+        return @"null";
+    }
+    
+    infinea_gs1_element elements[32];
+    size_t count = 0;
+    NSString *source = nil;
+    BOOL twoDimensional = type == BAR_QRCODE || type == BAR_DATAMATRIX;
+    if (twoDimensional && length > 7 && (!strncasecmp(code, "https://", 8) || !strncasecmp(code, "http://", 7))) {
+        count = infinea_gs1_digital_link(code, length, elements, 32);
+        source = @"digitalLink";
+    }
+    // Plain 2D codes are only GS1 with a symbology identifier or leading FNC1
+    else if (type == BAR_EAN128 || type == BAR_GS1DATABAR || (twoDimensional && length > 0 && (code[0] == ']' || code[0] == 0x1D))) {
+        count = infinea_gs1_parse(code, length, elements, 32);
+        source = @"elementString";
+    }
+    if (count == 0) {
+        return @"null";
+    }
+    
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:count];
+    BOOL valid = YES;
+    for (size_t i = 0; i < count; i++) {
+        infinea_span value = elements[i].value;
+        // Sized from scanned data, so decoded on the heap
+        NSMutableData *decoded = nil;
+        if (elements[i].escaped) {
+            decoded = [NSMutableData dataWithLength:value.length];
+            value.length = infinea_percent_decode(value.data, value.length, decoded.mutableBytes);
+            value.data = decoded.bytes;
+        }
+        NSString *text = [[NSString alloc] initWithBytes:value.data length:value.length encoding:NSUTF8StringEncoding] ?: InfineaSpanString(value);
+        [values addObject:@{@"ai": @(elements[i].ai), @"value": text}];
+        valid &= elements[i].check >= 0;
+    }
+    return InfineaJSONString(@{@"source": source, @"elements": values, @"valid": @(valid)});
+}
+
+// NDEF records as JSON objects, Smart Poster records include their nested records
+static NSArray *InfineaNDEFRecords(const uint8_t *message, size_t length)
+{
+    NSMutableArray *records = [NSMutableArray new];
+    infinea_ndef_record record;
+    size_t offset = 0;
+    int result;
+    while ((result = infinea_ndef_record_next(message, length, &offset, &record)) == 1) {
+        NSString *type = [[NSString alloc] initWithBytes:record.type length:record.type_length encoding:NSUTF8StringEncoding] ?: @"";
+        NSMutableDictionary *entry = [@{@"tnf": @(record.tnf),
+                                        @"type": type,
+                                        @"id": InfineaHexString([NSData dataWithBytes:record.id length:record.id_length]),
+                                        @"payload": InfineaHexString([NSData dataWithBytes:record.payload length:record.payload_length])
+                                        } mutableCopy];
+        
+        if (infinea_ndef_is_type(&record, "U")) {
+            NSMutableData *uri = [NSMutableData dataWithLength:record.payload_length + 26];
+            size_t uriLength = infinea_ndef_uri(record.payload, record.payload_length, uri.mutableBytes);
+            entry[@"uri"] = [[NSString alloc] initWithBytes:uri.bytes length:uriLength encoding:NSUTF8StringEncoding] ?: @"";
+        }
+        else if (infinea_ndef_is_type(&record, "T")) {
+            int utf16;
+            const uint8_t *language, *text;
+            size_t languageLength, textLength;
+            if (infinea_ndef_text(record.payload, record.payload_length, &utf16, &language, &languageLength, &text, &textLength)) {
+                entry[@"lang"] = [[NSString alloc] initWithBytes:language length:languageLength encoding:NSASCIIStringEncoding] ?: @"";
+                entry[@"text"] = [[NSString alloc] initWithBytes:text length:textLength encoding:utf16 ? NSUTF16StringEncoding : NSUTF8StringEncoding] ?: @"";
+            }
+        }
+        else if (infinea_ndef_is_type(&record, "Sp")) {
+            entry[@"records"] = InfineaNDEFRecords(record.payload, record.payload_length);
+        }
+        else if (record.tnf == INFINEA_TNF_MIME && [type hasPrefix:@"text/"]) {
+            entry[@"text"] = [[NSString alloc] initWithBytes:record.payload length:record.payload_length encoding:NSUTF8StringEncoding] ?: @"";
+        }
+        [records addObject:entry];
+    }
+    return records;
+}
+
+static NSStringEncoding InfineaECIEncoding(int32_t eci)
+{
+    CFStringEncoding encoding = kCFStringEncodingInvalidId;
+    switch (eci) {
+        case 0: case 2: encoding = kCFStringEncodingDOSLatinUS; break;
+        case 21: encoding = kCFStringEncodingWindowsLatin2; break;
+        case 22: encoding = kCFStringEncodingWindowsCyrillic; break;
+        case 23: encoding = kCFStringEncodingWindowsLatin1; break;
+        case 24: encoding = kCFStringEncodingWindowsArabic; break;
+        case 28: encoding = kCFStringEncodingBig5; break;
+        case 29: encoding = kCFStringEncodingEUC_CN; break;
+        case 30: encoding = kCFStringEncodingEUC_KR; break;
+        case 32: encoding = kCFStringEncodingGB_18030_2000; break;
+        default:
+            // ECI 4-18 are ISO-8859-2 to ISO-8859-16
+            if (eci >= 4 && eci <= 18 && eci != 14) {
+                encoding = kCFStringEncodingISOLatin1 + (eci - 3);
+            }
+            break;
+    }
+    return encoding == kCFStringEncodingInvalidId ? 0 : CFStringConvertEncodingToNSStringEncoding(encoding);
+}
+
+static NSStringEncoding InfineaSegmentEncoding(infinea_text_segment segment)
+{
+    switch (segment.charset) {
+        case INFINEA_CHARSET_ASCII: return NSASCIIStringEncoding;
+        case INFINEA_CHARSET_UTF8: return NSUTF8StringEncoding;
+        case INFINEA_CHARSET_UTF16BE: return NSUTF16BigEndianStringEncoding;
+        case INFINEA_CHARSET_ISO8859_1: return NSISOLatin1StringEncoding;
+        case INFINEA_CHARSET_SHIFT_JIS: return NSShiftJISStringEncoding;
+        case INFINEA_CHARSET_ECI: return InfineaECIEncoding(segment.eci);
+        case INFINEA_CHARSET_BINARY: return 0;
+    }
+    return 0;
+}
+
+// Decodes a barcode payload honouring ECI designators, charset receives the IANA name of the
+// first non-ASCII segment. Returns nil for binary payloads
+static NSString *InfineaBarcodeText(NSData *data, BOOL eciEscapes, NSString **charset)
+{
+    NSMutableData *payload = [NSMutableData dataWithLength:data.length];
+    size_t payloadLength = 0;
+    infinea_text_segment segments[16];
+    size_t count = infinea_text_segments(data.bytes, data.length, eciEscapes, payload.mutableBytes, &payloadLength, segments, 16);
+    
+    *charset = @"binary";
+    if (count == 0) {
+        return nil;
+    }
+    
+    NSMutableString *text = [NSMutableString stringWithCapacity:payloadLength];
+    for (size_t i = 0; i < count; i++) {
+        NSStringEncoding encoding = InfineaSegmentEncoding(segments[i]);
+        const uint8_t *bytes = (const uint8_t *)payload.bytes + segments[i].offset;
+        NSUInteger length = segments[i].length;
+        if (encoding == NSUTF16BigEndianStringEncoding && length >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+            bytes += 2;
+            length -= 2;
+        }
+        NSString *segmentText = encoding ? [[NSString alloc] initWithBytes:bytes length:length encoding:encoding] : nil;
+        if (!segmentText) {
+            *charset = @"binary";
+            return nil;
+        }
+        if (encoding != NSASCIIStringEncoding && [*charset isEqualToString:@"binary"]) {
+            *charset = (__bridge NSString *)CFStringConvertEncodingToIANACharSetName(CFStringConvertNSStringEncodingToEncoding(encoding));
+        }
+        [text appendString:segmentText];
+    }
+    if ([*charset isEqualToString:@"binary"]) {
+        *charset = @"US-ASCII";
+    }
+    return text;
+}
+
+// Scan attempts and scan-to-decode latency for one phase of the symbology advisor
+typedef struct {
+    NSUInteger attempts;
+    NSUInteger failures;
+    NSUInteger decodes;
+    double latencySum;
+} InfineaSymbologyPhase;
+
+@interface InfineaSDKCordova : CDVPlugin <IPCDTDeviceDelegate, WKScriptMessageHandler>
 
 @property (strong, nonatomic) IPCIQ *iq;
 @property (strong, nonatomic) IPCDTDevices *ipc;
 
-- (void)coolMethod:(CDVInvokedUrlCommand*)command;
+// Batched event channel
+@property (strong, nonatomic) NSString *eventCallbackId;
+@property (strong, nonatomic) NSMutableArray *pendingEvents;
+@property (assign, nonatomic) BOOL eventFlushScheduled;
+// Callbacks made before JS registered the event channel, e.g. connectionState with InfineaConnectOnLoad
+@property (strong, nonatomic) NSMutableArray<NSString *> *pendingCallbacks;
+
+// Serial queue for device commands that may be pipelined from JS
+@property (strong, nonatomic) dispatch_queue_t commandQueue;
+
+// POG throughput counters, keyed by solution
+@property (strong, nonatomic) NSMutableDictionary *pogStats;
+
+// Device clock correlation, samples are @[hostUptime, deviceTime - hostUptime]
+@property (strong, nonatomic) NSMutableArray *clockSamples;
+@property (strong, nonatomic) dispatch_source_t clockTimer;
+@property (assign, nonatomic) double clockOffset;
+@property (assign, nonatomic) double clockDrift;
+@property (assign, nonatomic) NSTimeInterval clockSampleInterval;
+@property (assign, nonatomic) NSTimeInterval clockResyncThreshold;
+@property (strong, nonatomic) NSDate *clockLastResync;
+
+// Startup phase marks in ms since pluginInitialize
+@property (assign, nonatomic) NSTimeInterval startupBegin;
+@property (strong, nonatomic) NSMutableDictionary *startupTimings;
+@property (assign, nonatomic) BOOL delegateAdded;
+
+// Scan journal, appends happen on the delegate path and fsyncs are batched on journalQueue
+@property (strong, nonatomic) dispatch_queue_t journalQueue;
+@property (assign, nonatomic) BOOL journalOpen;
+@property (assign, nonatomic) BOOL journalSyncScheduled;
+@property (assign, nonatomic) NSUInteger journalUnsynced;
+@property (assign, nonatomic) NSUInteger journalSyncInterval;
+@property (assign, nonatomic) NSUInteger journalSyncRecords;
+
+// Honour AIM ECI escape sequences in barcodeNSData payloads
+@property (assign, nonatomic) BOOL barcodeECIEscapes;
+
+// Multi-part barcode reassembly, parts are held in appendArena
+@property (strong, nonatomic) NSMutableData *appendArena;
+@property (assign, nonatomic) BOOL appendQRHeader;
+@property (strong, nonatomic) NSRegularExpression *appendPattern;
+@property (assign, nonatomic) uint64_t appendTTL;
+
+// Read NDEF from Type 2 and ISO 15693 tags before rfCardDetected is sent
+@property (assign, nonatomic) BOOL rfReadNdef;
+// Cards in the field by card index, for the tag writer
+@property (strong, nonatomic) NSMutableDictionary<NSNumber *, DTRFCardInfo *> *rfCards;
+// Blocks per read, blocks per write and services per frame by FeliCa IC type, used on the command queue only
+@property (strong, nonatomic) NSMutableDictionary<NSNumber *, NSArray<NSNumber *> *> *felicaLimits;
+// Authentication state by card index: uid, auth (identity by key family), app, handshakes, saved.
+// Used on the command queue only
+@property (strong, nonatomic) NSMutableDictionary<NSNumber *, NSMutableDictionary *> *rfSessions;
+// Mifare keys stored into the reader's key slots on every connect: slot, type, key
+@property (strong, nonatomic) NSArray<NSDictionary *> *rfStoredKeys;
+
+// Versions the stored key inventory was checked against on this connection, nil until checked
+@property (copy) NSString *keyInventoryVersions;
+
+// Security watchdog: last verified tamper and key state with "uptime" of the check, polled on the command queue with
+// an interval that doubles while nothing changes. The timer and options are only changed on the command queue; the
+// generation changes on every disconnect, so checks that started before it do not store their result
+@property (copy) NSDictionary *securityState;
+@property (assign) NSUInteger securityGeneration;
+@property (strong, nonatomic) dispatch_source_t securityTimer;
+@property (assign, nonatomic) BOOL securityWatchdog;
+@property (assign, nonatomic) NSTimeInterval securityInterval;
+@property (assign, nonatomic) NSTimeInterval securityMinInterval;
+@property (assign, nonatomic) NSTimeInterval securityMaxInterval;
+@property (assign, nonatomic) NSTimeInterval securityMaxAge;
+@property (strong, nonatomic) NSArray<NSNumber *> *securityRequiredKeys;
+
+// EMV UI messages and sounds: the merged table of emvSyncMessages by entry key ("message:ID", "sound:ID").
+// Used on the command queue only
+@property (strong, nonatomic) NSMutableDictionary<NSString *, NSDictionary *> *emvMessageTable;
+
+// Loyalty IDs (LOYALTY_ID_*) read with every magnetic card, empty when off
+@property (strong, nonatomic) NSArray<NSNumber *> *loyaltyIDs;
+// Apple VAS result of the current tap, held on the main thread until the transaction outcome is sent with it,
+// or sent on its own when the transaction is cancelled or the device disconnects
+@property (strong, nonatomic) NSDictionary *emvPendingVAS;
+
+#ifdef INFINEA_TEST_DUKPT
+// Test DUKPT engines (NSMutableData holding an infinea_dukpt) by BDK and key usage, nil unless InfineaTestDUKPT is set
+@property (strong, nonatomic) NSMutableDictionary<NSString *, NSMutableData *> *dukptEngines;
+#endif
+
+// Configuration profile re-applied on every connect
+@property (strong, nonatomic) NSData *activeProfile;
+
+// Symbology advisor, touched on the main thread only. Pruning is undone with compiled profile ops
+@property (strong, nonatomic) NSMutableDictionary *symbologyCounts;
+@property (assign, nonatomic) NSTimeInterval symbologyLearnUntil;
+@property (strong, nonatomic) NSDictionary *symbologyAutoPrune;
+@property (strong, nonatomic) NSData *symbologyUndo;
+@property (strong, nonatomic) NSArray *symbologyEnabled;
+@property (assign, nonatomic) NSTimeInterval symbologyAttemptStart;
+@property (assign, nonatomic) NSTimeInterval symbologyLastDecode;
+@property (assign, nonatomic) NSUInteger symbologyConsecutiveFailures;
+@property (assign, nonatomic) NSUInteger symbologyFailureLimit;
+
+- (void)coolMethod:(CDVInvokedUrlCommand*)command;
+
+// Available functions
+- (void)setDeveloperKey:(CDVInvokedUrlCommand *)command;
+- (void)connect:(CDVInvokedUrlCommand*)command;
+- (void)disconnect:(CDVInvokedUrlCommand*)command;
+- (void)getConnectedDeviceInfo:(CDVInvokedUrlCommand*)command;
+- (void)getConnectedDevicesInfo:(CDVInvokedUrlCommand*)command;
+- (void)setPassThroughSync:(CDVInvokedUrlCommand*)command;
+- (void)getPassThroughSync:(CDVInvokedUrlCommand*)command;
+- (void)setUSBChargeCurrent:(CDVInvokedUrlCommand*)command;
+- (void)getUSBChargeCurrent:(CDVInvokedUrlCommand*)command;
+- (void)getBatteryInfo:(CDVInvokedUrlCommand*)command;
+- (void)setAutoOffWhenIdle:(CDVInvokedUrlCommand*)command;
+- (void)rfInit:(CDVInvokedUrlCommand*)command;
+- (void)rfClose:(CDVInvokedUrlCommand*)command;
+- (void)barcodeGetScanButtonMode:(CDVInvokedUrlCommand*)command;
+- (void)barcodeSetScanButtonMode:(CDVInvokedUrlCommand*)command;
+- (void)barcodeGetScanMode:(CDVInvokedUrlCommand*)command;
+- (void)barcodeSetScanMode:(CDVInvokedUrlCommand*)command;
+- (void)barcodeStartScan:(CDVInvokedUrlCommand*)command;
+- (void)barcodeStopScan:(CDVInvokedUrlCommand*)command;
+- (void)setCharging:(CDVInvokedUrlCommand*)command;
+- (void)getFirmwareFileInformation:(CDVInvokedUrlCommand*)command;
+- (void)updateFirmwareData:(CDVInvokedUrlCommand*)command;
+- (void)emsrSetEncryption:(CDVInvokedUrlCommand*)command;
+- (void)emsrSetActiveHead:(CDVInvokedUrlCommand*)command;
+- (void)emsrConfigMaskedDataShowExpiration:(CDVInvokedUrlCommand*)command;
+- (void)emsrIsTampered:(CDVInvokedUrlCommand*)command;
+- (void)emsrGetKeyVersion:(CDVInvokedUrlCommand*)command;
+- (void)emsrGetDeviceInfo:(CDVInvokedUrlCommand*)command;
+- (void)barcodeSetScanBeep: (CDVInvokedUrlCommand *)command;
+- (void)registerEventChannel:(CDVInvokedUrlCommand*)command;
+- (void)pogCommand:(CDVInvokedUrlCommand*)command;
+- (void)pogGetStats:(CDVInvokedUrlCommand*)command;
+- (void)clockGetCorrelation:(CDVInvokedUrlCommand*)command;
+- (void)clockSetCorrelationOptions:(CDVInvokedUrlCommand*)command;
+- (void)clockCorrectDeviceTime:(CDVInvokedUrlCommand*)command;
+- (void)getStartupTimings:(CDVInvokedUrlCommand*)command;
+- (void)ping:(CDVInvokedUrlCommand*)command;
+- (void)journalOpen:(CDVInvokedUrlCommand*)command;
+- (void)journalReplay:(CDVInvokedUrlCommand*)command;
+- (void)journalAcknowledge:(CDVInvokedUrlCommand*)command;
+- (void)journalSetSyncPolicy:(CDVInvokedUrlCommand*)command;
+- (void)exportBatch:(CDVInvokedUrlCommand*)command;
+- (void)profileApply:(CDVInvokedUrlCommand*)command;
+- (void)profileClear:(CDVInvokedUrlCommand*)command;
+- (void)symbologyLearn:(CDVInvokedUrlCommand*)command;
+- (void)symbologyGetAdvice:(CDVInvokedUrlCommand*)command;
+- (void)symbologyPrune:(CDVInvokedUrlCommand*)command;
+- (void)symbologyRollback:(CDVInvokedUrlCommand*)command;
+- (void)gtinNormalize:(CDVInvokedUrlCommand*)command;
+- (void)barcodeSetTextDecoding:(CDVInvokedUrlCommand*)command;
+- (void)barcodeSetStructuredAppend:(CDVInvokedUrlCommand*)command;
+- (void)rfSetNdefReading:(CDVInvokedUrlCommand*)command;
+- (void)rfWriteTag:(CDVInvokedUrlCommand*)command;
+- (void)felicaReadBatch:(CDVInvokedUrlCommand*)command;
+- (void)felicaWriteBatch:(CDVInvokedUrlCommand*)command;
+- (void)rfAuthenticate:(CDVInvokedUrlCommand*)command;
+- (void)rfSetStoredKeys:(CDVInvokedUrlCommand*)command;
+- (void)keyInventory:(CDVInvokedUrlCommand*)command;
+- (void)keyInventoryInvalidate:(CDVInvokedUrlCommand*)command;
+#ifdef INFINEA_TEST_DUKPT
+- (void)dukptDecrypt:(CDVInvokedUrlCommand*)command;
+#endif
+- (void)securityGetState:(CDVInvokedUrlCommand*)command;
+- (void)securityCheckout:(CDVInvokedUrlCommand*)command;
+- (void)securitySetWatchdogOptions:(CDVInvokedUrlCommand*)command;
+- (void)emvSyncMessages:(CDVInvokedUrlCommand*)command;
+- (void)emvStartTransaction:(CDVInvokedUrlCommand*)command;
+- (void)emvCancelTransaction:(CDVInvokedUrlCommand*)command;
+- (void)msSetLoyaltyReading:(CDVInvokedUrlCommand*)command;
+
+@end
+
+@implementation InfineaSDKCordova
+{
+    infinea_journal _journal;
+    // Before and after pruning
+    InfineaSymbologyPhase _symbologyPhase[2];
+    infinea_assembler _assembler;
+}
+
+- (void)pluginInitialize
+{
+    self.pendingEvents = [NSMutableArray new];
+    self.pendingCallbacks = [NSMutableArray new];
+    self.commandQueue = dispatch_queue_create("com.ipcmobile.infinea.command", DISPATCH_QUEUE_SERIAL);
+    self.pogStats = [NSMutableDictionary new];
+    self.clockSamples = [NSMutableArray new];
+    self.clockSampleInterval = 300;
+    self.clockResyncThreshold = 2;
+    
+    self.startupBegin = [[NSProcessInfo processInfo] systemUptime];
+    self.startupTimings = [NSMutableDictionary new];
+    [self startupMark:@"pluginInitialize"];
+    
+    if ([self.webView isKindOfClass:WKWebView.class]) {
+        InfineaScriptMessageProxy *proxy = [InfineaScriptMessageProxy new];
+        proxy.target = self;
+        [((WKWebView *)self.webView).configuration.userContentController addScriptMessageHandler:proxy name:kScriptMessageHandlerName];
+    }
+    
+    self.journalQueue = dispatch_queue_create("com.ipcmobile.infinea.journal", DISPATCH_QUEUE_SERIAL);
+    self.journalSyncInterval = 200;
+    self.journalSyncRecords = 32;
+    
+    self.symbologyCounts = [NSMutableDictionary new];
+    self.rfCards = [NSMutableDictionary new];
+    self.felicaLimits = [NSMutableDictionary new];
+    self.rfSessions = [NSMutableDictionary new];
+    self.emvMessageTable = [NSMutableDictionary new];
+    self.loyaltyIDs = @[];
+    self.symbologyFailureLimit = 3;
+    self.securityWatchdog = YES;
+    self.securityMinInterval = 30;
+    self.securityMaxInterval = 600;
+    self.securityMaxAge = 900;
+    self.securityRequiredKeys = @[];
+    
+    // <preference name="InfineaJournal" value="true" />
+    if ([[self.commandDelegate.settings objectForKey:@"infineajournal"] boolValue]) {
+        [self openJournal:nil];
+    }
+    
+#ifdef INFINEA_TEST_DUKPT
+    // Local decryption with test BDKs for load tests, only compiled into test builds
+    // <preference name="InfineaTestDUKPT" value="true" />
+    if ([[self.commandDelegate.settings objectForKey:@"infineatestdukpt"] boolValue]) {
+        self.dukptEngines = [NSMutableDictionary new];
+    }
+#endif
+    
+    // Optionally start the accessory connect before the WebView has loaded. Last, so connect callbacks find all state
+    // set up; needs the onload param in plugin.xml to run at launch instead of on the first exec
+    // <preference name="InfineaConnectOnLoad" value="true" />
+    if ([[self.commandDelegate.settings objectForKey:@"infineaconnectonload"] boolValue]) {
+        [self connectDevice];
+    }
+}
+
+- (void)dispose
+{
+    if ([self.webView isKindOfClass:WKWebView.class]) {
+        [((WKWebView *)self.webView).configuration.userContentController removeScriptMessageHandlerForName:kScriptMessageHandlerName];
+    }
+    
+    [super dispose];
+}
+
+- (void)startupMark:(NSString *)phase
+{
+    NSTimeInterval elapsed = [[NSProcessInfo processInfo] systemUptime] - self.startupBegin;
+    @synchronized (self.startupTimings) {
+        if (!self.startupTimings[phase]) {
+            self.startupTimings[phase] = @(round(elapsed * 1000.0));
+        }
+    }
+}
+
+- (void)getStartupTimings:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call getStartupTimings");
+    
+    NSDictionary *timings = nil;
+    @synchronized (self.startupTimings) {
+        timings = [self.startupTimings copy];
+    }
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:timings];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+// Prototype
+- (void)coolMethod:(CDVInvokedUrlCommand*)command
+{
+    NSLog(@"Call coolMethod");
+    
+    CDVPluginResult* pluginResult = nil;
+    NSString* echo = [command.arguments objectAtIndex:0];
+    
+    if (echo != nil && [echo length] > 0) {
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsString:echo];
+    } else {
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR];
+    }
+    
+    [self sendPluginResult:pluginResult command:command];
+}
+// *********
+
+// Callback helper
+- (void)callback:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2)
+{
+    va_list args;
+    va_start(args, format);
+    NSString *javascript = [[NSString alloc] initWithFormat:format arguments:args];
+    va_end(args);
+    
+    // Held until the page registered the event channel, so the facade exists to receive it
+    @synchronized (self.pendingCallbacks) {
+        if (!self.eventCallbackId) {
+            [self.pendingCallbacks addObject:javascript];
+            return;
+        }
+    }
+    [self evaluateCallback:javascript];
+}
+
+- (void)evaluateCallback:(NSString *)javascript
+{
+    if ([self.webView isKindOfClass:WKWebView.class]) {
+        [(WKWebView*)self.webView evaluateJavaScript:javascript completionHandler:^(id result, NSError *error) {}];
+    }
+    else {
+        [(UIWebView*)self.webView stringByEvaluatingJavaScriptFromString: javascript];
+    }
+}
+
+
+// Batched event helper
+// Events are queued and flushed together on the next main loop pass as a single multipart
+// result, laid out as [name, argc, arg1...argN, name, argc, ...]. NSData arguments arrive in JS as ArrayBuffers.
+- (void)sendEvent:(NSString *)name arguments:(NSArray *)arguments
+{
+    @synchronized (self.pendingEvents) {
+        [self.pendingEvents addObject:name];
+        [self.pendingEvents addObject:@(arguments.count)];
+        [self.pendingEvents addObjectsFromArray:arguments];
+        
+        if (self.eventFlushScheduled) {
+            return;
+        }
+        self.eventFlushScheduled = YES;
+    }
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self flushEvents];
+    });
+}
+
+- (void)flushEvents
+{
+    NSArray *events = nil;
+    @synchronized (self.pendingEvents) {
+        self.eventFlushScheduled = NO;
+        // Events stay queued until registerEventChannel flushes them
+        if (!self.eventCallbackId) {
+            return;
+        }
+        events = [self.pendingEvents copy];
+        [self.pendingEvents removeAllObjects];
+    }
+    
+    if (events.count == 0) {
+        return;
+    }
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsMultipart:events];
+    [pluginResult setKeepCallbackAsBool:YES];
+    [self.commandDelegate sendPluginResult:pluginResult callbackId:self.eventCallbackId];
+}
+
+- (void)registerEventChannel:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call registerEventChannel");
+    
+    NSArray *callbacks = nil;
+    @synchronized (self.pendingCallbacks) {
+        self.eventCallbackId = command.callbackId;
+        callbacks = [self.pendingCallbacks copy];
+        [self.pendingCallbacks removeAllObjects];
+    }
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_NO_RESULT];
+    [pluginResult setKeepCallbackAsBool:YES];
+    [self sendPluginResult:pluginResult command:command];
+    
+    // Everything that happened before the page was ready, e.g. on a cold start with InfineaConnectOnLoad
+    for (NSString *javascript in callbacks) {
+        [self evaluateCallback:javascript];
+    }
+    [self flushEvents];
+}
+
+- (NSMutableDictionary *)pogStatsForSolution:(int)solution
+{
+    NSString *key = [NSString stringWithFormat:@"%i", solution];
+    NSMutableDictionary *stats = self.pogStats[key];
+    if (!stats) {
+        stats = [@{@"commands": @0,
+                   @"commandErrors": @0,
+                   @"bytesSent": @0,
+                   @"bytesReceived": @0,
+                   @"events": @0,
+                   @"eventBytes": @0
+                   } mutableCopy];
+        self.pogStats[key] = stats;
+    }
+    return stats;
+}
+
+- (void)pogStats:(int)solution add:(NSUInteger)value to:(NSString *)counter
+{
+    @synchronized (self.pogStats) {
+        NSMutableDictionary *stats = [self pogStatsForSolution:solution];
+        stats[counter] = @([stats[counter] unsignedLongLongValue] + value);
+    }
+}
+
+
+#pragma mark - Clock correlation
+// Number of samples the offset/drift regression is computed over
+static const NSUInteger kClockWindow = 16;
+
+- (void)clockStart
+{
+    [self clockStop];
+    
+    @synchronized (self.clockSamples) {
+        [self.clockSamples removeAllObjects];
+    }
+    
+    self.clockTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.commandQueue);
+    dispatch_source_set_timer(self.clockTimer, dispatch_time(DISPATCH_TIME_NOW, 0), (uint64_t)(self.clockSampleInterval * NSEC_PER_SEC), NSEC_PER_SEC);
+    
+    __weak InfineaSDKCordova *weakSelf = self;
+    dispatch_source_set_event_handler(self.clockTimer, ^{
+        [weakSelf clockSample];
+    });
+    dispatch_resume(self.clockTimer);
+}
+
+- (void)clockStop
+{
+    if (self.clockTimer) {
+        dispatch_source_cancel(self.clockTimer);
+        self.clockTimer = nil;
+    }
+}
+
+// Runs on the command queue
+- (void)clockSample
+{
+    NSError *error = nil;
+    NSTimeInterval before = [[NSProcessInfo processInfo] systemUptime];
+    NSDate *deviceDate = [self.ipc rtcGetDeviceDate:&error];
+    NSTimeInterval after = [[NSProcessInfo processInfo] systemUptime];
+    
+    if (!deviceDate) {
+        NSLog(@"Clock sample error: %@", error.localizedDescription);
+        return;
+    }
+    
+    // Assume the device read its clock halfway through the round trip
+    NSTimeInterval host = (before + after) / 2.0;
+    NSTimeInterval wallError = [deviceDate timeIntervalSinceDate:[NSDate dateWithTimeIntervalSinceNow:host - after]];
+    
+    if (fabs(wallError) > self.clockResyncThreshold) {
+        if ([self.ipc rtcSetDeviceDate:[NSDate date] error:&error]) {
+            NSLog(@"Device clock resynced, was off by %.3fs", wallError);
+            self.clockLastResync = [NSDate date];
+            @synchronized (self.clockSamples) {
+                [self.clockSamples removeAllObjects];
+            }
+        }
+        else {
+            NSLog(@"Device clock resync error: %@", error.localizedDescription);
+        }
+        return;
+    }
+    
+    @synchronized (self.clockSamples) {
+        [self.clockSamples addObject:@[@(host), @([deviceDate timeIntervalSince1970] - host)]];
+        if (self.clockSamples.count > kClockWindow) {
+            [self.clockSamples removeObjectAtIndex:0];
+        }
+        
+        // Least squares fit of offset = a + b * host over the window
+        NSUInteger n = self.clockSamples.count;
+        double meanX = 0, meanY = 0;
+        for (NSArray *sample in self.clockSamples) {
+            meanX += [sample[0] doubleValue];
+            meanY += [sample[1] doubleValue];
+        }
+        meanX /= n;
+        meanY /= n;
+        
+        double sxy = 0, sxx = 0;
+        for (NSArray *sample in self.clockSamples) {
+            double dx = [sample[0] doubleValue] - meanX;
+            sxy += dx * ([sample[1] doubleValue] - meanY);
+            sxx += dx * dx;
+        }
+        
+        self.clockDrift = sxx > 0 ? sxy / sxx : 0;
+        self.clockOffset = meanY - self.clockDrift * meanX;
+    }
+}
+
+// Converts a device timestamp to the host wall clock using the current offset/drift estimate
+- (NSDate *)hostDateForDeviceDate:(NSDate *)deviceDate
+{
+    double offset, drift;
+    @synchronized (self.clockSamples) {
+        if (self.clockSamples.count == 0) {
+            return deviceDate;
+        }
+        offset = self.clockOffset;
+        drift = self.clockDrift;
+    }
+    
+    // device = host * (1 + drift) + offset
+    NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+    NSTimeInterval host = ([deviceDate timeIntervalSince1970] - offset) / (1.0 + drift);
+    return [NSDate dateWithTimeIntervalSinceNow:host - now];
+}
+
+- (NSDictionary *)clockCorrelationSnapshot
+{
+    NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+    @synchronized (self.clockSamples) {
+        // Without samples there is no fit, offset and drift are not measured yet
+        BOOL fitted = self.clockSamples.count > 0;
+        NSTimeInterval deviceNow = now + self.clockOffset + self.clockDrift * now;
+        return @{@"samples": @(self.clockSamples.count),
+                 @"offsetMs": fitted ? @((deviceNow - [[NSDate date] timeIntervalSince1970]) * 1000.0) : [NSNull null],
+                 @"driftPPM": fitted ? @(self.clockDrift * 1000000.0) : [NSNull null],
+                 @"lastResync": self.clockLastResync ? @([self.clockLastResync timeIntervalSince1970] * 1000.0) : [NSNull null]
+                 };
+    }
+}
+
+- (void)clockGetCorrelation:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call clockGetCorrelation");
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:[self clockCorrelationSnapshot]];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+- (void)clockSetCorrelationOptions:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call clockSetCorrelationOptions");
+    
+    CDVPluginResult *pluginResult = nil;
+    NSTimeInterval interval = [command.arguments[0] doubleValue];
+    NSTimeInterval threshold = [command.arguments[1] doubleValue];
+    
+    if (interval < 1 || threshold <= 0) {
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Invalid clock correlation options!"];
+    }
+    else {
+        self.clockSampleInterval = interval;
+        self.clockResyncThreshold = threshold;
+        if (self.clockTimer) {
+            [self clockStart];
+        }
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    }
+    
+    [self sendPluginResult:pluginResult command:command];
+}
+
+- (void)clockCorrectDeviceTime:(CDVInvokedUrlCommand *)command
+{
+    NSDate *deviceDate = [NSDate dateWithTimeIntervalSince1970:[command.arguments[0] doubleValue] / 1000.0];
+    NSDate *hostDate = [self hostDateForDeviceDate:deviceDate];
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDouble:[hostDate timeIntervalSince1970] * 1000.0];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+
+#pragma mark - Direct command channel
+// Commands posted to window.webkit.messageHandlers.infinea as {id, action, args} are dispatched straight to the
+// plugin method, skipping Cordova's exec queue. Replies go back through callAsyncJavaScript arguments.
+// Only the actions execDirect is used for are dispatched, and only for the main frame, so embedded frames cannot
+// reach arbitrary plugin selectors.
+- (void)userContentController:(WKUserContentController *)userContentController didReceiveScriptMessage:(WKScriptMessage *)message
+{
+    static NSSet<NSString *> *directActions;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        directActions = [NSSet setWithArray:@[@"barcodeStartScan", @"barcodeStopScan", @"rfInit", @"rfClose", @"ping"]];
+    });
+    
+    if (!message.frameInfo.isMainFrame || ![message.body isKindOfClass:[NSDictionary class]]) {
+        return;
+    }
+    
+    NSDictionary *body = message.body;
+    NSString *action = [body[@"action"] isKindOfClass:[NSString class]] ? body[@"action"] : @"";
+    NSArray *arguments = [body[@"args"] isKindOfClass:[NSArray class]] ? body[@"args"] : @[];
+    NSString *callbackId = [NSString stringWithFormat:@"%@%@", kDirectCallbackPrefix, body[@"id"]];
+    
+    CDVInvokedUrlCommand *command = [[CDVInvokedUrlCommand alloc] initWithArguments:arguments callbackId:callbackId className:@"InfineaSDKCordova" methodName:action];
+    
+    SEL selector = NSSelectorFromString([NSString stringWithFormat:@"%@:", action]);
+    if (![directActions containsObject:action] || ![self respondsToSelector:selector]) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_INVALID_ACTION messageAsString:@"Unknown action!"];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Warc-performSelector-leaks"
+    [self performSelector:selector withObject:command];
+#pragma clang diagnostic pop
+}
+
+// All command results go through here so commands from either channel are answered on the channel they came from
+- (void)sendPluginResult:(CDVPluginResult *)pluginResult command:(CDVInvokedUrlCommand *)command
+{
+    if (![command.callbackId hasPrefix:kDirectCallbackPrefix]) {
+        [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+        return;
+    }
+    
+    if ([pluginResult.status intValue] == CDVCommandStatus_NO_RESULT) {
+        return;
+    }
+    
+    NSDictionary *reply = @{@"id": @([[command.callbackId substringFromIndex:kDirectCallbackPrefix.length] longLongValue]),
+                            @"ok": @([pluginResult.status intValue] == CDVCommandStatus_OK),
+                            @"value": pluginResult.message ?: [NSNull null]
+                            };
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+        WKWebView *webView = (WKWebView *)self.webView;
+        if (@available(iOS 14.0, *)) {
+            [webView callAsyncJavaScript:@"Infinea._directReply(id, ok, value)" arguments:reply inFrame:nil inContentWorld:WKContentWorld.pageWorld completionHandler:nil];
+        }
+        else {
+            NSString *javascript = [NSString stringWithFormat:@"(function(r){Infinea._directReply(r.id, r.ok, r.value);})(%@)", InfineaJSONString(reply)];
+            [webView evaluateJavaScript:javascript completionHandler:nil];
+        }
+    });
+}
+
+// No-op round trip, used to benchmark the command channels
+- (void)ping:(CDVInvokedUrlCommand *)command
+{
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsArray:command.arguments];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+
+#pragma mark - Scan journal
+- (NSURL *)journalURL
+{
+    NSURL *supportURL = [[[NSFileManager defaultManager] URLsForDirectory:NSApplicationSupportDirectory inDomains:NSUserDomainMask] firstObject];
+    return [supportURL URLByAppendingPathComponent:@"Infinea/scan.journal"];
+}
+
+- (BOOL)openJournal:(NSError **)error
+{
+    @synchronized (self.journalQueue) {
+        if (self.journalOpen) {
+            return YES;
+        }
+        
+        NSURL *url = [self journalURL];
+        NSURL *directoryURL = [url URLByDeletingLastPathComponent];
+        if (![[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:error]) {
+            return NO;
+        }
+        
+        // Scans can include card data, keep them out of backups and encrypted while the device is locked after boot.
+        // Compaction renames a new file over the journal, so both are set on the directory as well: the exclusion covers
+        // everything in it and new files take the directory's protection class.
+        [[NSFileManager defaultManager] setAttributes:@{NSFileProtectionKey: NSFileProtectionCompleteUntilFirstUserAuthentication} ofItemAtPath:directoryURL.path error:nil];
+        [directoryURL setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+        
+        if (infinea_journal_open(&_journal, url.fileSystemRepresentation) != 0) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            }
+            return NO;
+        }
+        
+        [self protectJournalFile];
+        
+        self.journalOpen = YES;
+        return YES;
+    }
+}
+
+- (void)protectJournalFile
+{
+    NSURL *url = [self journalURL];
+    [[NSFileManager defaultManager] setAttributes:@{NSFileProtectionKey: NSFileProtectionCompleteUntilFirstUserAuthentication} ofItemAtPath:url.path error:nil];
+    [url setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+}
+
+// Journals an event before it is delivered to JS, returns its sequence number or 0 if the journal is not open
+- (uint64_t)journalEvent:(NSString *)name arguments:(NSArray *)arguments
+{
+    if (!self.journalOpen) {
+        return 0;
+    }
+    
+    NSData *json = [NSJSONSerialization dataWithJSONObject:@[name, arguments] options:0 error:nil];
+    if (!json) {
+        return 0;
+    }
+    
+    uint64_t seq = 0;
+    BOOL syncNow = NO;
+    BOOL scheduleSync = NO;
+    @synchronized (self.journalQueue) {
+        seq = infinea_journal_append(&_journal, json.bytes, json.length);
+        if (seq == 0) {
+            NSLog(@"Journal append error: %s", strerror(errno));
+            return 0;
+        }
+        
+        // Group commit: one fsync per journalSyncRecords entries or journalSyncInterval ms, whichever comes first
+        self.journalUnsynced++;
+        if (self.journalUnsynced >= self.journalSyncRecords) {
+            self.journalUnsynced = 0;
+            syncNow = YES;
+        }
+        else if (!self.journalSyncScheduled) {
+            self.journalSyncScheduled = YES;
+            scheduleSync = YES;
+        }
+    }
+    
+    if (syncNow) {
+        dispatch_async(self.journalQueue, ^{
+            [self syncJournal];
+        });
+    }
+    else if (scheduleSync) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)self.journalSyncInterval * NSEC_PER_MSEC), self.journalQueue, ^{
+            [self syncJournal];
+        });
+    }
+    
+    return seq;
+}
+
+// Runs on the journal queue. fsync only needs the descriptor, appends can continue meanwhile.
+- (void)syncJournal
+{
+    @synchronized (self.journalQueue) {
+        self.journalUnsynced = 0;
+        self.journalSyncScheduled = NO;
+    }
+    
+    if (infinea_journal_sync(&_journal) != 0) {
+        NSLog(@"Journal sync error: %s", strerror(errno));
+    }
+}
+
+static void InfineaJournalReplayVisitor(uint64_t seq, const uint8_t *data, size_t length, void *context)
+{
+    InfineaSDKCordova *plugin = (__bridge InfineaSDKCordova *)context;
+    NSArray *entry = [NSJSONSerialization JSONObjectWithData:[NSData dataWithBytesNoCopy:(void *)data length:length freeWhenDone:NO] options:0 error:nil];
+    if ([entry isKindOfClass:[NSArray class]] && entry.count == 2) {
+        [plugin sendEvent:@"journalEntry" arguments:@[@(seq), entry[0], entry[1]]];
+    }
+}
+
+- (void)journalOpen:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call journalOpen");
+    
+    CDVPluginResult *pluginResult = nil;
+    NSError *error = nil;
+    if ([self openJournal:&error]) {
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    }
+    else {
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+    }
+    
+    [self sendPluginResult:pluginResult command:command];
+}
+
+- (void)journalReplay:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call journalReplay");
+    
+    dispatch_async(self.journalQueue, ^{
+        CDVPluginResult *pluginResult = nil;
+        long count = -1;
+        @synchronized (self.journalQueue) {
+            if (self.journalOpen) {
+                count = infinea_journal_replay(&self->_journal, InfineaJournalReplayVisitor, (__bridge void *)self);
+            }
+        }
+        
+        if (count >= 0) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsInt:(int)count];
+        }
+        else {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:self.journalOpen ? @(strerror(errno)) : @"Journal is not open!"];
+        }
+        
+        // Entries are queued on the event channel, so the result arrives after them
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self sendPluginResult:pluginResult command:command];
+        });
+    });
+}
+
+- (void)journalAcknowledge:(CDVInvokedUrlCommand *)command
+{
+    uint64_t seq = [command.arguments[0] unsignedLongLongValue];
+    
+    dispatch_async(self.journalQueue, ^{
+        CDVPluginResult *pluginResult = nil;
+        int status = -1;
+        @synchronized (self.journalQueue) {
+            if (self.journalOpen) {
+                int fd = self->_journal.fd;
+                status = infinea_journal_ack(&self->_journal, seq);
+                // A compacting ack renamed a new file over the journal, which does not keep the old one's attributes
+                if (status == 0 && self->_journal.fd != fd) {
+                    [self protectJournalFile];
+                }
+            }
+        }
+        
+        if (status == 0) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+        }
+        else {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:self.journalOpen ? @(strerror(errno)) : @"Journal is not open!"];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+- (void)journalSetSyncPolicy:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call journalSetSyncPolicy");
+    
+    CDVPluginResult *pluginResult = nil;
+    int interval = [command.arguments[0] intValue];
+    int records = [command.arguments[1] intValue];
+    
+    if (interval < 1 || records < 1) {
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Invalid journal sync policy!"];
+    }
+    else {
+        @synchronized (self.journalQueue) {
+            self.journalSyncInterval = interval;
+            self.journalSyncRecords = records;
+        }
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    }
+    
+    [self sendPluginResult:pluginResult command:command];
+}
+
+
+#pragma mark - Batch export
+static int InfineaExportFileSink(const uint8_t *data, size_t length, void *context)
+{
+    return fwrite(data, 1, length, (FILE *)context) == length ? 0 : -1;
+}
+
+static int InfineaExportDataSink(const uint8_t *data, size_t length, void *context)
+{
+    [(__bridge NSMutableData *)context appendBytes:data length:length];
+    return 0;
+}
+
+// Copies journal entries so they can be compressed after the journal lock is released
+static void InfineaExportJournalVisitor(uint64_t seq, const uint8_t *data, size_t length, void *context)
+{
+    [(__bridge NSMutableArray *)context addObject:@[@(seq), [NSData dataWithBytes:data length:length]]];
+}
+
+// Exported files belong to the caller until the next export, older ones are removed before a new one is written
+static void InfineaRemoveExportFiles(void)
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    for (NSString *name in [fileManager contentsOfDirectoryAtPath:NSTemporaryDirectory() error:nil]) {
+        if ([name hasPrefix:@"infinea-export-"] && [name.pathExtension isEqualToString:@"ijx"]) {
+            [fileManager removeItemAtPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name] error:nil];
+        }
+    }
+}
+
+- (void)exportBatch:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call exportBatch");
+    
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    BOOL includeJournal = options[@"journal"] ? [options[@"journal"] boolValue] : YES;
+    BOOL includeTelemetry = options[@"telemetry"] ? [options[@"telemetry"] boolValue] : YES;
+    BOOL asArrayBuffer = [options[@"arrayBuffer"] boolValue];
+    
+    // Compression runs on a background queue, the journal lock is only held while its entries are read
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+        infinea_export_writer *writer = malloc(sizeof(infinea_export_writer));
+        NSMutableData *data = nil;
+        NSString *path = nil;
+        FILE *file = NULL;
+        int status;
+        
+        if (asArrayBuffer) {
+            data = [NSMutableData new];
+            status = infinea_export_begin(writer, InfineaExportDataSink, (__bridge void *)data);
+        }
+        else {
+            InfineaRemoveExportFiles();
+            path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"infinea-export-%.0f.ijx", [[NSDate date] timeIntervalSince1970] * 1000.0]];
+            // The export holds card data, create it protected before anything is written
+            if ([[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:@{NSFileProtectionKey: NSFileProtectionComplete}]) {
+                file = fopen(path.fileSystemRepresentation, "wb");
+            }
+            status = file ? infinea_export_begin(writer, InfineaExportFileSink, file) : -1;
+        }
+        
+        if (status == 0 && includeJournal) {
+            NSMutableArray *entries = [NSMutableArray new];
+            @synchronized (self.journalQueue) {
+                if (self.journalOpen && infinea_journal_replay(&self->_journal, InfineaExportJournalVisitor, (__bridge void *)entries) < 0) {
+                    status = -1;
+                }
+            }
+            for (NSArray *entry in entries) {
+                if (status != 0) {
+                    break;
+                }
+                NSData *payload = entry[1];
+                status = infinea_export_add(writer, INFINEA_EXPORT_JOURNAL, [entry[0] unsignedLongLongValue], payload.bytes, payload.length);
+            }
+        }
+        
+        if (status == 0 && includeTelemetry) {
+            NSDictionary *telemetry = nil;
+            @synchronized (self.startupTimings) {
+                telemetry = @{@"time": @([[NSDate date] timeIntervalSince1970] * 1000.0),
+                              @"pog": [self pogStatsSnapshot],
+                              @"clock": [self clockCorrelationSnapshot],
+                              @"startup": [self.startupTimings copy]
+                              };
+            }
+            NSData *json = [NSJSONSerialization dataWithJSONObject:telemetry options:0 error:nil];
+            status = infinea_export_add(writer, INFINEA_EXPORT_TELEMETRY, 0, json.bytes, json.length);
+        }
+        
+        if (status == 0) {
+            status = infinea_export_finish(writer);
+        }
+        if (file && fclose(file) != 0) {
+            status = -1;
+        }
+        
+        CDVPluginResult *pluginResult = nil;
+        if (status == 0) {
+            NSDictionary *stats = @{@"path": path ?: [NSNull null],
+                                    @"records": @(writer->records),
+                                    @"rawBytes": @(writer->raw_bytes),
+                                    @"exportBytes": @(writer->written_bytes),
+                                    @"chunks": @(writer->chunks),
+                                    @"ms": @(round(([[NSProcessInfo processInfo] systemUptime] - start) * 1000.0))
+                                    };
+            if (asArrayBuffer) {
+                pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsMultipart:@[stats, data]];
+            }
+            else {
+                pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:stats];
+            }
+        }
+        else {
+            if (path) {
+                [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+            }
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Unable to write export!"];
+        }
+        
+        free(writer);
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+
+#pragma mark - Configuration profiles
+// Profiles are compiled from JSON into a canonical list of ops: u8 op, u8 flags, u16 payload length, payload.
+// Numeric payloads are little endian int64 values. The SHA-256 of the compiled bytes identifies the profile.
+typedef NS_ENUM(uint8_t, InfineaProfileOp) {
+    InfineaProfileOpScanMode = 1,
+    InfineaProfileOpScanButtonMode = 2,
+    InfineaProfileOpTypeMode = 3,
+    InfineaProfileOpUPCZeroStrip = 4,
+    InfineaProfileOpScanBeep = 5,
+    InfineaProfileOpEngineInitString = 6,
+    InfineaProfileOpCodeParam = 7,
+    InfineaProfileOpMSREncryption = 8,
+    InfineaProfileOpMSRActiveHead = 9,
+    InfineaProfileOpMSRMasking = 10,
+    InfineaProfileOpAutoOff = 11,
+    InfineaProfileOpUSBChargeCurrent = 12,
+    InfineaProfileOpPassThroughSync = 13,
+    InfineaProfileOpCharging = 14,
+};
+
+// The setting survives a reconnect once saved to flash
+static const uint8_t kProfileFlagPersistent = 0x01;
+
+static NSString * const kProfileHashesKey = @"InfineaProfileHashes";
+static NSString * const kActiveProfileKey = @"InfineaActiveProfile";
+
+static void InfineaProfileAppend(NSMutableData *compiled, InfineaProfileOp op, BOOL persistent, NSData *payload)
+{
+    uint8_t header[4] = { op, persistent ? kProfileFlagPersistent : 0, (uint8_t)payload.length, (uint8_t)(payload.length >> 8) };
+    [compiled appendBytes:header length:sizeof(header)];
+    [compiled appendData:payload];
+}
+
+// Returns nil unless every value is a number or a string holding only a decimal integer
+static NSData *InfineaProfileValues(NSArray *values)
+{
+    NSMutableData *payload = [NSMutableData dataWithCapacity:values.count * 8];
+    for (id value in values) {
+        long long v = 0;
+        if ([value isKindOfClass:[NSNumber class]]) {
+            v = [value longLongValue];
+        }
+        else if (![value isKindOfClass:[NSString class]]) {
+            return nil;
+        }
+        else {
+            NSScanner *scanner = [NSScanner scannerWithString:value];
+            if (![scanner scanLongLong:&v] || !scanner.isAtEnd) {
+                return nil;
+            }
+        }
+        uint8_t bytes[8];
+        for (int i = 0; i < 8; i++) {
+            bytes[i] = (uint8_t)((uint64_t)v >> (8 * i));
+        }
+        [payload appendBytes:bytes length:sizeof(bytes)];
+    }
+    return payload;
+}
+
+static int64_t InfineaProfileValue(const uint8_t *payload, NSUInteger length, NSUInteger index)
+{
+    if ((index + 1) * 8 > length) {
+        return 0;
+    }
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | payload[index * 8 + i];
+    }
+    return (int64_t)v;
+}
+
+- (NSData *)compileProfile:(NSDictionary *)profile error:(NSString **)error
+{
+    NSMutableData *compiled = [NSMutableData new];
+    __block BOOL invalid = NO;
+    NSData *(^values)(NSArray *) = ^NSData *(NSArray *list) {
+        NSData *payload = InfineaProfileValues(list);
+        invalid = invalid || !payload;
+        return payload ?: [NSData data];
+    };
+    
+    // Keys are compiled in a fixed order, so equal profiles always hash the same
+    if (profile[@"scanMode"]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpScanMode, NO, values(@[profile[@"scanMode"]]));
+    }
+    if (profile[@"scanButtonMode"]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpScanButtonMode, YES, values(@[profile[@"scanButtonMode"]]));
+    }
+    if (profile[@"typeMode"]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpTypeMode, NO, values(@[profile[@"typeMode"]]));
+    }
+    if (profile[@"upcZeroStrip"]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpUPCZeroStrip, NO, values(@[profile[@"upcZeroStrip"]]));
+    }
+    
+    NSDictionary *beep = profile[@"scanBeep"];
+    if ([beep isKindOfClass:[NSDictionary class]]) {
+        NSMutableArray *beepValues = [NSMutableArray arrayWithObjects:beep[@"enabled"] ?: @YES, beep[@"volume"] ?: @100, nil];
+        if ([beep[@"data"] isKindOfClass:[NSArray class]]) {
+            [beepValues addObjectsFromArray:beep[@"data"]];
+        }
+        InfineaProfileAppend(compiled, InfineaProfileOpScanBeep, NO, values(beepValues));
+    }
+    
+    if ([profile[@"engineInitString"] isKindOfClass:[NSString class]]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpEngineInitString, NO, [profile[@"engineInitString"] dataUsingEncoding:NSUTF8StringEncoding]);
+    }
+    
+    NSDictionary *codeParams = profile[@"codeParams"];
+    if ([codeParams isKindOfClass:[NSDictionary class]]) {
+        NSArray *settings = [codeParams.allKeys sortedArrayUsingComparator:^NSComparisonResult(NSString *a, NSString *b) {
+            return [@(strtoll(a.UTF8String, NULL, 0)) compare:@(strtoll(b.UTF8String, NULL, 0))];
+        }];
+        for (NSString *setting in settings) {
+            InfineaProfileAppend(compiled, InfineaProfileOpCodeParam, YES, values(@[@(strtoll(setting.UTF8String, NULL, 0)), codeParams[setting]]));
+        }
+    }
+    
+    NSDictionary *msr = profile[@"msr"];
+    if ([msr isKindOfClass:[NSDictionary class]]) {
+        if (msr[@"activeHead"]) {
+            InfineaProfileAppend(compiled, InfineaProfileOpMSRActiveHead, NO, values(@[msr[@"activeHead"]]));
+        }
+        if (msr[@"encryption"]) {
+            NSMutableData *payload = [values(@[msr[@"encryption"], msr[@"keyID"] ?: @0]) mutableCopy];
+            if ([msr[@"params"] isKindOfClass:[NSDictionary class]]) {
+                NSData *params = [NSJSONSerialization dataWithJSONObject:msr[@"params"] options:NSJSONWritingSortedKeys error:nil];
+                if (params) {
+                    [payload appendData:params];
+                }
+            }
+            InfineaProfileAppend(compiled, InfineaProfileOpMSREncryption, YES, payload);
+        }
+        NSDictionary *masking = msr[@"masking"];
+        if ([masking isKindOfClass:[NSDictionary class]]) {
+            InfineaProfileAppend(compiled, InfineaProfileOpMSRMasking, YES, values(@[masking[@"showExpiration"] ?: @NO,
+                                                                                      masking[@"showServiceCode"] ?: @NO,
+                                                                                      masking[@"unmaskedDigitsAtStart"] ?: @4,
+                                                                                      masking[@"unmaskedDigitsAtEnd"] ?: @4,
+                                                                                      masking[@"unmaskedDigitsAfter"] ?: @0]));
+        }
+    }
+    
+    NSDictionary *autoOff = profile[@"autoOff"];
+    if ([autoOff isKindOfClass:[NSDictionary class]]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpAutoOff, YES, values(@[autoOff[@"idle"] ?: @5400, autoOff[@"disconnected"] ?: @30]));
+    }
+    if (profile[@"usbChargeCurrent"]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpUSBChargeCurrent, YES, values(@[profile[@"usbChargeCurrent"]]));
+    }
+    if (profile[@"passThroughSync"]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpPassThroughSync, YES, values(@[profile[@"passThroughSync"]]));
+    }
+    if (profile[@"charging"]) {
+        InfineaProfileAppend(compiled, InfineaProfileOpCharging, NO, values(@[profile[@"charging"]]));
+    }
+    
+    if (invalid) {
+        if (error) {
+            *error = @"Invalid profile!";
+        }
+        return nil;
+    }
+    if (compiled.length == 0) {
+        if (error) {
+            *error = @"Profile contains no settings!";
+        }
+        return nil;
+    }
+    return compiled;
+}
+
+static NSString *InfineaProfileHash(NSData *compiled)
+{
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(compiled.bytes, (CC_LONG)compiled.length, digest);
+    return InfineaHexString([NSData dataWithBytes:digest length:sizeof(digest)]);
+}
+
+// Calls block for each op, stops early when the block returns NO
+static void InfineaProfileEnumerate(NSData *compiled, BOOL (^block)(InfineaProfileOp op, BOOL persistent, const uint8_t *payload, NSUInteger length))
+{
+    const uint8_t *bytes = compiled.bytes;
+    NSUInteger offset = 0;
+    while (compiled.length - offset >= 4) {
+        NSUInteger length = bytes[offset + 2] | (bytes[offset + 3] << 8);
+        if (compiled.length - offset - 4 < length) {
+            return;
+        }
+        if (!block(bytes[offset], (bytes[offset + 1] & kProfileFlagPersistent) != 0, bytes + offset + 4, length)) {
+            return;
+        }
+        offset += 4 + length;
+    }
+}
+
+// Runs on the command queue
+- (BOOL)applyProfileOp:(InfineaProfileOp)op payload:(const uint8_t *)payload length:(NSUInteger)length error:(NSError **)error
+{
+    switch (op) {
+        case InfineaProfileOpScanMode:
+            return [self.ipc barcodeSetScanMode:(SCAN_MODES)InfineaProfileValue(payload, length, 0) error:error];
+        case InfineaProfileOpScanButtonMode:
+            return [self.ipc barcodeSetScanButtonMode:(int)InfineaProfileValue(payload, length, 0) error:error];
+        case InfineaProfileOpTypeMode:
+            return [self.ipc barcodeSetTypeMode:(int)InfineaProfileValue(payload, length, 0) error:error];
+        case InfineaProfileOpUPCZeroStrip:
+            return [self.ipc barcodeSetUPCZeroStrip:InfineaProfileValue(payload, length, 0) != 0 error:error];
+        case InfineaProfileOpScanBeep: {
+            NSUInteger count = length / 8 > 2 ? length / 8 - 2 : 0;
+            int beepData[count > 0 ? count : 1];
+            for (NSUInteger i = 0; i < count; i++) {
+                beepData[i] = (int)InfineaProfileValue(payload, length, i + 2);
+            }
+            return [self.ipc barcodeSetScanBeep:InfineaProfileValue(payload, length, 0) != 0 volume:(int)InfineaProfileValue(payload, length, 1) beepData:beepData length:(int)(count * sizeof(int)) error:error];
+        }
+        case InfineaProfileOpEngineInitString:
+            return [self.ipc barcodeEngineSetInitString:[[NSString alloc] initWithBytes:payload length:length encoding:NSUTF8StringEncoding] error:error];
+        case InfineaProfileOpCodeParam:
+            return [self.ipc barcodeCodeSetParam:(int)InfineaProfileValue(payload, length, 0) value:(uint64_t)InfineaProfileValue(payload, length, 1) error:error];
+        case InfineaProfileOpMSREncryption: {
+            NSDictionary *params = nil;
+            if (length > 16) {
+                params = [NSJSONSerialization JSONObjectWithData:[NSData dataWithBytes:payload + 16 length:length - 16] options:0 error:nil];
+            }
+            return [self.ipc emsrSetEncryption:(int)InfineaProfileValue(payload, length, 0) keyID:(int)InfineaProfileValue(payload, length, 1) params:params error:error];
+        }
+        case InfineaProfileOpMSRActiveHead:
+            return [self.ipc emsrSetActiveHead:(int)InfineaProfileValue(payload, length, 0) error:error];
+        case InfineaProfileOpMSRMasking:
+            return [self.ipc emsrConfigMaskedDataShowExpiration:InfineaProfileValue(payload, length, 0) != 0
+                                                showServiceCode:InfineaProfileValue(payload, length, 1) != 0
+                                          unmaskedDigitsAtStart:(int)InfineaProfileValue(payload, length, 2)
+                                            unmaskedDigitsAtEnd:(int)InfineaProfileValue(payload, length, 3)
+                                            unmaskedDigitsAfter:(int)InfineaProfileValue(payload, length, 4)
+                                                          error:error];
+        case InfineaProfileOpAutoOff:
+            return [self.ipc setAutoOffWhenIdle:InfineaProfileValue(payload, length, 0) whenDisconnected:InfineaProfileValue(payload, length, 1) error:error];
+        case InfineaProfileOpUSBChargeCurrent:
+            return [self.ipc setUSBChargeCurrent:(int)InfineaProfileValue(payload, length, 0) error:error];
+        case InfineaProfileOpPassThroughSync:
+            return [self.ipc setPassThroughSync:InfineaProfileValue(payload, length, 0) != 0 error:error];
+        case InfineaProfileOpCharging:
+            return [self.ipc setCharging:InfineaProfileValue(payload, length, 0) != 0 error:error];
+    }
+    return YES;
+}
+
+// Reads the current value of an op's setting as a compiled op, nil if the setting can not be read back
+- (NSData *)readProfileOp:(InfineaProfileOp)op payload:(const uint8_t *)payload length:(NSUInteger)length
+{
+    NSMutableData *undo = [NSMutableData new];
+    switch (op) {
+        case InfineaProfileOpScanMode: {
+            SCAN_MODES mode;
+            if (![self.ipc barcodeGetScanMode:&mode error:nil]) return nil;
+            InfineaProfileAppend(undo, op, NO, InfineaProfileValues(@[@(mode)]));
+            break;
+        }
+        case InfineaProfileOpScanButtonMode: {
+            int mode;
+            if (![self.ipc barcodeGetScanButtonMode:&mode error:nil]) return nil;
+            InfineaProfileAppend(undo, op, YES, InfineaProfileValues(@[@(mode)]));
+            break;
+        }
+        case InfineaProfileOpTypeMode: {
+            int mode;
+            if (![self.ipc barcodeGetTypeMode:&mode error:nil]) return nil;
+            InfineaProfileAppend(undo, op, NO, InfineaProfileValues(@[@(mode)]));
+            break;
+        }
+        case InfineaProfileOpCodeParam: {
+            uint64_t value;
+            if (![self.ipc barcodeCodeGetParam:(int)InfineaProfileValue(payload, length, 0) value:&value error:nil]) return nil;
+            InfineaProfileAppend(undo, op, YES, InfineaProfileValues(@[@(InfineaProfileValue(payload, length, 0)), @(value)]));
+            break;
+        }
+        case InfineaProfileOpAutoOff: {
+            NSTimeInterval idle, disconnected;
+            if (![self.ipc getAutoOffWhenIdle:&idle whenDisconnected:&disconnected error:nil]) return nil;
+            InfineaProfileAppend(undo, op, YES, InfineaProfileValues(@[@(idle), @(disconnected)]));
+            break;
+        }
+        case InfineaProfileOpUSBChargeCurrent: {
+            int current;
+            if (![self.ipc getUSBChargeCurrent:&current error:nil]) return nil;
+            InfineaProfileAppend(undo, op, YES, InfineaProfileValues(@[@(current)]));
+            break;
+        }
+        case InfineaProfileOpPassThroughSync: {
+            BOOL enabled;
+            if (![self.ipc getPassThroughSync:&enabled error:nil]) return nil;
+            InfineaProfileAppend(undo, op, YES, InfineaProfileValues(@[@(enabled)]));
+            break;
+        }
+        case InfineaProfileOpCharging: {
+            BOOL charging;
+            if (![self.ipc getCharging:&charging error:nil]) return nil;
+            InfineaProfileAppend(undo, op, NO, InfineaProfileValues(@[@(charging)]));
+            break;
+        }
+        default:
+            return nil;
+    }
+    return undo;
+}
+
+// Runs on the command queue. Applies the profile, or only its non-persistent ops when the device already
+// holds this profile in flash. On failure, settings that can be read back are restored.
+- (NSDictionary *)applyProfile:(NSData *)compiled error:(NSError **)error
+{
+    NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+    NSString *hash = InfineaProfileHash(compiled);
+    NSString *serial = self.ipc.serialNumber ?: @"";
+    NSDictionary *hashes = [[NSUserDefaults standardUserDefaults] dictionaryForKey:kProfileHashesKey];
+    
+    // Every persistent setting that can be read back must match, otherwise the device was reset or changed since
+    // the profile was saved. A profile without readable settings is trusted on its hash but reported unverified.
+    __block BOOL persisted = serial.length > 0 && [hashes[serial] isEqualToString:hash];
+    __block int readable = 0;
+    if (persisted) {
+        InfineaProfileEnumerate(compiled, ^BOOL(InfineaProfileOp op, BOOL persistent, const uint8_t *payload, NSUInteger length) {
+            if (!persistent) {
+                return YES;
+            }
+            NSData *current = [self readProfileOp:op payload:payload length:length];
+            if (current) {
+                NSMutableData *expected = [NSMutableData new];
+                InfineaProfileAppend(expected, op, YES, [NSData dataWithBytes:payload length:length]);
+                persisted = [current isEqualToData:expected];
+                readable++;
+            }
+            return persisted;
+        });
+    }
+    
+    __block int applied = 0;
+    __block int skipped = 0;
+    __block NSError *opError = nil;
+    NSMutableArray *undo = [NSMutableArray new];
+    
+    InfineaProfileEnumerate(compiled, ^BOOL(InfineaProfileOp op, BOOL persistent, const uint8_t *payload, NSUInteger length) {
+        if (persistent && persisted) {
+            skipped++;
+            return YES;
+        }
+        
+        NSData *previous = [self readProfileOp:op payload:payload length:length];
+        if (![self applyProfileOp:op payload:payload length:length error:&opError]) {
+            return NO;
+        }
+        if (previous) {
+            [undo addObject:previous];
+        }
+        applied++;
+        return YES;
+    });
+    
+    if (opError) {
+        for (NSData *previous in undo.reverseObjectEnumerator) {
+            InfineaProfileEnumerate(previous, ^BOOL(InfineaProfileOp op, BOOL persistent, const uint8_t *payload, NSUInteger length) {
+                [self applyProfileOp:op payload:payload length:length error:nil];
+                return YES;
+            });
+        }
+        if (error) {
+            *error = opError;
+        }
+        return nil;
+    }
+    
+    BOOL savedToFlash = persisted;
+    if (!persisted && serial.length > 0) {
+        NSError *flashError = nil;
+        savedToFlash = [self.ipc sysSaveSettingsToFlash:&flashError];
+        
+        NSMutableDictionary *updated = [hashes mutableCopy] ?: [NSMutableDictionary new];
+        if (savedToFlash) {
+            updated[serial] = hash;
+        }
+        else {
+            // Without flash persistence every connect needs the full profile
+            NSLog(@"Profile not saved to flash: %@", flashError.localizedDescription);
+            [updated removeObjectForKey:serial];
+        }
+        [[NSUserDefaults standardUserDefaults] setObject:updated forKey:kProfileHashesKey];
+    }
+    
+    return @{@"hash": hash,
+             @"applied": @(applied),
+             @"skipped": @(skipped),
+             @"savedToFlash": @(savedToFlash),
+             @"verified": @(persisted && readable > 0),
+             @"ms": @(round(([[NSProcessInfo processInfo] systemUptime] - start) * 1000.0))
+             };
+}
+
+- (void)profileApply:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call profileApply");
+    
+    NSDictionary *profile = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : nil;
+    NSString *compileError = @"Invalid profile!";
+    NSData *compiled = profile ? [self compileProfile:profile error:&compileError] : nil;
+    if (!compiled) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:compileError];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+    self.activeProfile = compiled;
+    [[NSUserDefaults standardUserDefaults] setObject:compiled forKey:kActiveProfileKey];
+    
+    dispatch_async(self.commandQueue, ^{
+        CDVPluginResult *pluginResult = nil;
+        NSError *error = nil;
+        NSDictionary *result = nil;
+        
+        if (self.ipc.connstate != CONN_CONNECTED) {
+            // Applied on the next connect
+            result = @{@"hash": InfineaProfileHash(compiled), @"applied": @0, @"skipped": @0, @"savedToFlash": @NO, @"verified": @NO, @"ms": @0};
+        }
+        else {
+            result = [self applyProfile:compiled error:&error];
+        }
+        
+        if (result) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:result];
+        }
+        else {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+- (void)profileClear:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call profileClear");
+    
+    self.activeProfile = nil;
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:kActiveProfileKey];
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:kProfileHashesKey];
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+- (void)applyActiveProfileOnConnect
+{
+    // The active profile survives relaunches, it is verified against the device again on connect
+    if (!self.activeProfile) {
+        self.activeProfile = [[NSUserDefaults standardUserDefaults] dataForKey:kActiveProfileKey];
+    }
+    NSData *compiled = self.activeProfile;
+    if (!compiled) {
+        return;
+    }
+    
+    dispatch_async(self.commandQueue, ^{
+        NSError *error = nil;
+        NSDictionary *result = [self applyProfile:compiled error:&error];
+        if (result) {
+            [self sendEvent:@"profileApplied" arguments:@[result]];
+        }
+        else {
+            NSLog(@"Profile apply error: %@", error.localizedDescription);
+            [self sendEvent:@"profileApplyFailed" arguments:@[error.localizedDescription ?: @""]];
+        }
+    });
+}
+
+
+#pragma mark - Symbology advisor
+// Scans are counted per barcode type over a learning window. Pruning disables the types that were not seen,
+// through barcodeCodeSetParam settings or engine init string fragments supplied by the app, since they are engine specific.
+// A scan attempt starts on a button press or barcodeStartScan and fails if it ends without a decode.
+
+- (InfineaSymbologyPhase *)symbologyCurrentPhase
+{
+    return &_symbologyPhase[self.symbologyUndo ? 1 : 0];
+}
+
+- (void)symbologyAttemptBegan
+{
+    if (self.symbologyAttemptStart == 0) {
+        self.symbologyAttemptStart = [[NSProcessInfo processInfo] systemUptime];
+    }
+}
+
+- (void)symbologyAttemptEnded
+{
+    if (self.symbologyAttemptStart == 0) {
+        return;
+    }
+    self.symbologyAttemptStart = 0;
+    self.symbologyCurrentPhase->attempts++;
+    self.symbologyCurrentPhase->failures++;
+    
+    if (!self.symbologyUndo) {
+        return;
+    }
+    
+    // A type disabled by pruning is now being scanned, or scanning got worse than before pruning
+    self.symbologyConsecutiveFailures++;
+    InfineaSymbologyPhase before = _symbologyPhase[0];
+    InfineaSymbologyPhase after = _symbologyPhase[1];
+    double beforeRate = before.attempts ? (double)before.failures / before.attempts : 0;
+    double afterRate = after.attempts ? (double)after.failures / after.attempts : 0;
+    if (self.symbologyConsecutiveFailures >= self.symbologyFailureLimit || (after.attempts >= 10 && afterRate > beforeRate + 0.1)) {
+        [self symbologyRestore:@"Scan failures after pruning" completion:nil];
+    }
+}
+
+- (void)symbologyDecoded:(int)type
+{
+    NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+    
+    // barcodeData and barcodeNSData can both report the same scan
+    if (now - self.symbologyLastDecode < 0.02 && self.symbologyAttemptStart == 0) {
+        return;
+    }
+    self.symbologyLastDecode = now;
+    
+    InfineaSymbologyPhase *phase = self.symbologyCurrentPhase;
+    phase->decodes++;
+    if (self.symbologyAttemptStart > 0) {
+        // Further decodes in continuous scan modes are not attempts of their own
+        phase->attempts++;
+        phase->latencySum += now - self.symbologyAttemptStart;
+        self.symbologyAttemptStart = 0;
+    }
+    self.symbologyConsecutiveFailures = 0;
+    
+    if (self.symbologyLearnUntil > 0) {
+        self.symbologyCounts[@(type)] = @([self.symbologyCounts[@(type)] unsignedIntegerValue] + 1);
+    }
+}
+
+// Seen types with at least minCount scans, most scanned first
+- (NSArray *)symbologyProposedSet:(NSUInteger)minCount
+{
+    NSArray *types = [self.symbologyCounts keysSortedByValueUsingComparator:^NSComparisonResult(NSNumber *a, NSNumber *b) {
+        return [b compare:a];
+    }];
+    NSMutableArray *proposed = [NSMutableArray new];
+    for (NSNumber *type in types) {
+        if ([self.symbologyCounts[type] unsignedIntegerValue] >= minCount) {
+            [proposed addObject:type];
+        }
+    }
+    return proposed;
+}
+
+- (NSDictionary *)symbologyPhaseSnapshot:(InfineaSymbologyPhase)phase
+{
+    NSUInteger successes = phase.attempts - phase.failures;
+    return @{@"attempts": @(phase.attempts),
+             @"failures": @(phase.failures),
+             @"decodes": @(phase.decodes),
+             @"latencyMs": successes ? @(round(phase.latencySum / successes * 1000.0)) : [NSNull null]
+             };
+}
+
+- (NSDictionary *)symbologyAdvice:(NSUInteger)minCount
+{
+    NSUInteger total = 0;
+    for (NSNumber *count in self.symbologyCounts.allValues) {
+        total += count.unsignedIntegerValue;
+    }
+    
+    NSMutableArray *seen = [NSMutableArray new];
+    for (NSNumber *type in [self symbologyProposedSet:1]) {
+        NSUInteger count = [self.symbologyCounts[type] unsignedIntegerValue];
+        [seen addObject:@{@"type": type,
+                          @"name": [self.ipc barcodeType2Text:type.intValue] ?: @"",
+                          @"count": @(count),
+                          @"share": @((double)count / total)
+                          }];
+    }
+    
+    NSTimeInterval remaining = self.symbologyLearnUntil - [[NSProcessInfo processInfo] systemUptime];
+    return @{@"learning": @(self.symbologyLearnUntil > 0),
+             @"remainingMs": @(self.symbologyLearnUntil > 0 ? MAX(0, round(remaining * 1000.0)) : 0),
+             @"pruned": @(self.symbologyUndo != nil),
+             @"enabled": self.symbologyEnabled ?: [NSNull null],
+             @"seen": seen,
+             @"proposed": [self symbologyProposedSet:minCount],
+             @"before": [self symbologyPhaseSnapshot:_symbologyPhase[0]],
+             @"after": [self symbologyPhaseSnapshot:_symbologyPhase[1]]
+             };
+}
+
+- (void)symbologyLearn:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call symbologyLearn");
+    
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    NSTimeInterval duration = options[@"durationMs"] ? [options[@"durationMs"] doubleValue] / 1000.0 : 86400;
+    
+    [self.symbologyCounts removeAllObjects];
+    if (!self.symbologyUndo) {
+        memset(&_symbologyPhase[0], 0, sizeof(InfineaSymbologyPhase));
+    }
+    self.symbologyLearnUntil = [[NSProcessInfo processInfo] systemUptime] + duration;
+    self.symbologyAutoPrune = [options[@"autoPrune"] isKindOfClass:[NSDictionary class]] ? options[@"autoPrune"] : nil;
+    if (options[@"failureLimit"]) {
+        self.symbologyFailureLimit = MAX(1, [options[@"failureLimit"] unsignedIntegerValue]);
+    }
+    
+    NSTimeInterval learnUntil = self.symbologyLearnUntil;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(duration * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        // A later symbologyLearn replaced this window
+        if (self.symbologyLearnUntil != learnUntil) {
+            return;
+        }
+        self.symbologyLearnUntil = 0;
+        
+        if (self.symbologyAutoPrune) {
+            [self symbologyApplyPrune:self.symbologyAutoPrune completion:^(NSDictionary *result, NSError *error) {
+                if (result) {
+                    [self sendEvent:@"symbologyPruned" arguments:@[result]];
+                }
+                else {
+                    NSLog(@"Symbology prune error: %@", error.localizedDescription);
+                }
+            }];
+        }
+    });
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+- (void)symbologyGetAdvice:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call symbologyGetAdvice");
+    
+    NSUInteger minCount = MAX(1, [command.arguments.firstObject unsignedIntegerValue]);
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:[self symbologyAdvice:minCount]];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+// Completion is called on the main thread
+- (void)symbologyApplyPrune:(NSDictionary *)options completion:(void (^)(NSDictionary *result, NSError *error))completion
+{
+    NSUInteger minCount = MAX(1, [options[@"minCount"] unsignedIntegerValue]);
+    NSArray *enabled = [self symbologyProposedSet:minCount];
+    NSDictionary *controls = [options[@"controls"] isKindOfClass:[NSDictionary class]] ? options[@"controls"] : @{};
+    NSDictionary *initStrings = [options[@"initStrings"] isKindOfClass:[NSDictionary class]] ? options[@"initStrings"] : @{};
+    
+    NSMutableData *prune = [NSMutableData new];
+    NSMutableArray *disabled = [NSMutableArray new];
+    for (NSString *type in [controls.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+        NSDictionary *control = controls[type];
+        if ([enabled containsObject:@(type.intValue)] || ![control isKindOfClass:[NSDictionary class]] || !control[@"setting"]) {
+            continue;
+        }
+        NSData *payload = InfineaProfileValues(@[control[@"setting"], control[@"disable"] ?: @0]);
+        if (!payload) {
+            continue;
+        }
+        InfineaProfileAppend(prune, InfineaProfileOpCodeParam, YES, payload);
+        [disabled addObject:@(type.intValue)];
+    }
+    
+    NSMutableString *initString = [NSMutableString new];
+    for (NSString *type in [initStrings.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+        if (![enabled containsObject:@(type.intValue)] && [initStrings[type] isKindOfClass:[NSString class]]) {
+            [initString appendString:initStrings[type]];
+            if (![disabled containsObject:@(type.intValue)]) {
+                [disabled addObject:@(type.intValue)];
+            }
+        }
+    }
+    if (initString.length > 0) {
+        InfineaProfileAppend(prune, InfineaProfileOpEngineInitString, NO, [initString dataUsingEncoding:NSUTF8StringEncoding]);
+    }
+    NSString *restoreInitString = [options[@"restoreInitString"] isKindOfClass:[NSString class]] ? options[@"restoreInitString"] : nil;
+    
+    if (enabled.count == 0 || prune.length == 0) {
+        completion(nil, [NSError errorWithDomain:@"InfineaSDKCordova" code:-1 userInfo:@{NSLocalizedDescriptionKey: enabled.count == 0 ? @"No scans collected!" : @"Nothing to disable!"}]);
+        return;
+    }
+    
+    NSData *previousUndo = self.symbologyUndo;
+    dispatch_async(self.commandQueue, ^{
+        NSMutableData *undo = [NSMutableData new];
+        __block NSError *error = nil;
+        
+        InfineaProfileEnumerate(prune, ^BOOL(InfineaProfileOp op, BOOL persistent, const uint8_t *payload, NSUInteger length) {
+            NSData *previous = [self readProfileOp:op payload:payload length:length];
+            if (![self applyProfileOp:op payload:payload length:length error:&error]) {
+                return NO;
+            }
+            if (previous) {
+                [undo appendData:previous];
+            }
+            return YES;
+        });
+        if (restoreInitString) {
+            InfineaProfileAppend(undo, InfineaProfileOpEngineInitString, NO, [restoreInitString dataUsingEncoding:NSUTF8StringEncoding]);
+        }
+        if (error) {
+            InfineaProfileEnumerate(undo, ^BOOL(InfineaProfileOp op, BOOL persistent, const uint8_t *payload, NSUInteger length) {
+                [self applyProfileOp:op payload:payload length:length error:nil];
+                return YES;
+            });
+        }
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (error) {
+                completion(nil, error);
+                return;
+            }
+            
+            // Pruning again keeps the settings from before the first prune as the rollback target
+            if (!previousUndo) {
+                self.symbologyUndo = undo;
+                memset(&self->_symbologyPhase[1], 0, sizeof(InfineaSymbologyPhase));
+            }
+            self.symbologyEnabled = enabled;
+            self.symbologyConsecutiveFailures = 0;
+            completion(@{@"enabled": enabled, @"disabled": disabled}, nil);
+        });
+    });
+}
+
+// Completion is called on the main thread, error is nil if nothing was pruned
+- (void)symbologyRestore:(NSString *)reason completion:(void (^)(NSError *error))completion
+{
+    NSData *undo = self.symbologyUndo;
+    self.symbologyUndo = nil;
+    self.symbologyEnabled = nil;
+    if (!undo) {
+        if (completion) {
+            completion(nil);
+        }
+        return;
+    }
+    
+    dispatch_async(self.commandQueue, ^{
+        __block NSError *error = nil;
+        InfineaProfileEnumerate(undo, ^BOOL(InfineaProfileOp op, BOOL persistent, const uint8_t *payload, NSUInteger length) {
+            NSError *opError = nil;
+            if (![self applyProfileOp:op payload:payload length:length error:&opError] && !error) {
+                error = opError;
+            }
+            return YES;
+        });
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self sendEvent:@"symbologyRolledBack" arguments:@[reason, error.localizedDescription ?: @""]];
+            if (completion) {
+                completion(error);
+            }
+        });
+    });
+}
+
+- (void)symbologyPrune:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call symbologyPrune");
+    
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    [self symbologyApplyPrune:options completion:^(NSDictionary *result, NSError *error) {
+        CDVPluginResult *pluginResult = nil;
+        if (result) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:result];
+        }
+        else {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    }];
+}
+
+- (void)symbologyRollback:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call symbologyRollback");
+    
+    [self symbologyRestore:@"Requested" completion:^(NSError *error) {
+        CDVPluginResult *pluginResult = nil;
+        if (!error) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+        }
+        else {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    }];
+}
+
+
+- (void)gtinNormalize:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call gtinNormalize");
+    
+    NSArray *codes = [command.arguments.firstObject isKindOfClass:[NSArray class]] ? command.arguments.firstObject : @[];
+    
+    // Runs off the main thread, catalogue imports can be large
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSMutableArray *gtins = [NSMutableArray arrayWithCapacity:codes.count];
+        for (id code in codes) {
+            const char *digits = [code isKindOfClass:[NSString class]] ? [code UTF8String] : NULL;
+            uint64_t gtin;
+            if (digits && infinea_gtin14(digits, strlen(digits), 0, &gtin)) {
+                [gtins addObject:@(gtin)];
+            }
+            else {
+                [gtins addObject:[NSNull null]];
+            }
+        }
+        
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsArray:gtins];
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+
+- (void)barcodeSetTextDecoding:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call barcodeSetTextDecoding");
+    
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    self.barcodeECIEscapes = [options[@"eciEscapes"] boolValue];
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+
+#pragma mark - Multi-part barcodes
+// Parts of Structured Append QR codes, or of any payload whose header the app describes with a pattern,
+// are held natively until every part was scanned and then delivered as one barcodeNSData in part order.
+
+- (void)barcodeSetStructuredAppend:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call barcodeSetStructuredAppend");
+    
+    CDVPluginResult* pluginResult = nil;
+    
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    NSError *error;
+    NSRegularExpression *pattern = nil;
+    if ([options[@"pattern"] isKindOfClass:[NSString class]]) {
+        pattern = [NSRegularExpression regularExpressionWithPattern:options[@"pattern"] options:0 error:&error];
+        if (pattern && (![pattern.pattern containsString:@"(?<index>"] || ![pattern.pattern containsString:@"(?<total>"])) {
+            error = [NSError errorWithDomain:@"InfineaSDKCordova" code:-1 userInfo:@{NSLocalizedDescriptionKey: @"Pattern needs index and total groups!"}];
+        }
+    }
+    
+    if (!error) {
+        BOOL enabled = options[@"enabled"] ? [options[@"enabled"] boolValue] : YES;
+        if (enabled && !self.appendArena) {
+            self.appendArena = [NSMutableData dataWithLength:256 * 1024];
+            infinea_assembler_init(&_assembler, self.appendArena.mutableBytes, self.appendArena.length);
+        }
+        else if (!enabled) {
+            self.appendArena = nil;
+        }
+        self.appendQRHeader = [options[@"qrHeader"] boolValue];
+        self.appendPattern = pattern;
+        self.appendTTL = options[@"ttlMs"] ? [options[@"ttlMs"] unsignedLongLongValue] : 30000;
+        
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    } else {
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+    }
+    
+    [self sendPluginResult:pluginResult command:command];
+}
+
+// Returns NO if the barcode is not a part, or could not be held, and should be delivered as is
+- (BOOL)assembleBarcodePart:(NSData *)barcode type:(int)type
+{
+    if (!self.appendArena) {
+        return NO;
+    }
+    
+    uint64_t now = (uint64_t)([[NSProcessInfo processInfo] systemUptime] * 1000.0);
+    size_t expired = infinea_assembler_expire(&_assembler, now, self.appendTTL);
+    if (expired > 0) {
+        [self sendEvent:@"barcodePartsExpired" arguments:@[@(expired)]];
+    }
+    
+    unsigned index = 0;
+    unsigned total = 0;
+    uint32_t key = 0;
+    size_t header = 0;
+    
+    if (type == BAR_QRCODE && self.appendQRHeader) {
+        uint32_t parity;
+        header = infinea_qr_append_header(barcode.bytes, barcode.length, &index, &total, &parity);
+        // Parity alone is only 8 bits, the total tells more messages apart
+        key = (total << 8) | parity;
+        
+        // The scanner passes no Structured Append flag, so ordinary QR data can look like a header. The parity is the XOR
+        // of the whole message: a last part that does not match it means the data was not a Structured Append part.
+        const infinea_assembly_file *file = header ? infinea_assembler_find(&_assembler, key) : NULL;
+        uint32_t missing = file ? (((1u << total) - 1) & ~file->have) : 0;
+        if (file && missing == (1u << index) &&
+            infinea_assembler_parity(&_assembler, file, (const uint8_t *)barcode.bytes + header, barcode.length - header) != parity) {
+            NSLog(@"QR part %u/%u does not match the message parity", index + 1, total);
+            header = 0;
+        }
+    }
+    if (header == 0 && self.appendPattern) {
+        // ISO-8859-1 maps every byte to one character, so match ranges are byte ranges
+        NSString *latin1 = [[NSString alloc] initWithData:barcode encoding:NSISOLatin1StringEncoding];
+        NSTextCheckingResult *match = [self.appendPattern firstMatchInString:latin1 options:NSMatchingAnchored range:NSMakeRange(0, latin1.length)];
+        NSRange indexRange = match ? [match rangeWithName:@"index"] : NSMakeRange(NSNotFound, 0);
+        NSRange totalRange = match ? [match rangeWithName:@"total"] : NSMakeRange(NSNotFound, 0);
+        if (indexRange.location != NSNotFound && totalRange.location != NSNotFound) {
+            NSInteger number = [[latin1 substringWithRange:indexRange] integerValue];
+            total = (unsigned)[[latin1 substringWithRange:totalRange] integerValue];
+            index = number > 0 ? (unsigned)(number - 1) : total;
+            
+            // FNV-1a of the file ID, when the pattern has one
+            key = 2166136261u ^ total;
+            NSRange idRange = [self.appendPattern.pattern containsString:@"(?<id>"] ? [match rangeWithName:@"id"] : NSMakeRange(NSNotFound, 0);
+            if (idRange.location != NSNotFound) {
+                const uint8_t *bytes = (const uint8_t *)barcode.bytes + idRange.location;
+                for (NSUInteger i = 0; i < idRange.length; i++) {
+                    key = (key ^ bytes[i]) * 16777619u;
+                }
+            }
+            header = NSMaxRange(match.range);
+        }
+    }
+    if (header == 0) {
+        return NO;
+    }
+    
+    NSMutableData *combined = [NSMutableData dataWithLength:self.appendArena.length + barcode.length];
+    size_t combinedLength = 0;
+    int result = infinea_assembler_add(&_assembler, key, index, total, (const uint8_t *)barcode.bytes + header, barcode.length - header,
+                                       now, combined.mutableBytes, combined.length, &combinedLength);
+    switch (result) {
+        case INFINEA_ASSEMBLY_COMPLETE:
+            combined.length = combinedLength;
+            [self deliverBarcodeNSData:combined type:type];
+            return YES;
+        case INFINEA_ASSEMBLY_PENDING:
+        case INFINEA_ASSEMBLY_DUPLICATE: {
+            const infinea_assembly_file *file = infinea_assembler_find(&_assembler, key);
+            [self sendEvent:@"barcodePartScanned" arguments:@[@(key), @(index), @(file ? file->received : 0), @(total)]];
+            return YES;
+        }
+    }
+    
+    NSLog(@"Barcode part %u/%u could not be held", index + 1, total);
+    return NO;
+}
+
+
+#pragma mark - NFC tags
+// Tag memory is addressed in bytes here; Type 2 reads are 16 bytes (4 pages) at page granularity,
+// ISO 15693 reads are whole blocks. Writes are whole pages or blocks and only the ones that change are sent.
+
+- (void)rfSetNdefReading:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call rfSetNdefReading");
+    
+    self.rfReadNdef = [command.arguments.firstObject boolValue];
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+// Bytes per page or block, the write granularity
+static NSUInteger InfineaTagUnit(DTRFCardInfo *info)
+{
+    return info.type == CARD_ISO15693 && info.blockSize > 0 ? info.blockSize : 4;
+}
+
+// Reads at least length bytes at a byte offset of tag memory, offset must be aligned to a page or block. Runs on the command queue
+- (NSData *)readTag:(int)cardIndex info:(DTRFCardInfo *)info offset:(NSUInteger)offset length:(NSUInteger)length error:(NSError **)error
+{
+    NSUInteger unit = InfineaTagUnit(info);
+    if (info.type == CARD_ISO15693) {
+        NSUInteger rounded = (length + unit - 1) / unit * unit;
+        return [self.ipc iso15693Read:cardIndex startBlock:(int)(offset / unit) length:(int)rounded error:error];
+    }
+    if (info.type == CARD_ST_SRI) {
+        NSUInteger rounded = (length + unit - 1) / unit * unit;
+        return [self.ipc stSRIRead:cardIndex address:(int)(offset / unit) length:(int)rounded error:error];
+    }
+    NSUInteger rounded = (length + 15) / 16 * 16;
+    return [self.ipc mfRead:cardIndex address:(int)(offset / unit) length:(int)rounded error:error];
+}
+
+// Writes whole pages or blocks at a byte offset of tag memory. Runs on the command queue
+- (BOOL)writeTag:(int)cardIndex info:(DTRFCardInfo *)info offset:(NSUInteger)offset data:(NSData *)data error:(NSError **)error
+{
+    NSUInteger unit = InfineaTagUnit(info);
+    if (info.type == CARD_ISO15693) {
+        return [self.ipc iso15693Write:cardIndex startBlock:(int)(offset / unit) data:data bytesWritten:NULL error:error];
+    }
+    if (info.type == CARD_ST_SRI) {
+        return [self.ipc stSRIWrite:cardIndex address:(int)(offset / unit) data:data bytesWritten:NULL error:error];
+    }
+    return [self.ipc mfWrite:cardIndex address:(int)(offset / unit) data:data bytesWritten:NULL error:error];
+}
+
+// Reads tag memory from the capability container to the end of the NDEF Message TLV with as few reads as the TLV layout
+// allows: one read covers the container and the first TLV header, a second one the rest of the message.
+// memory starts at byte *start of the tag, tlv offsets are relative to the area. Returns nil if the tag is not NDEF formatted.
+// Runs on the command queue
+- (NSMutableData *)readNdefMemory:(int)cardIndex info:(DTRFCardInfo *)info start:(NSUInteger *)start area:(infinea_ndef_area *)area
+                              tlv:(infinea_ndef_tlv *)tlv result:(int *)result reads:(int *)reads
+{
+    BOOL type5 = info.type == CARD_ISO15693;
+    *start = type5 ? 0 : 12;
+    *reads = 1;
+    
+    NSData *head = [self readTag:cardIndex info:info offset:*start length:16 error:nil];
+    if (!head || head.length < 4) {
+        return nil;
+    }
+    int formatted = type5 ? infinea_ndef_type5_cc(head.bytes, head.length, area) : infinea_ndef_type2_cc(head.bytes, area);
+    if (formatted != 1) {
+        return nil;
+    }
+    
+    NSMutableData *memory = [head mutableCopy];
+    NSUInteger skip = area->offset - *start;
+    size_t needed = 0;
+    while ((*result = infinea_ndef_tlv_find((const uint8_t *)memory.bytes + MIN(skip, memory.length), memory.length > skip ? memory.length - skip : 0,
+                                            area->size, tlv, &needed)) == INFINEA_NDEF_MORE) {
+        NSUInteger read = memory.length > skip ? memory.length - skip : 0;
+        NSData *more = [self readTag:cardIndex info:info offset:*start + memory.length length:MIN(needed, area->size) - read error:nil];
+        (*reads)++;
+        if (more.length == 0) {
+            return nil;
+        }
+        [memory appendData:more];
+    }
+    return memory;
+}
+
+// Reads and parses the NDEF message, nil if the tag is not NDEF formatted. Runs on the command queue
+- (NSDictionary *)readNdef:(int)cardIndex info:(DTRFCardInfo *)info
+{
+    NSUInteger start;
+    infinea_ndef_area area;
+    infinea_ndef_tlv tlv;
+    int result, reads;
+    NSData *memory = [self readNdefMemory:cardIndex info:info start:&start area:&area tlv:&tlv result:&result reads:&reads];
+    if (!memory) {
+        return nil;
+    }
+    
+    const uint8_t *data = (const uint8_t *)memory.bytes + (area.offset - start);
+    NSArray *records = result == INFINEA_NDEF_FOUND ? InfineaNDEFRecords(data + tlv.value_offset, tlv.length) : @[];
+    return @{@"records": records,
+             @"writable": @(area.writable != 0),
+             @"capacity": @(area.size),
+             @"reads": @(reads)
+             };
+}
+
+- (void)rfWriteTag:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call rfWriteTag");
+    
+    int cardIndex = [command.arguments.firstObject intValue];
+    NSDictionary *options = command.arguments.count > 1 && [command.arguments[1] isKindOfClass:[NSDictionary class]] ? command.arguments[1] : @{};
+    DTRFCardInfo *info = self.rfCards[@(cardIndex)];
+    NSData *message = InfineaHexData(options[@"message"]);
+    NSData *data = InfineaHexData(options[@"data"]);
+    BOOL invalidate = [options[@"invalidate"] boolValue];
+    BOOL ndefTag = info.type == CARD_MIFARE_ULTRALIGHT || info.type == CARD_MIFARE_ULTRALIGHT_C || info.type == CARD_ISO15693;
+    
+    NSString *invalid = nil;
+    if (!info) {
+        invalid = @"Card is not in the field!";
+    }
+    else if (!message && !data) {
+        invalid = @"Nothing to write!";
+    }
+    else if (message && !ndefTag) {
+        invalid = @"NDEF messages can only be written to Type 2 and ISO 15693 tags!";
+    }
+    else if (data && data.length % InfineaTagUnit(info) != 0) {
+        invalid = @"Data must be whole pages or blocks!";
+    }
+    if (invalid) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:invalid];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+    // First page or block of a raw image, the start of the user memory by default
+    NSUInteger address = options[@"address"] ? [options[@"address"] unsignedIntegerValue] : info.type == CARD_ST_SRI ? 7 : info.type == CARD_ISO15693 ? 0 : 4;
+    
+    dispatch_async(self.commandQueue, ^{
+        NSError *error = nil;
+        NSDictionary *result = message ? [self writeNdef:cardIndex info:info message:message invalidate:invalidate error:&error]
+                                       : [self writeImage:cardIndex info:info offset:address * InfineaTagUnit(info) data:data invalidate:invalidate error:&error];
+        
+        CDVPluginResult *pluginResult = nil;
+        if (result) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:result];
+        }
+        else {
+            [self rfSessionFailed:cardIndex];
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+// Writes the pages or blocks of target that differ from current, current and target start at byte offset of tag memory.
+// The NDEF TLV header, if any, is written last. Runs on the command queue
+- (NSDictionary *)updateTag:(int)cardIndex info:(DTRFCardInfo *)info offset:(NSUInteger)offset current:(NSData *)current target:(NSData *)target
+               headerOffset:(NSUInteger)headerOffset headerLength:(NSUInteger)headerLength invalidate:(BOOL)invalidate
+                      reads:(int)reads since:(NSTimeInterval)begin error:(NSError **)error
+{
+    NSUInteger unit = InfineaTagUnit(info);
+    size_t units = target.length / unit;
+    // Runs of changed units are separated by unchanged ones, plus the two header writes
+    NSMutableData *plan = [NSMutableData dataWithLength:(units + 2) * sizeof(infinea_tag_write)];
+    size_t written = 0, skipped = 0;
+    int count = infinea_tag_plan(current.bytes, target.bytes, target.length, unit, headerOffset, headerLength, invalidate,
+                                 plan.mutableBytes, units + 2, &written, &skipped);
+    
+    const infinea_tag_write *writes = plan.bytes;
+    NSMutableData *buffer = [NSMutableData dataWithLength:target.length];
+    for (int i = 0; i < count; i++) {
+        infinea_tag_write_data(target.bytes, &writes[i], headerOffset, buffer.mutableBytes);
+        NSData *data = [NSData dataWithBytes:buffer.bytes length:writes[i].length];
+        if (![self writeTag:cardIndex info:info offset:offset + writes[i].offset data:data error:error]) {
+            return nil;
+        }
+    }
+    
+    return @{@"written": @(written),
+             @"skipped": @(skipped),
+             @"commands": @(count),
+             @"reads": @(reads),
+             @"ms": @(round(([[NSProcessInfo processInfo] systemUptime] - begin) * 1000.0))
+             };
+}
+
+// Replaces the NDEF message, keeping the TLVs in front of it. Runs on the command queue
+- (NSDictionary *)writeNdef:(int)cardIndex info:(DTRFCardInfo *)info message:(NSData *)message invalidate:(BOOL)invalidate error:(NSError **)error
+{
+    NSTimeInterval begin = [[NSProcessInfo processInfo] systemUptime];
+    NSUInteger start;
+    infinea_ndef_area area;
+    infinea_ndef_tlv tlv;
+    int found = INFINEA_NDEF_NONE, reads = 0;
+    NSMutableData *memory = [self readNdefMemory:cardIndex info:info start:&start area:&area tlv:&tlv result:&found reads:&reads];
+    
+    NSString *invalid = nil;
+    NSMutableData *encoded = [NSMutableData dataWithLength:message.length + 5];
+    size_t encodedLength = infinea_ndef_tlv_encode(message.bytes, message.length, encoded.mutableBytes, encoded.length);
+    size_t position = found == INFINEA_NDEF_FOUND ? tlv.tlv_offset : 0;
+    if (!memory) {
+        invalid = @"Tag is not NDEF formatted!";
+    }
+    else if (!area.writable) {
+        invalid = @"Tag is read-only!";
+    }
+    else if (encodedLength == 0 || position + encodedLength > area.size) {
+        invalid = @"Message does not fit the tag!";
+    }
+    if (invalid) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"InfineaSDKCordova" code:-1 userInfo:@{NSLocalizedDescriptionKey: invalid}];
+        }
+        return nil;
+    }
+    
+    // The image ends with the page or block holding the new terminator
+    NSUInteger unit = InfineaTagUnit(info);
+    NSUInteger headerOffset = area.offset - start + position;
+    NSUInteger end = (headerOffset + encodedLength + unit - 1) / unit * unit;
+    if (memory.length < end) {
+        NSData *more = [self readTag:cardIndex info:info offset:start + memory.length length:end - memory.length error:error];
+        reads++;
+        if (!more) {
+            return nil;
+        }
+        [memory appendData:more];
+    }
+    memory.length = end;
+    
+    NSMutableData *target = [memory mutableCopy];
+    [target replaceBytesInRange:NSMakeRange(headerOffset, encodedLength) withBytes:encoded.bytes];
+    return [self updateTag:cardIndex info:info offset:start current:memory target:target
+              headerOffset:headerOffset headerLength:encodedLength - message.length - 1 invalidate:invalidate
+                     reads:reads since:begin error:error];
+}
+
+// Writes a raw memory image. If it covers the start of the TLV area, its NDEF TLV is written in TLV safe order. Runs on the command queue
+- (NSDictionary *)writeImage:(int)cardIndex info:(DTRFCardInfo *)info offset:(NSUInteger)offset data:(NSData *)data invalidate:(BOOL)invalidate error:(NSError **)error
+{
+    NSTimeInterval begin = [[NSProcessInfo processInfo] systemUptime];
+    NSData *current = [self readTag:cardIndex info:info offset:offset length:data.length error:error];
+    if (!current) {
+        return nil;
+    }
+    if (current.length < data.length) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"InfineaSDKCordova" code:-1 userInfo:@{NSLocalizedDescriptionKey: @"Image is larger than the tag!"}];
+        }
+        return nil;
+    }
+    current = [current subdataWithRange:NSMakeRange(0, data.length)];
+    
+    NSUInteger areaOffset = NSNotFound;
+    infinea_ndef_area area;
+    if ((info.type == CARD_MIFARE_ULTRALIGHT || info.type == CARD_MIFARE_ULTRALIGHT_C) && offset <= 16) {
+        areaOffset = 16;
+    }
+    else if (info.type == CARD_ISO15693 && offset == 0 && infinea_ndef_type5_cc(data.bytes, data.length, &area) == 1) {
+        areaOffset = area.offset;
+    }
+    
+    NSUInteger headerOffset = 0, headerLength = 0;
+    if (areaOffset != NSNotFound && offset + data.length > areaOffset) {
+        NSUInteger skip = areaOffset - offset;
+        infinea_ndef_tlv tlv;
+        size_t needed;
+        if (infinea_ndef_tlv_find((const uint8_t *)data.bytes + skip, data.length - skip, data.length - skip, &tlv, &needed) == INFINEA_NDEF_FOUND) {
+            headerOffset = skip + tlv.tlv_offset;
+            headerLength = tlv.value_offset - tlv.tlv_offset;
+        }
+    }
+    
+    return [self updateTag:cardIndex info:info offset:offset current:current target:data
+              headerOffset:headerOffset headerLength:headerLength invalidate:invalidate
+                     reads:1 since:begin error:error];
+}
+
+#pragma mark - FeliCa batches
+// Read and Write Without Encryption over several services, sent with felicaSendCommand in as few frames as the card accepts.
+// Frame limits start from the IC type in the PMm and are halved when the card rejects the number of blocks or services.
+
+- (void)felicaReadBatch:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call felicaReadBatch");
+    [self felicaBatch:command write:NO];
+}
+
+- (void)felicaWriteBatch:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call felicaWriteBatch");
+    [self felicaBatch:command write:YES];
+}
+
+- (void)felicaBatch:(CDVInvokedUrlCommand *)command write:(BOOL)write
+{
+    int cardIndex = [command.arguments.firstObject intValue];
+    NSArray *list = command.arguments.count > 1 && [command.arguments[1] isKindOfClass:[NSArray class]] ? command.arguments[1] : @[];
+    DTRFCardInfo *info = self.rfCards[@(cardIndex)];
+    
+    NSMutableData *ranges = [NSMutableData dataWithLength:list.count * sizeof(infinea_felica_range)];
+    infinea_felica_range *range = ranges.mutableBytes;
+    NSMutableData *writeData = write ? [NSMutableData new] : nil;
+    NSString *invalid = nil;
+    if (!info || info.type != CARD_FELICA) {
+        invalid = @"No FeliCa card in the field!";
+    }
+    else if (list.count == 0) {
+        invalid = @"No blocks given!";
+    }
+    for (NSUInteger i = 0; i < list.count && !invalid; i++) {
+        NSDictionary *entry = [list[i] isKindOfClass:[NSDictionary class]] ? list[i] : @{};
+        NSUInteger service = [entry[@"service"] unsignedIntegerValue];
+        NSUInteger start = [entry[@"start"] unsignedIntegerValue];
+        NSUInteger count = [entry[@"count"] unsignedIntegerValue];
+        if (write) {
+            NSData *data = InfineaHexData(entry[@"data"]);
+            if (data.length % INFINEA_FELICA_BLOCK != 0) {
+                invalid = @"Write data must be whole 16 byte blocks!";
+            }
+            count = data.length / INFINEA_FELICA_BLOCK;
+            [writeData appendData:data ?: [NSData data]];
+        }
+        if (!invalid && (!entry[@"service"] || service > 0xFFFF || count == 0 || start + count > 0x10000)) {
+            invalid = [NSString stringWithFormat:@"Invalid block range at %lu!", (unsigned long)i];
+        }
+        range[i] = (infinea_felica_range){ (uint16_t)service, (uint16_t)start, (uint16_t)count };
+    }
+    if (invalid) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:invalid];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+    // PMm byte 1 is the IC type, FeliCa Lite, Lite-S and Link take 4 blocks per read, 1 per write and 1 service
+    uint8_t icType = info.felicaPMm.length > 1 ? ((const uint8_t *)info.felicaPMm.bytes)[1] : 0;
+    BOOL lite = icType >= 0xF0 && icType <= 0xF2;
+    
+    dispatch_async(self.commandQueue, ^{
+        NSTimeInterval begin = [[NSProcessInfo processInfo] systemUptime];
+        NSArray<NSNumber *> *known = self.felicaLimits[@(icType)] ?: (lite ? @[@4, @1, @1] : @[@12, @8, @(INFINEA_FELICA_MAX_SERVICES)]);
+        size_t limits[3] = { known[0].unsignedIntegerValue, known[1].unsignedIntegerValue, known[2].unsignedIntegerValue };
+        size_t *maxBlocks = &limits[write ? 1 : 0];
+        
+        uint8_t frame[1 + 2 * INFINEA_FELICA_MAX_SERVICES + 1 + (3 + INFINEA_FELICA_BLOCK) * INFINEA_FELICA_MAX_BLOCKS];
+        infinea_felica_cursor cursor = { 0, 0, 0 };
+        NSMutableData *read = [NSMutableData new];
+        NSError *error = nil;
+        NSString *failure = nil;
+        int frames = 0;
+        size_t blocks, length;
+        while (!failure) {
+            infinea_felica_cursor mark = cursor;
+            length = infinea_felica_encode(ranges.bytes, list.count, &cursor, *maxBlocks, limits[2], writeData.bytes, frame, &blocks);
+            if (length == 0) {
+                break;
+            }
+            
+            NSData *response = [self.ipc felicaSendCommand:cardIndex command:write ? 0x08 : 0x06 data:[NSData dataWithBytes:frame length:length] error:&error];
+            frames++;
+            if (!response) {
+                failure = error.localizedDescription ?: @"No response from the card!";
+                break;
+            }
+            
+            uint8_t status[2];
+            const uint8_t *data = NULL;
+            int parsed = infinea_felica_parse(response.bytes, response.length, write, write ? 0 : blocks, status, &data);
+            if (parsed == 0 && status[1] == 0xA2 && blocks > 1) {
+                *maxBlocks = blocks / 2;
+                cursor = mark;
+                continue;
+            }
+            if (parsed == 0 && status[1] == 0xA1 && frame[0] > 1) {
+                limits[2] = frame[0] / 2;
+                cursor = mark;
+                continue;
+            }
+            if (parsed != 1) {
+                failure = parsed == 0 ? [NSString stringWithFormat:@"Card status %02X %02X!", status[0], status[1]] : @"Invalid response from the card!";
+                break;
+            }
+            if (!write) {
+                [read appendBytes:data length:blocks * INFINEA_FELICA_BLOCK];
+            }
+        }
+        self.felicaLimits[@(icType)] = @[@(limits[0]), @(limits[1]), @(limits[2])];
+        
+        CDVPluginResult *pluginResult = nil;
+        if (failure) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:failure];
+        }
+        else {
+            NSMutableDictionary *result = [@{@"blocks": @(cursor.ordinal),
+                                             @"frames": @(frames),
+                                             @"ms": @(round(([[NSProcessInfo processInfo] systemUptime] - begin) * 1000.0))
+                                             } mutableCopy];
+            if (!write) {
+                NSMutableArray *results = [NSMutableArray new];
+                const infinea_felica_range *requested = ranges.bytes;
+                NSUInteger offset = 0;
+                for (NSUInteger i = 0; i < list.count; i++) {
+                    NSData *data = [read subdataWithRange:NSMakeRange(offset, requested[i].count * INFINEA_FELICA_BLOCK)];
+                    [results addObject:@{@"service": @(requested[i].service), @"start": @(requested[i].start), @"data": InfineaHexString(data)}];
+                    offset += data.length;
+                }
+                result[@"ranges"] = results;
+            }
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:result];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+#pragma mark - Card authentication sessions
+// A card stays authenticated until it leaves the field, so rfAuthenticate with the same scheme, key and scope for the same UID
+// is answered from the session without another handshake. Ultralight C keeps one authentication for the card, DESFire one
+// per selected application and Mifare Classic one per sector; authenticating with another key or scope replaces it.
+
+// Identifies a key without keeping it in the session
+static NSString *InfineaKeyID(NSData *key, id slot)
+{
+    if (!key) {
+        return [NSString stringWithFormat:@"slot%@", slot];
+    }
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(key.bytes, (CC_LONG)key.length, digest);
+    return InfineaHexString([NSData dataWithBytes:digest length:8]);
+}
+
+- (void)rfSessionBegin:(int)cardIndex uid:(NSData *)uid
+{
+    dispatch_async(self.commandQueue, ^{
+        self.rfSessions[@(cardIndex)] = [@{@"uid": uid ?: [NSData data], @"auth": [NSMutableDictionary new], @"handshakes": @0, @"saved": @0} mutableCopy];
+    });
+}
+
+- (void)rfSessionEnd:(int)cardIndex
+{
+    dispatch_async(self.commandQueue, ^{
+        NSDictionary *session = self.rfSessions[@(cardIndex)];
+        [self.rfSessions removeObjectForKey:@(cardIndex)];
+        if ([session[@"handshakes"] intValue] > 0 || [session[@"saved"] intValue] > 0) {
+            [self sendEvent:@"rfSessionEnded" arguments:@[@(cardIndex), @{@"UID": InfineaHexString(session[@"uid"]),
+                                                                          @"handshakes": session[@"handshakes"],
+                                                                          @"saved": session[@"saved"]}]];
+        }
+    });
+}
+
+// A failed card command leaves Ultralight C and DESFire cards unauthenticated, so nothing cached can be trusted after it.
+// Runs on the command queue
+- (void)rfSessionFailed:(int)cardIndex
+{
+    NSMutableDictionary *session = self.rfSessions[@(cardIndex)];
+    [session[@"auth"] removeAllObjects];
+    [session removeObjectForKey:@"app"];
+}
+
+- (void)rfAuthenticate:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call rfAuthenticate");
+    
+    int cardIndex = [command.arguments.firstObject intValue];
+    NSDictionary *options = command.arguments.count > 1 && [command.arguments[1] isKindOfClass:[NSDictionary class]] ? command.arguments[1] : @{};
+    NSString *scheme = [options[@"scheme"] isKindOfClass:[NSString class]] ? options[@"scheme"] : @"";
+    NSData *key = InfineaHexData(options[@"key"]);
+    id slot = options[@"keySlot"];
+    int keyIndex = [options[@"keyIndex"] intValue];
+    int address = [options[@"address"] intValue];
+    char type = [options[@"type"] isEqual:@"B"] ? 'B' : 'A';
+    NSNumber *app = options[@"app"];
+    
+    // Family and identity of the authentication, the identity includes its scope
+    NSString *family = nil, *identity = nil, *invalid = nil;
+    if ([scheme isEqualToString:@"ulc"]) {
+        family = @"ulc";
+        identity = InfineaKeyID(key, nil);
+        invalid = key.length == 16 ? nil : @"Ultralight C keys are 16 bytes!";
+    }
+    else if ([scheme isEqualToString:@"desfireAES"] || [scheme isEqualToString:@"desfire3DES"]) {
+        family = @"desfire";
+        identity = [NSString stringWithFormat:@"%@:%d:%@", scheme, keyIndex, InfineaKeyID(key, nil)];
+        // The reader authenticates with 2-key 3DES only
+        invalid = key.length == 16 ? nil : key.length == 24 ? @"3-key 3DES (24 byte) DESFire keys are not supported!" : @"DESFire keys are 16 bytes!";
+    }
+    else if ([scheme isEqualToString:@"classic"]) {
+        family = @"classic";
+        int sector = address < 128 ? address / 4 : 32 + (address - 128) / 16;
+        identity = [NSString stringWithFormat:@"%d:%c:%@", sector, type, InfineaKeyID(key, slot)];
+        invalid = key.length == 6 || (!key && slot) ? nil : @"Classic authentication needs a 6 byte key or a keySlot!";
+    }
+    else {
+        invalid = @"Unknown scheme!";
+    }
+    if (invalid) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:invalid];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+    dispatch_async(self.commandQueue, ^{
+        CDVPluginResult *pluginResult = nil;
+        NSMutableDictionary *session = self.rfSessions[@(cardIndex)];
+        if (!session) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Card is not in the field!"];
+            [self sendPluginResult:pluginResult command:command];
+            return;
+        }
+        NSMutableDictionary *auth = session[@"auth"];
+        NSError *error = nil;
+        BOOL cached = NO, isSuccess = YES;
+        
+        // Selecting another application ends the DESFire authentication
+        if (app && ![app isEqual:session[@"app"]]) {
+            isSuccess = [self.ipc dfSelectApplication:cardIndex app:app.unsignedIntValue error:&error];
+            [auth removeObjectForKey:@"desfire"];
+            session[@"app"] = isSuccess ? app : nil;
+        }
+        
+        if (isSuccess && [auth[family] isEqualToString:identity]) {
+            cached = YES;
+            session[@"saved"] = @([session[@"saved"] intValue] + 1);
+        }
+        else if (isSuccess) {
+            if ([family isEqualToString:@"ulc"]) {
+                isSuccess = [self.ipc mfUlcAuthByKey:cardIndex key:key error:&error];
+            }
+            else if ([scheme isEqualToString:@"desfireAES"]) {
+                // The returned session key is not kept, none of the bridged card commands use it
+                isSuccess = [self.ipc dfAESAuthByFixedKey:cardIndex key:key keyIndex:keyIndex error:&error] != nil;
+            }
+            else if ([scheme isEqualToString:@"desfire3DES"]) {
+                isSuccess = [self.ipc df3DESAuthByFixedKey:cardIndex key:key keyIndex:keyIndex error:&error];
+            }
+            else if (key) {
+                isSuccess = [self.ipc mfAuthByKey:cardIndex type:type address:address key:key error:&error];
+            }
+            else {
+                isSuccess = [self.ipc mfAuthByStoredKey:cardIndex type:type address:address keyIndex:[slot intValue] error:&error];
+            }
+            session[@"handshakes"] = @([session[@"handshakes"] intValue] + 1);
+            auth[family] = isSuccess ? identity : nil;
+        }
+        
+        if (isSuccess) {
+            NSDictionary *result = @{@"cached": @(cached),
+                                     @"handshakes": session[@"handshakes"],
+                                     @"saved": session[@"saved"]
+                                     };
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:result];
+        }
+        else {
+            [self rfSessionFailed:cardIndex];
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+- (void)rfSetStoredKeys:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call rfSetStoredKeys");
+    
+    NSArray *list = [command.arguments.firstObject isKindOfClass:[NSArray class]] ? command.arguments.firstObject : @[];
+    NSMutableArray *keys = [NSMutableArray new];
+    for (id entry in list) {
+        NSDictionary *options = [entry isKindOfClass:[NSDictionary class]] ? entry : @{};
+        NSData *key = InfineaHexData(options[@"key"]);
+        int slot = [options[@"slot"] intValue];
+        if (key.length != 6 || slot < 0 || slot > 7) {
+            CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Keys are 6 bytes in slots 0-7!"];
+            [self sendPluginResult:pluginResult command:command];
+            return;
+        }
+        [keys addObject:@{@"slot": @(slot), @"type": [options[@"type"] isEqual:@"B"] ? @"B" : @"A", @"key": key}];
+    }
+    self.rfStoredKeys = keys.count ? keys : nil;
+    
+    if (self.ipc.connstate != CONN_CONNECTED) {
+        // Stored on the next connect
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsInt:0];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    dispatch_async(self.commandQueue, ^{
+        NSError *error = nil;
+        int stored = [self storeRfKeys:keys error:&error];
+        CDVPluginResult *pluginResult = nil;
+        if ((NSUInteger)stored == keys.count) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsInt:stored];
+        }
+        else {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+// Runs on the command queue, returns the number of keys stored before the first failure
+- (int)storeRfKeys:(NSArray<NSDictionary *> *)keys error:(NSError **)error
+{
+    int stored = 0;
+    for (NSDictionary *entry in keys) {
+        if (![self.ipc mfStoreKeyIndex:[entry[@"slot"] intValue] type:[entry[@"type"] characterAtIndex:0] key:entry[@"key"] error:error]) {
+            break;
+        }
+        stored++;
+    }
+    return stored;
+}
+
+- (void)storeRfKeysOnConnect
+{
+    NSArray *keys = self.rfStoredKeys;
+    if (!keys) {
+        return;
+    }
+    
+    dispatch_async(self.commandQueue, ^{
+        NSError *error = nil;
+        if ((NSUInteger)[self storeRfKeys:keys error:&error] < keys.count) {
+            NSLog(@"Storing keys failed: %@", error.localizedDescription);
+        }
+    });
+}
+
+#pragma mark - Key inventory
+// Keys and certificates change only with a key load or a security firmware update, so the inventory is stored per device serial
+// with the firmware and security versions. emsrGetDeviceInfo is asked once per connection; later calls are answered from memory,
+// except for the DUKPT KSNs, which change with every transaction.
+
+static NSString * const kKeyInventoryKey = @"InfineaKeyInventory";
+
+// Tells calls the device does not support, or keys that are not loaded, from failures that may pass on the next try
+static BOOL InfineaUnsupported(NSError *error)
+{
+    // No answer without an error means there is nothing to report
+    if (!error) {
+        return YES;
+    }
+    switch (error.code) {
+        case DT_ENOSUPPORTED:
+        case DT_ENOIMPLEMENTED:
+        case DT_EINVALID_CMD:
+        case DT_ENOEXIST:
+        case DT_PPAD_ENOT_SUPPORTED:
+            return YES;
+    }
+    return NO;
+}
+
+// The DUKPT KSN advances with every transaction, so it is never stored and is read live for each answer
+static NSMutableArray *InfineaEmsrKeyEntries(EMSRKeysInfo *keysInfo, BOOL includeKSN)
+{
+    NSMutableArray *entries = [NSMutableArray new];
+    for (EMSRKey *key in keysInfo.keys) {
+        NSMutableDictionary *entry = [@{@"keyID": @(key.keyID), @"keyVersion": @(key.keyVersion), @"keyName": key.keyName ?: @""} mutableCopy];
+        if (includeKSN) {
+            entry[@"dukptKSN"] = InfineaHexString(key.dukptKSN);
+        }
+        [entries addObject:entry];
+    }
+    return entries;
+}
+
+- (void)keyInventory:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call keyInventory");
+    
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    BOOL refresh = [options[@"refresh"] boolValue];
+    NSArray *ppadKeys = [options[@"ppadKeys"] isKindOfClass:[NSArray class]] ? options[@"ppadKeys"] : @[];
+    ppadKeys = [ppadKeys filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self isKindOfClass: %@", [NSNumber class]]];
+    
+    dispatch_async(self.commandQueue, ^{
+        NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+        CDVPluginResult *pluginResult = nil;
+        NSString *serial = self.ipc.serialNumber ?: @"";
+        if (self.ipc.connstate != CONN_CONNECTED || serial.length == 0) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Device is not connected!"];
+            [self sendPluginResult:pluginResult command:command];
+            return;
+        }
+        
+        NSError *error = nil;
+        NSString *versions = self.keyInventoryVersions;
+        if (!versions) {
+            EMSRDeviceInfo *info = [self.ipc emsrGetDeviceInfo:&error];
+            versions = info ? [NSString stringWithFormat:@"%d:%d", info.firmwareVersion, info.securityVersion] : @"";
+            self.keyInventoryVersions = versions;
+        }
+        
+        NSDictionary *stored = [[NSUserDefaults standardUserDefaults] dictionaryForKey:kKeyInventoryKey][serial];
+        BOOL cached = !refresh && versions.length > 0 && [stored[@"versions"] isEqualToString:versions] &&
+                      [[NSSet setWithArray:ppadKeys] isSubsetOfSet:[NSSet setWithArray:stored[@"ppadKeyIDs"] ?: @[]]];
+        BOOL complete = YES;
+        NSMutableDictionary *inventory = cached ? [stored mutableCopy] : [self readKeyInventory:ppadKeys complete:&complete];
+        if (!cached) {
+            inventory[@"versions"] = versions;
+            inventory[@"takenAt"] = @(round([[NSDate date] timeIntervalSince1970] * 1000.0));
+            // Without versions there is nothing to tell a stale inventory by, and a partial one would hide keys until the next refresh
+            if (versions.length > 0 && complete) {
+                NSMutableDictionary *updated = [[[NSUserDefaults standardUserDefaults] dictionaryForKey:kKeyInventoryKey] mutableCopy] ?: [NSMutableDictionary new];
+                NSMutableDictionary *entry = [inventory mutableCopy];
+                NSMutableArray *emsrKeys = [NSMutableArray new];
+                for (NSDictionary *key in inventory[@"emsrKeys"]) {
+                    NSMutableDictionary *stripped = [key mutableCopy];
+                    [stripped removeObjectForKey:@"dukptKSN"];
+                    [emsrKeys addObject:stripped];
+                }
+                if (inventory[@"emsrKeys"]) {
+                    entry[@"emsrKeys"] = emsrKeys;
+                }
+                updated[serial] = entry;
+                [[NSUserDefaults standardUserDefaults] setObject:updated forKey:kKeyInventoryKey];
+            }
+        }
+        else if (inventory[@"emsrKeys"]) {
+            EMSRKeysInfo *keysInfo = [self.ipc emsrGetKeysInfo:nil];
+            if (keysInfo) {
+                inventory[@"emsrKeys"] = InfineaEmsrKeyEntries(keysInfo, YES);
+            }
+        }
+        
+        inventory[@"complete"] = @(complete);
+        inventory[@"cached"] = @(cached);
+        inventory[@"ms"] = @(round(([[NSProcessInfo processInfo] systemUptime] - start) * 1000.0));
+        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:inventory];
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+// Queries every source, calls the device does not support leave their entry out. complete is set to NO when a
+// supported call failed. Runs on the command queue
+- (NSMutableDictionary *)readKeyInventory:(NSArray *)ppadKeys complete:(BOOL *)complete
+{
+    NSMutableDictionary *inventory = [NSMutableDictionary new];
+    NSError *error = nil;
+    *complete = YES;
+    
+    NSArray<DTCertificateInfo *> *certificates = [self.ipc cryptoGetCertificatesInfo:&error];
+    if (!certificates && !InfineaUnsupported(error)) {
+        *complete = NO;
+    }
+    if (certificates) {
+        NSMutableArray *entries = [NSMutableArray new];
+        for (DTCertificateInfo *certificate in certificates) {
+            [entries addObject:@{@"slot": @(certificate.slot), @"version": @(certificate.version), @"usage": @(certificate.usage)}];
+        }
+        inventory[@"certificates"] = entries;
+    }
+    
+    error = nil;
+    EMSRKeysInfo *keysInfo = [self.ipc emsrGetKeysInfo:&error];
+    if (keysInfo) {
+        inventory[@"emsrKeys"] = InfineaEmsrKeyEntries(keysInfo, YES);
+    }
+    else if (!InfineaUnsupported(error)) {
+        *complete = NO;
+    }
+    
+    NSMutableDictionary *cryptoKeys = [NSMutableDictionary new];
+    for (NSNumber *keyID in @[@(KEY_AUTHENTICATION), @(KEY_ENCRYPTION)]) {
+        uint32_t version = 0;
+        error = nil;
+        if ([self.ipc cryptoGetKeyVersion:keyID.intValue keyVersion:&version error:&error]) {
+            cryptoKeys[keyID.stringValue] = @(version);
+        }
+        else if (!InfineaUnsupported(error)) {
+            *complete = NO;
+        }
+    }
+    if (cryptoKeys.count) {
+        inventory[@"cryptoKeys"] = cryptoKeys;
+    }
+    
+    NSMutableArray *entries = [NSMutableArray new];
+    for (NSNumber *keyID in ppadKeys) {
+        error = nil;
+        DTKeyInfo *key = [self.ipc ppadGetKeyInfo:keyID.intValue error:&error];
+        if (!key && !InfineaUnsupported(error)) {
+            *complete = NO;
+        }
+        if (key) {
+            [entries addObject:@{@"keyID": keyID, @"checkValue": InfineaHexString(key.checkValue), @"type": @(key.type),
+                                 @"usage": key.usage ?: @"", @"mode": [NSString stringWithFormat:@"%c", key.mode ?: ' '], @"version": @(key.version)}];
+        }
+    }
+    inventory[@"ppadKeys"] = entries;
+    inventory[@"ppadKeyIDs"] = ppadKeys;
+    return inventory;
+}
+
+// Called after a key or certificate load, the next keyInventory queries the device again
+- (void)invalidateKeyInventory
+{
+    dispatch_async(self.commandQueue, ^{
+        NSString *serial = self.ipc.serialNumber ?: @"";
+        NSMutableDictionary *updated = [[[NSUserDefaults standardUserDefaults] dictionaryForKey:kKeyInventoryKey] mutableCopy];
+        [updated removeObjectForKey:serial];
+        if (updated) {
+            [[NSUserDefaults standardUserDefaults] setObject:updated forKey:kKeyInventoryKey];
+        }
+        self.keyInventoryVersions = nil;
+        // Loaded keys show up in the security state right away instead of after the current backoff interval
+        if (self.securityTimer) {
+            [self securityWatchdogRestart];
+        }
+    });
+}
+
+- (void)keyInventoryInvalidate:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call keyInventoryInvalidate");
+    
+    [self invalidateKeyInventory];
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+#pragma mark - Security watchdog
+
+- (void)securityWatchdogStart
+{
+    dispatch_async(self.commandQueue, ^{
+        [self securityWatchdogRestart];
+    });
+}
+
+- (void)securityWatchdogStop
+{
+    // A state verified on another connection may belong to another device
+    self.securityGeneration++;
+    self.securityState = nil;
+    dispatch_async(self.commandQueue, ^{
+        [self securityWatchdogCancel];
+    });
+}
+
+// Runs on the command queue
+- (void)securityWatchdogCancel
+{
+    if (self.securityTimer) {
+        dispatch_source_cancel(self.securityTimer);
+        self.securityTimer = nil;
+    }
+}
+
+// Runs on the command queue
+- (void)securityWatchdogRestart
+{
+    [self securityWatchdogCancel];
+    if (!self.securityWatchdog || self.ipc.connstate != CONN_CONNECTED) {
+        return;
+    }
+    
+    self.securityInterval = self.securityMinInterval;
+    self.securityTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.commandQueue);
+    // One-shot, securityWatchdogFire sets the next fire time
+    dispatch_source_set_timer(self.securityTimer, dispatch_time(DISPATCH_TIME_NOW, 0), DISPATCH_TIME_FOREVER, NSEC_PER_SEC);
+    
+    __weak InfineaSDKCordova *weakSelf = self;
+    dispatch_source_set_event_handler(self.securityTimer, ^{
+        [weakSelf securityWatchdogFire];
+    });
+    dispatch_resume(self.securityTimer);
+}
 
-// Available functions
-- (void)setDeveloperKey:(CDVInvokedUrlCommand *)command;
-- (void)connect:(CDVInvokedUrlCommand*)command;
-- (void)disconnect:(CDVInvokedUrlCommand*)command;
-- (void)getConnectedDeviceInfo:(CDVInvokedUrlCommand*)command;
-- (void)getConnectedDevicesInfo:(CDVInvokedUrlCommand*)command;
-- (void)setPassThroughSync:(CDVInvokedUrlCommand*)command;
-- (void)getPassThroughSync:(CDVInvokedUrlCommand*)command;
-- (void)setUSBChargeCurrent:(CDVInvokedUrlCommand*)command;
-- (void)getUSBChargeCurrent:(CDVInvokedUrlCommand*)command;
-- (void)getBatteryInfo:(CDVInvokedUrlCommand*)command;
-- (void)setAutoOffWhenIdle:(CDVInvokedUrlCommand*)command;
-- (void)rfInit:(CDVInvokedUrlCommand*)command;
-- (void)rfClose:(CDVInvokedUrlCommand*)command;
-- (void)barcodeGetScanButtonMode:(CDVInvokedUrlCommand*)command;
-- (void)barcodeSetScanButtonMode:(CDVInvokedUrlCommand*)command;
-- (void)barcodeGetScanMode:(CDVInvokedUrlCommand*)command;
-- (void)barcodeSetScanMode:(CDVInvokedUrlCommand*)command;
-- (void)barcodeStartScan:(CDVInvokedUrlCommand*)command;
-- (void)barcodeStopScan:(CDVInvokedUrlCommand*)command;
-- (void)setCharging:(CDVInvokedUrlCommand*)command;
-- (void)getFirmwareFileInformation:(CDVInvokedUrlCommand*)command;
-- (void)updateFirmwareData:(CDVInvokedUrlCommand*)command;
-- (void)emsrSetEncryption:(CDVInvokedUrlCommand*)command;
-- (void)emsrSetActiveHead:(CDVInvokedUrlCommand*)command;
-- (void)emsrConfigMaskedDataShowExpiration:(CDVInvokedUrlCommand*)command;
-- (void)emsrIsTampered:(CDVInvokedUrlCommand*)command;
-- (void)emsrGetKeyVersion:(CDVInvokedUrlCommand*)command;
-- (void)emsrGetDeviceInfo:(CDVInvokedUrlCommand*)command;
-- (void)barcodeSetScanBeep: (CDVInvokedUrlCommand *)command;
+// Runs on the command queue
+- (void)securityWatchdogFire
+{
+    if (!self.securityTimer) {
+        return;
+    }
+    NSDictionary *previous = self.securityState;
+    NSDictionary *state = [self securityCheck];
+    
+    BOOL changed = !previous || ![previous[@"ok"] isEqual:state[@"ok"]] || ![previous[@"tampered"] isEqual:state[@"tampered"]] ||
+                   ![previous[@"keys"] isEqual:state[@"keys"]];
+    // Back off while the device stays verified, poll at the short interval after any change or failure
+    if ([state[@"ok"] boolValue] && !changed) {
+        self.securityInterval = MIN(self.securityInterval * 2, self.securityMaxInterval);
+    }
+    else {
+        self.securityInterval = self.securityMinInterval;
+    }
+    
+    if (changed) {
+        [self sendEvent:@"securityStateChanged" arguments:@[[self securitySnapshot:state]]];
+    }
+    
+    if (self.securityTimer) {
+        dispatch_source_set_timer(self.securityTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.securityInterval * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC);
+    }
+}
 
-@end
+// Reads tamper state and key versions and stores the result, unless the device disconnected meanwhile. Runs on the command queue
+- (NSDictionary *)securityCheck
+{
+    NSUInteger generation = self.securityGeneration;
+    NSError *error = nil;
+    BOOL tampered = NO;
+    BOOL verified = NO;
+    NSMutableArray *keys = [NSMutableArray new];
+    
+    // The keys info carries the tamper flag as well, so one round trip covers both
+    EMSRKeysInfo *keysInfo = self.ipc.connstate == CONN_CONNECTED ? [self.ipc emsrGetKeysInfo:&error] : nil;
+    if (keysInfo) {
+        tampered = keysInfo.tampered;
+        for (EMSRKey *key in keysInfo.keys) {
+            [keys addObject:@{@"keyID": @(key.keyID), @"keyVersion": @(key.keyVersion)}];
+        }
+        verified = YES;
+    }
+    else if (self.ipc.connstate == CONN_CONNECTED) {
+        error = nil;
+        verified = [self.ipc emsrIsTampered:&tampered error:&error];
+    }
+    
+    NSString *reason = nil;
+    if (!verified) {
+        reason = error.localizedDescription ?: @"Device is not connected!";
+    }
+    else if (tampered) {
+        reason = @"Device is tampered!";
+    }
+    else {
+        for (NSNumber *keyID in self.securityRequiredKeys) {
+            if (![keysInfo getKeyVersion:keyID.intValue]) {
+                reason = [NSString stringWithFormat:@"Key %@ is not loaded!", keyID];
+                break;
+            }
+        }
+    }
+    
+    NSDictionary *state = @{@"ok": @(reason == nil), @"tampered": @(tampered), @"keys": keys, @"reason": reason ?: [NSNull null],
+                            @"checkedAt": @(round([[NSDate date] timeIntervalSince1970] * 1000.0)),
+                            @"uptime": @([[NSProcessInfo processInfo] systemUptime])};
+    // A result from before a disconnect must not be taken for the next connection
+    if (generation != self.securityGeneration || self.ipc.connstate != CONN_CONNECTED) {
+        NSMutableDictionary *late = [state mutableCopy];
+        late[@"ok"] = @NO;
+        late[@"reason"] = verified ? @"Device disconnected during the check!" : reason;
+        return late;
+    }
+    self.securityState = state;
+    return state;
+}
 
-@implementation InfineaSDKCordova
+// The state as sent to JS, with its age instead of the check uptime
+- (NSDictionary *)securitySnapshot:(NSDictionary *)state
+{
+    if (!state) {
+        return @{@"ok": @NO, @"stale": @YES, @"reason": @"Security state was not checked yet!"};
+    }
+    NSMutableDictionary *snapshot = [state mutableCopy];
+    NSTimeInterval age = [[NSProcessInfo processInfo] systemUptime] - [state[@"uptime"] doubleValue];
+    [snapshot removeObjectForKey:@"uptime"];
+    snapshot[@"ageMs"] = @(round(age * 1000.0));
+    snapshot[@"stale"] = @(age > self.securityMaxAge);
+    snapshot[@"nextCheckMs"] = @(round(MAX(self.securityInterval - age, 0) * 1000.0));
+    return snapshot;
+}
 
-// Prototype
-- (void)coolMethod:(CDVInvokedUrlCommand*)command
+- (void)securityGetState:(CDVInvokedUrlCommand *)command
 {
-    NSLog(@"Call coolMethod");
+    NSLog(@"Call securityGetState");
     
-    CDVPluginResult* pluginResult = nil;
-    NSString* echo = [command.arguments objectAtIndex:0];
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:[self securitySnapshot:self.securityState]];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+- (void)securityCheckout:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call securityCheckout");
     
-    if (echo != nil && [echo length] > 0) {
-        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsString:echo];
-    } else {
-        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR];
+    // A fresh state is answered here without a device round trip, only a stale or missing one waits for a check
+    NSDictionary *snapshot = [self securitySnapshot:self.securityState];
+    if (![snapshot[@"stale"] boolValue]) {
+        CDVPluginResult *pluginResult = [snapshot[@"ok"] boolValue] ? [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:snapshot]
+                                                                      : [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:snapshot[@"reason"]];
+        [self sendPluginResult:pluginResult command:command];
+        return;
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    dispatch_async(self.commandQueue, ^{
+        NSDictionary *checked = [self securitySnapshot:[self securityCheck]];
+        CDVPluginResult *pluginResult = [checked[@"ok"] boolValue] ? [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:checked]
+                                                                    : [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:checked[@"reason"]];
+        [self sendPluginResult:pluginResult command:command];
+    });
 }
-// *********
 
-// Callback helper
-- (void)callback:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2)
+- (void)securitySetWatchdogOptions:(CDVInvokedUrlCommand *)command
 {
-    va_list args;
-    va_start(args, format);
-    NSString *javascript = [[NSString alloc] initWithFormat:format arguments:args];
-    va_end(args);
+    NSLog(@"Call securitySetWatchdogOptions");
     
-    if ([self.webView isKindOfClass:WKWebView.class]) {
-        [(WKWebView*)self.webView evaluateJavaScript:javascript completionHandler:^(id result, NSError *error) {}];
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    NSTimeInterval minInterval = options[@"minInterval"] ? [options[@"minInterval"] doubleValue] : self.securityMinInterval;
+    NSTimeInterval maxInterval = options[@"maxInterval"] ? [options[@"maxInterval"] doubleValue] : self.securityMaxInterval;
+    NSTimeInterval maxAge = options[@"maxAge"] ? [options[@"maxAge"] doubleValue] : self.securityMaxAge;
+    NSArray *requiredKeys = [options[@"requiredKeys"] isKindOfClass:[NSArray class]] ? options[@"requiredKeys"] : self.securityRequiredKeys;
+    requiredKeys = [requiredKeys filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self isKindOfClass: %@", [NSNumber class]]];
+    
+    if (minInterval < 1 || maxInterval < minInterval || maxAge <= 0) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Invalid security watchdog options!"];
+        [self sendPluginResult:pluginResult command:command];
+        return;
     }
-    else {
-        [(UIWebView*)self.webView stringByEvaluatingJavaScriptFromString: javascript];
+    
+    dispatch_async(self.commandQueue, ^{
+        self.securityMinInterval = minInterval;
+        self.securityMaxInterval = maxInterval;
+        self.securityMaxAge = maxAge;
+        self.securityRequiredKeys = requiredKeys;
+        if (options[@"enabled"]) {
+            self.securityWatchdog = [options[@"enabled"] boolValue];
+        }
+        // Restart so new required keys are checked now, stops the timer when disabled or not connected
+        [self securityWatchdogRestart];
+    });
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+// Test builds only, define INFINEA_TEST_DUKPT (GCC_PREPROCESSOR_DEFINITIONS) to include it
+#ifdef INFINEA_TEST_DUKPT
+- (void)dukptDecrypt:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call dukptDecrypt");
+    
+    NSDictionary *options = command.arguments.count > 0 && [command.arguments[0] isKindOfClass:[NSDictionary class]] ? command.arguments[0] : @{};
+    BOOL aes = [options[@"aes"] boolValue];
+    NSString *usageName = [options[@"usage"] isKindOfClass:[NSString class]] ? options[@"usage"] : @"data";
+    NSData *bdk = InfineaHexData(options[@"bdk"]);
+    NSArray *payloads = [options[@"payloads"] isKindOfClass:[NSArray class]] ? options[@"payloads"] : nil;
+    
+    NSDictionary *usages = aes ? @{@"pin": @(INFINEA_DUKPT_AES_PIN), @"mac": @(INFINEA_DUKPT_AES_MAC), @"data": @(INFINEA_DUKPT_AES_DATA_ENCRYPT),
+                                   @"dataDecrypt": @(INFINEA_DUKPT_AES_DATA_DECRYPT), @"dataBoth": @(INFINEA_DUKPT_AES_DATA)}
+                               : @{@"pin": @(INFINEA_DUKPT_PIN), @"mac": @(INFINEA_DUKPT_MAC), @"data": @(INFINEA_DUKPT_DATA),
+                                   @"dataVariant": @(INFINEA_DUKPT_DATA_VARIANT)};
+    NSNumber *usage = usages[usageName];
+    
+    NSString *invalid = nil;
+    if (!self.dukptEngines) {
+        invalid = @"Test DUKPT decryption is disabled, set the InfineaTestDUKPT preference";
+    }
+    else if (bdk.length != 16) {
+        invalid = @"bdk must be 16 bytes of hex";
+    }
+    else if (!usage) {
+        invalid = [NSString stringWithFormat:@"Unknown key usage %@", usageName];
+    }
+    else if (!payloads) {
+        invalid = @"payloads must be a list of {ksn, data}";
+    }
+    if (invalid) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:invalid];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+    // CPU only, so it stays off the command queue and device commands are not held up
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+        NSMutableArray *results = [NSMutableArray arrayWithCapacity:payloads.count];
+        uint64_t hits = 0, misses = 0;
+        
+        @synchronized (self.dukptEngines) {
+            NSString *engineKey = [NSString stringWithFormat:@"%@/%d/%@", InfineaHexString(bdk), aes, usage];
+            NSMutableData *engine = self.dukptEngines[engineKey];
+            if (!engine) {
+                engine = [NSMutableData dataWithLength:sizeof(infinea_dukpt)];
+                infinea_dukpt_init(engine.mutableBytes, bdk.bytes, aes, usage.intValue);
+                self.dukptEngines[engineKey] = engine;
+            }
+            infinea_dukpt *dukpt = engine.mutableBytes;
+            uint64_t hitsBefore = dukpt->hits, missesBefore = dukpt->misses;
+            
+            for (id payload in payloads) {
+                NSDictionary *entry = [payload isKindOfClass:[NSDictionary class]] ? payload : @{};
+                NSData *ksn = InfineaHexData(entry[@"ksn"]);
+                NSData *data = InfineaHexData(entry[@"data"]);
+                NSMutableData *plain = [NSMutableData dataWithLength:data.length];
+                if (ksn && data && infinea_dukpt_decrypt(dukpt, ksn.bytes, ksn.length, data.bytes, data.length, plain.mutableBytes)) {
+                    [results addObject:InfineaHexString(plain)];
+                }
+                else {
+                    [results addObject:[NSNull null]];
+                }
+            }
+            hits = dukpt->hits - hitsBefore;
+            misses = dukpt->misses - missesBefore;
+        }
+        
+        NSDictionary *result = @{@"payloads": results, @"keysDerived": @(misses), @"keysCached": @(hits),
+                                 @"ms": @(round(([[NSProcessInfo processInfo] systemUptime] - start) * 1000.0))};
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:result];
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+#endif
+
+- (void)msSetLoyaltyReading:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call msSetLoyaltyReading");
+    
+    NSArray *loyaltyIDs = [command.arguments.firstObject isKindOfClass:[NSArray class]] ? command.arguments.firstObject : @[];
+    self.loyaltyIDs = [loyaltyIDs filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self isKindOfClass: %@", [NSNumber class]]];
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
+    [self sendPluginResult:pluginResult command:command];
+}
+
+#pragma mark - EMV messages
+// The universal EMV engine takes its UI messages and sounds one ID at a time, and they hold for the next transaction only.
+// The table is kept natively and uploaded on the command queue right before emvStartTransaction starts a transaction.
+
+- (void)emvSyncMessages:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call emvSyncMessages");
+    
+    NSDictionary *table = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    NSArray *messages = [table[@"messages"] isKindOfClass:[NSArray class]] ? table[@"messages"] : @[];
+    NSArray *sounds = [table[@"sounds"] isKindOfClass:[NSArray class]] ? table[@"sounds"] : @[];
+    
+    // Entries are checked before anything is kept, so a bad table leaves the stored one as it was
+    NSMutableDictionary *entries = [NSMutableDictionary new];
+    NSString *invalid = nil;
+    for (id item in messages) {
+        NSDictionary *message = [item isKindOfClass:[NSDictionary class]] ? item : @{};
+        id text = message[@"message"] ?: [NSNull null];
+        if (![message[@"id"] isKindOfClass:[NSNumber class]] || !([text isKindOfClass:[NSString class]] || text == [NSNull null])) {
+            invalid = @"Messages must be {id, font, message}";
+            break;
+        }
+        int messageID = [message[@"id"] intValue];
+        int font = message[@"font"] ? [message[@"font"] intValue] : FONT_8X16;
+        entries[[NSString stringWithFormat:@"message:%d", messageID]] = @{@"id": @(messageID), @"font": @(font), @"value": text};
+    }
+    for (id item in sounds) {
+        NSDictionary *sound = [item isKindOfClass:[NSDictionary class]] ? item : @{};
+        id data = sound[@"sound"] && sound[@"sound"] != [NSNull null] ? (id)InfineaHexData(sound[@"sound"]) : [NSNull null];
+        if (![sound[@"id"] isKindOfClass:[NSNumber class]] || !data) {
+            invalid = @"Sounds must be {id, sound} with the sound in hex";
+            break;
+        }
+        int messageID = [sound[@"id"] intValue];
+        entries[[NSString stringWithFormat:@"sound:%d", messageID]] = @{@"id": @(messageID), @"value": data};
+    }
+    if (invalid) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:invalid];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+    dispatch_async(self.commandQueue, ^{
+        [self.emvMessageTable addEntriesFromDictionary:entries];
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:@{@"entries": @(self.emvMessageTable.count)}];
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+// Uploads the table for the next transaction. Runs on the command queue
+- (NSDictionary *)uploadEmvMessages
+{
+    NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+    NSUInteger uploaded = 0;
+    NSMutableArray *failed = [NSMutableArray new];
+    
+    for (NSString *key in [self.emvMessageTable.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+        NSDictionary *entry = self.emvMessageTable[key];
+        NSError *error = nil;
+        id value = entry[@"value"] == [NSNull null] ? nil : entry[@"value"];
+        BOOL isSuccess = [key hasPrefix:@"sound:"] ? [self.ipc emv2SetMessageSoundForID:[entry[@"id"] intValue] sound:value error:&error]
+                                                   : [self.ipc emv2SetMessageForID:[entry[@"id"] intValue] font:[entry[@"font"] intValue] message:value error:&error];
+        if (isSuccess) {
+            uploaded++;
+        }
+        else {
+            [failed addObject:@{@"entry": key, @"error": error.localizedDescription ?: @""}];
+        }
     }
+    
+    return @{@"uploaded": @(uploaded), @"failed": failed, @"ms": @(round(([[NSProcessInfo processInfo] systemUptime] - start) * 1000.0))};
 }
 
+- (void)emvStartTransaction:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call emvStartTransaction");
+    
+    NSDictionary *options = [command.arguments.firstObject isKindOfClass:[NSDictionary class]] ? command.arguments.firstObject : @{};
+    int interfaces = options[@"interfaces"] ? [options[@"interfaces"] intValue] : EMV_INTERFACE_CONTACT | EMV_INTERFACE_CONTACTLESS | EMV_INTERFACE_MAGNETIC;
+    int flags = [options[@"flags"] intValue];
+    NSData *initData = options[@"initData"] ? InfineaHexData(options[@"initData"]) : nil;
+    NSTimeInterval timeout = options[@"timeout"] ? [options[@"timeout"] doubleValue] : 60;
+    
+    if ((options[@"initData"] && !initData) || timeout <= 0) {
+        CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Invalid transaction options!"];
+        [self sendPluginResult:pluginResult command:command];
+        return;
+    }
+    
+    dispatch_async(self.commandQueue, ^{
+        // Messages hold for one transaction, so they go out right before it starts
+        NSDictionary *messages = [self uploadEmvMessages];
+        NSError *error = nil;
+        CDVPluginResult *pluginResult = nil;
+        if ([self.ipc emv2StartTransactionOnInterface:interfaces flags:flags initData:initData timeout:timeout error:&error]) {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:messages];
+        }
+        else {
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
 
+- (void)emvCancelTransaction:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call emvCancelTransaction");
+    
+    dispatch_async(self.commandQueue, ^{
+        NSError *error = nil;
+        BOOL isSuccess = [self.ipc emv2CancelTransaction:&error];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            // A cancelled transaction has no outcome to carry the VAS result of its tap
+            if (isSuccess) {
+                [self emvSendPendingVAS];
+            }
+            CDVPluginResult *pluginResult = isSuccess ? [CDVPluginResult resultWithStatus:CDVCommandStatus_OK]
+                                                      : [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+            [self sendPluginResult:pluginResult command:command];
+        });
+    });
+}
 
 // SDK API
+- (void)pogCommand:(CDVInvokedUrlCommand *)command
+{
+    int solution = [command.arguments[0] intValue];
+    int pogCommand = [command.arguments[1] intValue];
+    NSData *data = nil;
+    if (command.arguments.count > 2 && [command.arguments[2] isKindOfClass:[NSData class]]) {
+        data = command.arguments[2];
+    }
+    
+    // Commands run in order on the command queue, so JS can issue the next one without waiting for the reply
+    dispatch_async(self.commandQueue, ^{
+        CDVPluginResult *pluginResult = nil;
+        NSError *error = nil;
+        NSData *response = [self.ipc pogCommandForSolution:solution command:pogCommand data:data error:&error];
+        
+        [self pogStats:solution add:1 to:@"commands"];
+        [self pogStats:solution add:data.length to:@"bytesSent"];
+        
+        if (response) {
+            [self pogStats:solution add:response.length to:@"bytesReceived"];
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsArrayBuffer:response];
+        }
+        else {
+            [self pogStats:solution add:1 to:@"commandErrors"];
+            pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+        }
+        
+        [self sendPluginResult:pluginResult command:command];
+    });
+}
+
+- (NSDictionary *)pogStatsSnapshot
+{
+    @synchronized (self.pogStats) {
+        NSMutableDictionary *copy = [NSMutableDictionary new];
+        for (NSString *key in self.pogStats) {
+            copy[key] = [self.pogStats[key] copy];
+        }
+        return copy;
+    }
+}
+
+- (void)pogGetStats:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call pogGetStats");
+    
+    CDVPluginResult *pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK messageAsDictionary:[self pogStatsSnapshot]];
+    [self sendPluginResult:pluginResult command:command];
+}
+
 - (void)barcodeSetScanBeep: (CDVInvokedUrlCommand *)command{
     NSLog(@"Call barocdeSetScanBeep");
     
@@ -107,7 +3619,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:beepError.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)emsrGetKeyVersion:(CDVInvokedUrlCommand*)command{
@@ -127,7 +3639,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)emsrGetDeviceInfo:(CDVInvokedUrlCommand *)command{
@@ -151,7 +3663,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)emsrIsTampered:(CDVInvokedUrlCommand *)command
@@ -169,7 +3681,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)emsrConfigMaskedDataShowExpiration:(CDVInvokedUrlCommand *)command
@@ -191,7 +3703,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)emsrSetActiveHead:(CDVInvokedUrlCommand *)command
@@ -209,7 +3721,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)emsrSetEncryption:(CDVInvokedUrlCommand *)command
@@ -236,7 +3748,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)setCharging:(CDVInvokedUrlCommand *)command
@@ -254,7 +3766,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)barcodeStartScan:(CDVInvokedUrlCommand *)command
@@ -266,12 +3778,13 @@
     NSError *error;
     BOOL isSuccess = [self.ipc barcodeStartScan:&error];
     if (!error || isSuccess) {
+        [self symbologyAttemptBegan];
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
     } else {
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)barcodeStopScan:(CDVInvokedUrlCommand *)command
@@ -283,12 +3796,13 @@
     NSError *error;
     BOOL isSuccess = [self.ipc barcodeStopScan:&error];
     if (!error || isSuccess) {
+        [self symbologyAttemptEnded];
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_OK];
     } else {
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)barcodeGetScanMode:(CDVInvokedUrlCommand *)command
@@ -306,7 +3820,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)barcodeSetScanMode:(CDVInvokedUrlCommand *)command
@@ -324,7 +3838,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)barcodeGetScanButtonMode:(CDVInvokedUrlCommand *)command
@@ -342,7 +3856,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)barcodeSetScanButtonMode:(CDVInvokedUrlCommand *)command
@@ -360,7 +3874,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)rfClose:(CDVInvokedUrlCommand *)command
@@ -376,7 +3890,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)rfInit:(CDVInvokedUrlCommand *)command
@@ -392,7 +3906,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)setAutoOffWhenIdle:(CDVInvokedUrlCommand *)command
@@ -411,7 +3925,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)getBatteryInfo:(CDVInvokedUrlCommand *)command
@@ -437,7 +3951,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)getUSBChargeCurrent:(CDVInvokedUrlCommand *)command
@@ -455,7 +3969,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)setUSBChargeCurrent:(CDVInvokedUrlCommand *)command
@@ -473,7 +3987,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)getPassThroughSync:(CDVInvokedUrlCommand *)command
@@ -491,7 +4005,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)setPassThroughSync:(CDVInvokedUrlCommand *)command
@@ -509,7 +4023,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)getConnectedDevicesInfo:(CDVInvokedUrlCommand *)command
@@ -541,7 +4055,7 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)getConnectedDeviceInfo:(CDVInvokedUrlCommand *)command
@@ -568,29 +4082,42 @@
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
     }
     
-    [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    [self sendPluginResult:pluginResult command:command];
 }
 
 - (void)setDeveloperKey:(CDVInvokedUrlCommand *)command
 {
     
     NSLog(@"Call setDeveloperKey");
+    [self startupMark:@"setDeveloperKey"];
 
     NSString* key = [command.arguments objectAtIndex:0];
 
-    CDVPluginResult* pluginResult = nil;
-
-    NSError *error;
-    self.iq = [IPCIQ registerIPCIQ];
-    [self.iq setDeveloperKey:key withError:&error];
-    if (error) {
-        pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
-        [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+    // IPCIQ is registered on a later main loop pass so it does not hold up the accessory connect or first paint,
+    // it keeps its timers on the main run loop. Key validation then runs in the background.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (!self.iq) {
+            self.iq = [IPCIQ registerIPCIQ];
+        }
+        [self startupMark:@"iqRegistered"];
         
-        NSLog(@"Developer Key Error: %@", error.localizedDescription);
-    }
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            NSError *error;
+            [self.iq setDeveloperKey:key withError:&error];
+            [self startupMark:@"developerKeyValidated"];
+            if (error) {
+                CDVPluginResult* pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
+                [self sendPluginResult:pluginResult command:command];
+                
+                NSLog(@"Developer Key Error: %@", error.localizedDescription);
+            }
+        });
+    });
 
-    self.ipc = [IPCDTDevices sharedDevice];
+    if (!self.ipc) {
+        self.ipc = [IPCDTDevices sharedDevice];
+    }
+    [self startupMark:@"sharedDevice"];
 }
 
 - (NSURL *)resourcePath
@@ -613,7 +4140,7 @@
         
         if (!fileData) {
             pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Unable to read file. Check file path!"];
-            [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+            [self sendPluginResult:pluginResult command:command];
             return;
         }
         else {
@@ -626,14 +4153,14 @@
                 pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
             }
             
-            [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+            [self sendPluginResult:pluginResult command:command];
             
             return;
         }
         
     } @catch (NSException *exception) {
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:exception.reason];
-        [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+        [self sendPluginResult:pluginResult command:command];
         
         return;
     }
@@ -652,7 +4179,7 @@
     
     if (self.ipc.connstate != CONN_CONNECTED) {
         pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Device is not connected!"];
-        [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+        [self sendPluginResult:pluginResult command:command];
         
         return;
     }
@@ -662,7 +4189,7 @@
             
             if (!fileData) {
                 pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:@"Unable to read file. Check file path!"];
-                [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+                [self sendPluginResult:pluginResult command:command];
                 return;
             }
             else {
@@ -674,29 +4201,39 @@
                     pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:error.localizedDescription];
                 }
                 
-                [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+                [self sendPluginResult:pluginResult command:command];
                 
                 return;
             }
             
         } @catch (NSException *exception) {
             pluginResult = [CDVPluginResult resultWithStatus:CDVCommandStatus_ERROR messageAsString:exception.reason];
-            [self.commandDelegate sendPluginResult:pluginResult callbackId:command.callbackId];
+            [self sendPluginResult:pluginResult command:command];
             
             return;
         }
     }
 }
 
-- (void)connect:(CDVInvokedUrlCommand *)command
+- (void)connectDevice
 {
-    NSLog(@"Call connect");
+    [self startupMark:@"connectStarted"];
     
     self.ipc = [IPCDTDevices sharedDevice];
-    [self.ipc addDelegate:self];
+    if (!self.delegateAdded) {
+        [self.ipc addDelegate:self];
+        self.delegateAdded = YES;
+    }
     [self.ipc connect];
 }
 
+- (void)connect:(CDVInvokedUrlCommand *)command
+{
+    NSLog(@"Call connect");
+    
+    [self connectDevice];
+}
+
 - (void)disconnect:(CDVInvokedUrlCommand *)command
 {
     NSLog(@"Call disconnect");
@@ -708,77 +4245,202 @@
 #pragma mark - IPCDeviceDelegate
 - (void)connectionState:(int)state
 {
+    if (state == CONN_CONNECTED) {
+        [self startupMark:@"connected"];
+        [self clockStart];
+        [self applyActiveProfileOnConnect];
+        [self storeRfKeysOnConnect];
+        self.keyInventoryVersions = nil;
+        [self securityWatchdogStart];
+    }
+    else {
+        [self clockStop];
+        [self securityWatchdogStop];
+        [self emvSendPendingVAS];
+    }
+    
     [self callback:@"Infinea.connectionState(%i)", state];
 }
 
+// Held until the outcome, however long online authorization or PIN entry take
+- (void)emv2OnAppleVASProcessedWithResult:(int)result data:(NSData *)data
+{
+    self.emvPendingVAS = InfineaVASPasses(result, data);
+}
+
+- (void)emv2OnTransactionFinished:(NSData *)data
+{
+    // The loyalty passes of the tap go out in the same event as the outcome
+    NSDictionary *vas = self.emvPendingVAS;
+    self.emvPendingVAS = nil;
+    [self sendEvent:@"emvTransactionFinished" arguments:@[InfineaHexString(data), vas ?: [NSNull null]]];
+}
+
+// Sends a held VAS result without an outcome, when its transaction will not finish. Main thread
+- (void)emvSendPendingVAS
+{
+    NSDictionary *vas = self.emvPendingVAS;
+    self.emvPendingVAS = nil;
+    if (vas) {
+        [self sendEvent:@"emvTransactionFinished" arguments:@[[NSNull null], vas]];
+    }
+}
+
 - (void)barcodeData:(NSString *)barcode type:(int)type
 {
+    [self symbologyDecoded:type];
+    uint64_t seq = [self journalEvent:@"barcodeData" arguments:@[barcode ?: @"", @(type)]];
+    
     //*************
     // This send to regular barcodeData as string
-    [self callback:@"Infinea.barcodeData(\"%@\", %i)", barcode, type];
+    const char *code = barcode.UTF8String;
+    size_t length = code ? strlen(code) : 0;
+    NSString *gtin = InfineaGTINLiteral(code, length, type);
+    NSString *gs1 = InfineaGS1Literal(code, length, type);
+    [self callback:@"Infinea.barcodeData(\"%@\", %i, %llu, %@, %@)", InfineaEscapedString(barcode), type, seq, gtin, gs1];
     
     
     //*************
     // Convert to decimal
-    const char *barcodes = [barcode UTF8String];
-    NSMutableArray *barcodeDecimalArray = [NSMutableArray new];
-    for (int i = 0; i < sizeof(barcodes); i++) {
-        NSString *string = [NSString stringWithFormat:@"%02d", barcodes[i]];
-        NSLog(@"%@", string);
-        [barcodeDecimalArray addObject:string];
-    }
-    NSString *barcodeDecimalString = [barcodeDecimalArray componentsJoinedByString:@","];
+    NSData *bytes = [barcode dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *buffer = [NSMutableData dataWithLength:bytes.length * 4 + 1];
+    infinea_decimal_list(bytes.bytes, bytes.length, buffer.mutableBytes);
     
     // Send to barcodeDecimals as decimal array
-    [self callback:@"Infinea.barcodeDecimals([%@], %i)", barcodeDecimalString, type];
+    [self callback:@"Infinea.barcodeDecimals([%s], %i)", (const char *)buffer.bytes, type];
 }
 
 - (void)barcodeNSData:(NSData *)barcode type:(int)type
 {
-    // Hex data
-    NSString *hexData = [NSString stringWithFormat:@"%@", barcode];
-    hexData = [hexData stringByReplacingOccurrencesOfString:@"<" withString:@""];
-    hexData = [hexData stringByReplacingOccurrencesOfString:@">" withString:@""];
-    hexData = [hexData stringByReplacingOccurrencesOfString:@" " withString:@""];
+    [self symbologyDecoded:type];
     
-    // Ascii string
-    uint8_t *bytes=(uint8_t *)[barcode bytes];
-    NSMutableString *escapedString = [@"" mutableCopy];
-    for (int x = 0; x < barcode.length;x++)
-    {
-        [escapedString appendFormat:@"\\x%02X", bytes[x] ];
+    if (![self assembleBarcodePart:barcode type:type]) {
+        [self deliverBarcodeNSData:barcode type:type];
     }
+}
+
+- (void)deliverBarcodeNSData:(NSData *)barcode type:(int)type
+{
+    // Hex data
+    NSString *hexData = InfineaHexString(barcode);
+    uint64_t seq = [self journalEvent:@"barcodeNSData" arguments:@[hexData, @(type)]];
+    
+    NSString *gtin = InfineaGTINLiteral(barcode.bytes, barcode.length, type);
+    
+    NSString *charset = nil;
+    NSString *text = InfineaBarcodeText(barcode, self.barcodeECIEscapes, &charset);
+    NSString *textLiteral = text ? [NSString stringWithFormat:@"\"%@\"", InfineaEscapedString(text)] : @"null";
+    NSString *gs1 = InfineaGS1Literal(barcode.bytes, barcode.length, type);
     
-    [self callback:@"Infinea.barcodeNSData(\"%@\", %i)", hexData, type];
+    [self callback:@"Infinea.barcodeNSData(\"%@\", %i, %llu, %@, %@, \"%@\", %@)", hexData, type, seq, gtin, textLiteral, charset, gs1];
 }
 
 - (void)rfCardDetected:(int)cardIndex info:(DTRFCardInfo *)info
+{
+    self.rfCards[@(cardIndex)] = info;
+    [self rfSessionBegin:cardIndex uid:info.UID];
+    
+    BOOL ndefTag = info.type == CARD_MIFARE_ULTRALIGHT || info.type == CARD_MIFARE_ULTRALIGHT_C || info.type == CARD_ISO15693;
+    if (self.rfReadNdef && ndefTag) {
+        dispatch_async(self.commandQueue, ^{
+            NSDictionary *ndef = [self readNdef:cardIndex info:info];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self deliverCardDetected:cardIndex info:info ndef:ndef];
+            });
+        });
+        return;
+    }
+    
+    [self deliverCardDetected:cardIndex info:info ndef:nil];
+}
+
+- (void)deliverCardDetected:(int)cardIndex info:(DTRFCardInfo *)info ndef:(NSDictionary *)ndef
 {
     NSDictionary *cardInfo = @{@"type": @(info.type),
-                               @"typeStr": info.typeStr,
-                               @"UID": [NSString stringWithFormat:@"%@", info.UID],
+                               @"typeStr": info.typeStr ?: @"",
+                               @"UID": InfineaHexString(info.UID),
                                @"ATQA": @(info.ATQA),
                                @"SAK": @(info.SAK),
                                @"AFI": @(info.AFI),
                                @"DSFID": @(info.DSFID),
                                @"blockSize": @(info.blockSize),
                                @"nBlocks": @(info.nBlocks),
-                               @"felicaPMm": [NSString stringWithFormat:@"%@", info.felicaPMm],
-                               @"felicaRequestData": [NSString stringWithFormat:@"%@", info.felicaRequestData],
+                               @"felicaPMm": InfineaHexString(info.felicaPMm),
+                               @"felicaRequestData": InfineaHexString(info.felicaRequestData),
                                @"cardIndex": @(info.cardIndex)
                                };
+    uint64_t seq = [self journalEvent:@"rfCardDetected" arguments:@[@(cardIndex), cardInfo]];
     
-    [self callback:@"Infinea.rfCardDetected(%i, %@)", cardIndex, cardInfo];
+    [self callback:@"Infinea.rfCardDetected(%i, %@, %llu, %@)", cardIndex, InfineaJSONString(cardInfo), seq, ndef ? InfineaJSONString(ndef) : @"null"];
+}
+
+- (void)rfCardRemoved:(int)cardIndex
+{
+    [self.rfCards removeObjectForKey:@(cardIndex)];
+    [self rfSessionEnd:cardIndex];
 }
 
 - (void)magneticCardData:(NSString *)track1 track2:(NSString *)track2 track3:(NSString *)track3
 {
-    [self callback:@"Infinea.magneticCardData(\"%@\", \"%@\", \"%@\")", track1, track2, track3];
+    [self readLoyalty:^(NSString *loyalty) {
+        NSDictionary *fields = InfineaTrackFields(track1, track2);
+        // Clear tracks are sensitive authentication data, only the masked fields are kept at rest
+        uint64_t seq = [self journalEvent:@"magneticCardData" arguments:@[@"", @"", @"", InfineaJournalTrackFields(fields)]];
+        
+        [self callback:@"Infinea.magneticCardData(\"%@\", \"%@\", \"%@\", %@, %llu, %@)", InfineaEscapedString(track1), InfineaEscapedString(track2), InfineaEscapedString(track3), InfineaJSONString(fields), seq, loyalty];
+    }];
 }
 
 - (void)magneticCardEncryptedData:(int)encryption tracks:(int)tracks data:(NSData *)data track1masked:(NSString *)track1masked track2masked:(NSString *)track2masked track3:(NSString *)track3 source:(int)source
 {
-    [self callback:@"Infinea.magneticCardEncryptedData(%i, %i, \"%@\", \"%@\", \"%@\", \"%@\", %i)", encryption, tracks, [NSString stringWithFormat:@"%@", data], track1masked, track2masked, track3, source];
+    [self readLoyalty:^(NSString *loyalty) {
+        NSString *hexData = InfineaHexString(data);
+        // Track 3 is not encrypted, it stays out of the journal
+        uint64_t seq = [self journalEvent:@"magneticCardEncryptedData" arguments:@[@(encryption), @(tracks), hexData, track1masked ?: @"", track2masked ?: @"", @"", @(source)]];
+        
+        [self callback:@"Infinea.magneticCardEncryptedData(%i, %i, \"%@\", \"%@\", \"%@\", \"%@\", %i, %llu, %@)", encryption, tracks, hexData, InfineaEscapedString(track1masked), InfineaEscapedString(track2masked), InfineaEscapedString(track3), source, seq, loyalty];
+    }];
+}
+
+// Longest a swipe waits for its loyalty data, e.g. behind a slow command on the command queue
+static const NSTimeInterval kLoyaltyWaitTime = 0.3;
+
+// Reads the loyalty data of the card just swiped on the command queue before its event goes out, so both arrive
+// together. The block gets a JSON object of loyalty ID to data, or null when reading is off, the card is not a loyalty
+// card or the read did not finish within kLoyaltyWaitTime. Main thread
+- (void)readLoyalty:(void (^)(NSString *loyalty))deliver
+{
+    NSArray *loyaltyIDs = self.loyaltyIDs;
+    if (!loyaltyIDs.count) {
+        deliver(@"null");
+        return;
+    }
+    
+    // Whichever of the read and the timeout comes first delivers, both on the main thread
+    __block BOOL delivered = NO;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kLoyaltyWaitTime * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        if (!delivered) {
+            delivered = YES;
+            deliver(@"null");
+        }
+    });
+    
+    dispatch_async(self.commandQueue, ^{
+        NSMutableDictionary *loyalty = [NSMutableDictionary new];
+        for (NSNumber *loyaltyID in loyaltyIDs) {
+            NSString *data = [self.ipc msGetLoyaltyDataForID:loyaltyID.intValue error:nil];
+            if (data.length) {
+                loyalty[loyaltyID.stringValue] = data;
+            }
+        }
+        NSString *json = loyalty.count ? InfineaJSONString(loyalty) : @"null";
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (!delivered) {
+                delivered = YES;
+                deliver(json);
+            }
+        });
+    });
 }
 
 - (void)magneticCardReadFailed:(int)source reason:(int)reason
@@ -793,11 +4455,13 @@
 
 - (void)deviceButtonPressed:(int)which
 {
+    [self symbologyAttemptBegan];
     [self callback:@"Infinea.deviceButtonPressed(%i)", which];
 }
 
 - (void)deviceButtonReleased:(int)which
 {
+    [self symbologyAttemptEnded];
     [self callback:@"Infinea.deviceButtonReleased(%i)", which];
 }
 
@@ -806,6 +4470,14 @@
     [self callback:@"Infinea.firmwareUpdateProgress(%i, %i)", phase, percent];
 }
 
+- (void)pogEventDataForSolution:(POG_SOLUTIONS)solution command:(int)command data:(NSData *)data
+{
+    [self pogStats:solution add:1 to:@"events"];
+    [self pogStats:solution add:data.length to:@"eventBytes"];
+    
+    [self sendEvent:@"pogEventData" arguments:@[@(solution), @(command), data ?: [NSData data]]];
+}
+
 
 @end
 
@@ -1,4 +1,48 @@
 var exec = require('cordova/exec');
+var channel = require('cordova/channel');
+var base64 = require('cordova/base64');
+
+// ***** Direct command channel ****
+// High-frequency commands are posted straight to the plugin's WKScriptMessageHandler when available,
+// bypassing the cordova/exec queue. Arguments must be JSON-compatible.
+var directCallbacks = {};
+var directCallbackId = 0;
+
+function directHandler() {
+    return window.webkit && window.webkit.messageHandlers && window.webkit.messageHandlers.infinea;
+}
+
+function execDirect(success, error, action, args) {
+    var handler = directHandler();
+    if (!handler) {
+        exec(success, error, 'InfineaSDKCordova', action, args);
+        return;
+    }
+
+    var id = ++directCallbackId;
+    directCallbacks[id] = { success: success, error: error };
+    handler.postMessage({ id: id, action: action, args: args });
+}
+
+/**
+ * Called by native with the reply to a command sent over the direct channel
+ */
+exports._directReply = function (id, ok, value) {
+    var callbacks = directCallbacks[id];
+    if (!callbacks) {
+        return;
+    }
+    delete directCallbacks[id];
+
+    if (value && value.CDVType === 'ArrayBuffer') {
+        value = base64.toArrayBuffer(value.data);
+    }
+
+    var callback = ok ? callbacks.success : callbacks.error;
+    if (typeof callback === 'function') {
+        callback(value);
+    }
+};
 
 // Enum
 exports.SUPPORTED_DEVICE_TYPES = {
@@ -109,6 +153,17 @@ exports.UPDATE_PHASE = {
     */
     UPDATE_COMPLETING: 4
 };
+
+exports.POG_SOLUTIONS = {
+    /**
+     My Pinpad
+     */
+    POG_SOLUTION_MY_PINPAD: 1,
+    /**
+     Magic Cube
+     */
+    POG_SOLUTION_MAGIC_CUBE: 2
+};
                
 // ******* SDK Delegates ********
 // These functions will be called when the scanner receives these events
@@ -116,14 +171,18 @@ exports.UPDATE_PHASE = {
  * Callback from SDK
  * @param {string} barcode The scanned barcode
  * @param {int} type The barcode type
+ * @param {int} seq Scan journal sequence number, 0 if the journal is not open
+ * @param {int} gtin GTIN-14 of UPC-A, UPC-E, EAN-8, EAN-13 and ITF-14 scans as a number, null for other barcodes or invalid check digits
+ * @param {key-value} gs1 GS1 data parsed natively from GS1 Digital Link URIs in QR and DataMatrix codes, or from GS1 element strings:
+ * source ("digitalLink" or "elementString"), elements [{ai, value}] in scan order, valid (false if a check digit is wrong). null if the scan has none
  */
-exports.barcodeData = function (barcode, type) {
+exports.barcodeData = function (barcode, type, seq, gtin, gs1) {
     
 };
   
 /**
 * Callback from SDK
-* @param {array} barcodes The scanned barcode in decimal array. Need to combine them back into a string
+* @param {array} barcodes The scanned barcode UTF-8 bytes as a decimal array. Need to combine them back into a string
 * @param {int} type The barcode type
 */
 exports.barcodeDecimals = function (barcodes, type) {
@@ -132,10 +191,15 @@ exports.barcodeDecimals = function (barcodes, type) {
                
 /**
  * Callback from SDK
- * @param {string} barcode The scanned barcode in hex
+ * @param {string} barcode The scanned barcode in lowercase hex
  * @param {int} type The barcode type
+ * @param {int} seq Scan journal sequence number, 0 if the journal is not open
+ * @param {int} gtin GTIN-14 of retail scans as a number, null for other barcodes. See barcodeData
+ * @param {string} text The payload decoded natively, honouring ECI designators or detecting UTF-8, Shift-JIS and ISO-8859-1. null for binary payloads
+ * @param {string} charset IANA name of the detected character set, e.g. "Shift_JIS", or "binary"
+ * @param {key-value} gs1 GS1 data of the scan, null if it has none. See barcodeData
  */
-exports.barcodeNSData = function (barcode, type) {
+exports.barcodeNSData = function (barcode, type, seq, gtin, text, charset, gs1) {
                
 };
 
@@ -151,8 +215,12 @@ exports.connectionState = function (state) {
  * Called when an wireless card is in the field. Should power off after successful read.
  * @param {int} cardIndex
  * @param {key-value} cardInfo
+ * @param {int} seq Scan journal sequence number, 0 if the journal is not open
+ * @param {key-value} ndef With rfSetNdefReading, the NDEF contents of Type 2 (Ultralight, NTAG) and ISO 15693 tags: records
+ * ({tnf, type, id and payload in hex, uri for URI records, text and lang for Text records, records for Smart Posters}), writable, capacity
+ * and the number of reads it took. null for other cards, unformatted tags or when reading is off
  */
-exports.rfCardDetected = function (cardIndex, cardInfo) {
+exports.rfCardDetected = function (cardIndex, cardInfo, seq, ndef) {
     
 };
 
@@ -161,8 +229,11 @@ exports.rfCardDetected = function (cardIndex, cardInfo) {
  * @param {string} track1
  * @param {string} track2
  * @param {string} track3
+ * @param {key-value} fields Fields parsed from track 1, or track 2 if track 1 is unavailable: pan, name, expiration (YYMM), serviceCode, discretionary. Empty if neither track parses
+ * @param {int} seq Scan journal sequence number, 0 if the journal is not open
+ * @param {key-value} loyalty With msSetLoyaltyReading, loyalty data by loyalty ID if the card is a recognized loyalty card, null otherwise
  */
-exports.magneticCardData = function (track1, track2, track3) {
+exports.magneticCardData = function (track1, track2, track3, fields, seq, loyalty) {
     
 };
 
@@ -179,13 +250,15 @@ exports.magneticCardReadFailed = function (source, reason) {
  * Called when a card is read and the head is encrypted.
  * @param {int} encryption encryption algorithm used
  * @param {int} tracks contain information which tracks are successfully read and inside the encrypted data as bit fields, bit 1 corresponds to track 1, etc, so value of 7 means all tracks are read
- * @param {data} data contains the encrypted card data
+ * @param {string} data contains the encrypted card data in lowercase hex
  * @param {string} track1masked Masked track 1 info
  * @param {string} track2masked Masked track 2 info
  * @param {string} track3 Track 3 info
  * @param {int} source Source
+ * @param {int} seq Scan journal sequence number, 0 if the journal is not open
+ * @param {key-value} loyalty With msSetLoyaltyReading, loyalty data by loyalty ID if the card is a recognized loyalty card, null otherwise
  */
-exports.magneticCardEncryptedData = function (encryption, tracks, data, track1masked, track2masked, track3, source) {
+exports.magneticCardEncryptedData = function (encryption, tracks, data, track1masked, track2masked, track3, source, seq, loyalty) {
     
 };
 
@@ -214,6 +287,106 @@ exports.firmwareUpdateProgress = function (phase, percent) {
 
 };
 
+/**
+ * Called when a POG solution in the pinpad sends event data
+ * @param {int} solution One of POG_SOLUTIONS
+ * @param {int} command Command code specific to the solution
+ * @param {ArrayBuffer} data Event data, empty if the event carries no data
+ */
+exports.pogEventData = function (solution, command, data) {
+
+};
+
+/**
+ * Called for each unacknowledged scan journal entry after journalReplay
+ * @param {int} seq Journal sequence number, pass to journalAcknowledge once the entry is safely processed
+ * @param {string} name The event name, e.g. "barcodeData"
+ * @param {array} args The event arguments, as they were passed to the event callback. Card events are journaled without
+ * clear track data: magneticCardData keeps only the masked PAN, expiration and service code, magneticCardEncryptedData drops track 3
+ */
+exports.journalEntry = function (seq, name, args) {
+
+};
+
+/**
+ * Called after the active configuration profile was applied on connect
+ * @param {key-value} result hash, applied, skipped, savedToFlash, verified, ms. See profileApply
+ */
+exports.profileApplied = function (result) {
+
+};
+
+/**
+ * Called when the active configuration profile could not be applied on connect. Settings that can be read back are restored
+ * @param {string} reason The error reason
+ */
+exports.profileApplyFailed = function (reason) {
+
+};
+
+/**
+ * Called when a part of a multi-part barcode was scanned and held natively, see barcodeSetStructuredAppend
+ * @param {int} id Identifies the payload the part belongs to
+ * @param {int} index Zero based index of the part
+ * @param {int} received Parts of this payload scanned so far
+ * @param {int} total Number of parts
+ */
+exports.barcodePartScanned = function (id, index, received, total) {
+
+};
+
+/**
+ * Called when pending multi-part barcodes were dropped because their remaining parts were not scanned in time
+ * @param {int} count Number of dropped payloads
+ */
+exports.barcodePartsExpired = function (count) {
+
+};
+
+/**
+ * Called when a card that was authenticated with rfAuthenticate leaves the field
+ * @param {int} cardIndex
+ * @param {key-value} session UID, handshakes (authentications run), saved (authentications answered from the session)
+ */
+exports.rfSessionEnded = function (cardIndex, session) {
+
+};
+
+/**
+ * Called when the security watchdog sees the tamper state or the key versions change, and once after every connect
+ * @param {key-value} state ok, tampered, keys: [{keyID, keyVersion}], reason, checkedAt, ageMs, stale, nextCheckMs
+ */
+exports.securityStateChanged = function (state) {
+
+};
+
+/**
+ * Called when an EMV transaction of the universal EMV engine completes, with the Apple VAS result of the same tap
+ * @param {string} data TLV list of the transaction in hex, null when the transaction was cancelled or the device disconnected after a VAS result
+ * @param {key-value} vas Apple VAS result: result, passes: [{tag: value}] with tags and values in hex, one per 0xE8 template,
+ * raw if the TLV could not be parsed completely. null if the tap had no VAS
+ */
+exports.emvTransactionFinished = function (data, vas) {
+
+};
+
+/**
+ * Called when the symbology advisor disabled unused barcode types at the end of a learning window with autoPrune
+ * @param {key-value} result enabled, disabled. See symbologyPrune
+ */
+exports.symbologyPruned = function (result) {
+
+};
+
+/**
+ * Called when pruned barcode types were enabled again
+ * @param {string} reason Why the pruning was rolled back
+ * @param {string} error The error reason if restoring a setting failed, empty otherwise
+ */
+exports.symbologyRolledBack = function (reason, error) {
+
+};
+
 // ******************************
 
 // ***** Available functions ****
@@ -346,7 +519,7 @@ exports.setAutoOffWhenIdle = function (timeIdle, timeDisconnected, error) {
  * @param {function} error The error reason will be passed in if available
  */
 exports.rfInit = function (error) {
-    exec(null, error, 'InfineaSDKCordova', 'rfInit', []);
+    execDirect(null, error, 'rfInit', []);
 };
 
 /**
@@ -354,7 +527,7 @@ exports.rfInit = function (error) {
  * @param {function} error The error reason will be passed in if available
  */
 exports.rfClose = function (error) {
-    exec(null, error, 'InfineaSDKCordova', 'rfClose', []);
+    execDirect(null, error, 'rfClose', []);
 };
 
 /**
@@ -399,7 +572,7 @@ exports.barcodeSetScanMode = function (scanMode, error) {
  * @param {function} error The error reason will be passed in if available
  */
 exports.barcodeStartScan = function (success, error) {
-    exec(success, error, 'InfineaSDKCordova', 'barcodeStartScan', []);
+    execDirect(success, error, 'barcodeStartScan', []);
 };
 
 /**
@@ -408,7 +581,7 @@ exports.barcodeStartScan = function (success, error) {
  * @param {function} error The error reason will be passed in if available
  */
 exports.barcodeStopScan = function (success, error) {
-    exec(success, error, 'InfineaSDKCordova', 'barcodeStopScan', []);
+    execDirect(success, error, 'barcodeStopScan', []);
 };
                
 /**
@@ -487,3 +660,688 @@ exports.emsrGetDeviceInfo = function(success, error){
 exports.barcodeSetScanBeep = function(enabled, beepData, success, error){
                exec(success, error, 'InfineaSDKCordova', 'barcodeSetScanBeep', [enabled, beepData]);
 };
+
+
+/**
+ * Executes a custom command on a POG solution in the pinpad. Commands are queued natively and executed in order,
+ * so the next command can be issued without waiting for the previous reply.
+ * @param {int} solution One of POG_SOLUTIONS
+ * @param {int} command Command id, specific to the selected solution
+ * @param {ArrayBuffer} data Optional command data, pass null if none
+ * @param {function} success The command response will be passed in as ArrayBuffer
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.pogCommand = function (solution, command, data, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'pogCommand', [solution, command, data]);
+};
+
+/**
+ * Get POG throughput counters since launch
+ * @param {function} success Counters keyed by solution will be passed in as key-value: commands, commandErrors, bytesSent, bytesReceived, events, eventBytes
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.pogGetStats = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'pogGetStats', []);
+};
+
+/**
+ * Get the current device-to-host clock correlation. The device clock is sampled on connect and periodically afterwards.
+ * @param {function} success Will receive key-value: samples, offsetMs (device minus host) and driftPPM (null without samples), lastResync (ms since epoch or null)
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.clockGetCorrelation = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'clockGetCorrelation', []);
+};
+
+/**
+ * Configure device clock correlation
+ * @param {int} intervalSeconds Seconds between device clock samples while connected (default 300)
+ * @param {number} resyncThresholdSeconds The device clock is reset from the iOS clock when it is off by more than this (default 2)
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.clockSetCorrelationOptions = function (intervalSeconds, resyncThresholdSeconds, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'clockSetCorrelationOptions', [intervalSeconds, resyncThresholdSeconds]);
+};
+
+/**
+ * Convert a device timestamp to the iOS clock using the current offset and drift estimate
+ * @param {number} deviceTimeMs Device time in ms since epoch
+ * @param {function} success The corrected time in ms since epoch will be passed in
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.clockCorrectDeviceTime = function (deviceTimeMs, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'clockCorrectDeviceTime', [deviceTimeMs]);
+};
+
+/**
+ * Get plugin startup phase timings, in ms since the plugin was initialized. Phases not reached yet are absent:
+ * pluginInitialize, connectStarted, setDeveloperKey, sharedDevice, iqRegistered, developerKeyValidated, connected
+ * @param {function} success The timings will be passed in as key-value
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.getStartupTimings = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'getStartupTimings', []);
+};
+
+/**
+ * Measure round trips of a no-op command over cordova/exec and over the direct command channel
+ * @param {int} iterations Number of sequential round trips per channel
+ * @param {function} success Will receive key-value: iterations, execMs, directMs, execOpsPerSec, directOpsPerSec, direct (false if the direct channel is unavailable and exec was measured twice)
+ */
+exports.benchmarkCommandChannels = function (iterations, success) {
+    function run(send, done) {
+        var remaining = iterations;
+        var start = Date.now();
+        function next() {
+            if (remaining-- <= 0) {
+                done(Date.now() - start);
+                return;
+            }
+            send(next, next, 'ping', [remaining]);
+        }
+        next();
+    }
+
+    run(function (s, e, action, args) { exec(s, e, 'InfineaSDKCordova', action, args); }, function (execMs) {
+        run(execDirect, function (directMs) {
+            success({
+                iterations: iterations,
+                execMs: execMs,
+                directMs: directMs,
+                execOpsPerSec: execMs > 0 ? iterations * 1000 / execMs : 0,
+                directOpsPerSec: directMs > 0 ? iterations * 1000 / directMs : 0,
+                direct: !!directHandler()
+            });
+        });
+    });
+};
+
+/**
+ * Open the scan journal. While open, barcode, card and RF events are appended to a native journal before they are delivered,
+ * and carry their sequence number as last argument. Can also be opened at startup with the InfineaJournal preference.
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.journalOpen = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'journalOpen', []);
+};
+
+/**
+ * Deliver all unacknowledged journal entries to journalEntry, e.g. after the app was killed before syncing
+ * @param {function} success Called after the entries with their count
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.journalReplay = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'journalReplay', []);
+};
+
+/**
+ * Acknowledge all journal entries up to and including seq. The journal is truncated once everything is acknowledged.
+ * @param {int} seq Sequence number
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.journalAcknowledge = function (seq, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'journalAcknowledge', [seq]);
+};
+
+/**
+ * Set how often journal writes are flushed to storage. Entries survive the app being killed immediately, and power loss once flushed.
+ * @param {int} intervalMs Flush at most this long after an entry (default 200)
+ * @param {int} maxRecords Flush after this many entries (default 32)
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.journalSetSyncPolicy = function (intervalMs, maxRecords, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'journalSetSyncPolicy', [intervalMs, maxRecords]);
+};
+
+/**
+ * Export unacknowledged scan journal entries and a telemetry snapshot as a compact LZ4-compressed binary batch, ready for upload.
+ * Compression runs natively on a background queue. See src/core/InfineaExport.h for the format.
+ * The temporary file is protected while the device is locked and is removed by the next exportBatch call, upload or move it before then.
+ * @param {key-value} options journal (default true), telemetry (default true), arrayBuffer (default false, write to a temporary file instead)
+ * @param {function} success Will receive key-value: path (null with arrayBuffer), records, rawBytes, exportBytes, chunks, ms, followed by the ArrayBuffer when requested
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.exportBatch = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'exportBatch', [options || {}]);
+};
+
+/**
+ * Apply a declarative configuration profile and keep it active, also across app launches, so it is re-applied every time the device connects.
+ * The profile is compiled natively into a canonical form and hashed. Persistent settings are saved to device flash, and on later
+ * connects they are only verified by reading back every setting that can be read, while non-persistent settings (scanMode, typeMode, upcZeroStrip, scanBeep, engineInitString,
+ * msr.activeHead, charging) are sent every time. If a setting fails, the ones that can be read back are restored.
+ * @param {key-value} profile Any of: scanMode, scanButtonMode, typeMode, upcZeroStrip, scanBeep {enabled, volume, data},
+ * engineInitString, codeParams {setting: value}, msr {activeHead, encryption, keyID, params, masking {showExpiration, showServiceCode,
+ * unmaskedDigitsAtStart, unmaskedDigitsAtEnd, unmaskedDigitsAfter}}, autoOff {idle, disconnected}, usbChargeCurrent, passThroughSync, charging
+ * @param {function} success Will receive key-value: hash, applied, skipped, savedToFlash, verified (false when no skipped setting could be read back), ms
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.profileApply = function (profile, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'profileApply', [profile]);
+};
+
+/**
+ * Stop re-applying the active configuration profile on connect and forget which profiles devices hold in flash
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.profileClear = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'profileClear', []);
+};
+
+/**
+ * Start collecting barcode type statistics and scan-to-decode latency natively. Starting again resets the counts
+ * @param {key-value} options durationMs (default one day), autoPrune (symbologyPrune options, applied when the window ends),
+ * failureLimit (consecutive failed scans after pruning that roll it back, default 3)
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.symbologyLearn = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'symbologyLearn', [options || {}]);
+};
+
+/**
+ * Get the collected statistics and the proposed minimal set of barcode types
+ * @param {int} minCount Scans a type needs to stay enabled, default 1
+ * @param {function} success Will receive key-value: learning, remainingMs, pruned, enabled, seen [{type, name, count, share}], proposed [type],
+ * before and after pruning {attempts, failures, decodes, latencyMs}
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.symbologyGetAdvice = function (minCount, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'symbologyGetAdvice', [minCount || 1]);
+};
+
+/**
+ * Disable the barcode types that are not in the proposed set. How a type is disabled depends on the barcode engine, so the controls are supplied by the app.
+ * The previous values are read back and restored if scans start failing after pruning, or on symbologyRollback
+ * @param {key-value} options minCount, controls {type: {setting, disable}} for barcodeCodeSetParam, initStrings {type: fragment} for the engine init string,
+ * restoreInitString (engine init string applied on rollback)
+ * @param {function} success Will receive key-value: enabled [type], disabled [type]
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.symbologyPrune = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'symbologyPrune', [options || {}]);
+};
+
+/**
+ * Restore the barcode types disabled by symbologyPrune
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.symbologyRollback = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'symbologyRollback', []);
+};
+
+/**
+ * Normalise a batch of codes, e.g. a catalogue import, to GTIN-14 natively. Accepts UPC-A (with or without the leading zero), EAN-8, EAN-13,
+ * ITF-14 and 8 digit UPC-E, and validates the check digits
+ * @param {array} codes The codes as strings of digits
+ * @param {function} success Will receive an array with a GTIN-14 number per code, null for codes that are not valid GTINs
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.gtinNormalize = function (codes, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'gtinNormalize', [codes || []]);
+};
+
+/**
+ * Set how barcodeNSData payloads are decoded to text
+ * @param {key-value} options eciEscapes (default false): the engine transmits ECI designators as AIM escape sequences (backslash and 6 digits)
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.barcodeSetTextDecoding = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'barcodeSetTextDecoding', [options || {}]);
+};
+
+/**
+ * Reassemble multi-part barcodes natively. Parts are held until all of them were scanned, in any order, and then delivered as one
+ * barcodeNSData with the parts joined in order and their headers removed. barcodePartScanned reports progress
+ * @param {key-value} options enabled (default true), qrHeader (default false): QR payloads that start with the Structured Append header
+ * (position and total - 1 nibbles, then the parity byte) are parts. Only enable it when the scan engine is set up to pass the header through, since
+ * ordinary QR data can look like one; the parity is checked when the last part arrives. pattern: regular expression matching a textual part header at the start of the payload
+ * with named groups index (1 based), total and optionally id, e.g. "(?<id>[A-Z0-9]+)/(?<index>\\d+)/(?<total>\\d+)\\|", ttlMs (default 30000)
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.barcodeSetStructuredAppend = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'barcodeSetStructuredAppend', [options || {}]);
+};
+
+/**
+ * Read and parse the NDEF message of Type 2 and ISO 15693 tags natively before rfCardDetected is called, in two reads for most tags
+ * @param {boolean} enabled Default false
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.rfSetNdefReading = function (enabled, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'rfSetNdefReading', [enabled]);
+};
+
+/**
+ * Update a tag in the field, writing only the pages or blocks that differ from the current contents. NDEF TLV headers are
+ * written last, so a tag pulled early keeps a valid TLV structure
+ * @param {int} cardIndex As passed to rfCardDetected
+ * @param {key-value} options message: hex NDEF message to replace the current one with (Type 2 and ISO 15693 tags), or
+ * data: hex memory image of whole pages or blocks starting at address (default the start of user memory),
+ * invalidate: also clear the message length first when only the records change, so an early pull leaves an empty message (default false)
+ * @param {function} success Called with {written, skipped, commands, reads, ms}, written and skipped count pages or blocks
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.rfWriteTag = function (cardIndex, options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'rfWriteTag', [cardIndex, options || {}]);
+};
+
+/**
+ * Read blocks of several FeliCa services in as few Read Without Encryption commands as the card accepts
+ * @param {int} cardIndex As passed to rfCardDetected
+ * @param {array} ranges [{service, start, count}], service codes as in the FeliCa specification, e.g. 0x090F
+ * @param {function} success Called with {ranges: [{service, start, data}], blocks, frames, ms}, data in hex
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.felicaReadBatch = function (cardIndex, ranges, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'felicaReadBatch', [cardIndex, ranges || []]);
+};
+
+/**
+ * Write blocks of several FeliCa services in as few Write Without Encryption commands as the card accepts
+ * @param {int} cardIndex As passed to rfCardDetected
+ * @param {array} ranges [{service, start, data}], data in hex, whole 16 byte blocks
+ * @param {function} success Called with {blocks, frames, ms}
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.felicaWriteBatch = function (cardIndex, ranges, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'felicaWriteBatch', [cardIndex, ranges || []]);
+};
+
+/**
+ * Authenticate to a card in the field. The card stays authenticated until it leaves the field, so repeating the same
+ * authentication for the same UID returns without another handshake. Ultralight C keeps one authentication, DESFire one per
+ * application and Mifare Classic one per sector. A failed card operation, e.g. a NAK or a DESFire error, forgets the authentications of the card
+ * @param {int} cardIndex As passed to rfCardDetected
+ * @param {key-value} options scheme: "ulc", "desfireAES", "desfire3DES" or "classic", key: hex key (16 bytes, 3DES is 2-key only, Classic 6 bytes),
+ * keyIndex: DESFire key number, app: DESFire application to select first, address: Classic block, type: Classic key "A" or "B",
+ * keySlot: Classic key stored with rfSetStoredKeys, instead of key
+ * @param {function} success Called with {cached, handshakes, saved}, counts are for this tap
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.rfAuthenticate = function (cardIndex, options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'rfAuthenticate', [cardIndex, options || {}]);
+};
+
+/**
+ * Store Mifare Classic keys in the reader's key slots, now and on every connect, so they can be used with keySlot in rfAuthenticate
+ * @param {array} keys [{slot: 0-7, type: "A" or "B", key: 6 bytes hex}], an empty array stops storing keys on connect
+ * @param {function} success Called with the number of keys stored, 0 if not connected
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.rfSetStoredKeys = function (keys, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'rfSetStoredKeys', [keys || []]);
+};
+
+/**
+ * Key and certificate inventory of the connected device. Taken once per device serial and firmware/security version and
+ * stored; later calls return the stored inventory after one emsrGetDeviceInfo per connection. The DUKPT KSNs change with every
+ * transaction and are read live on each call. An inventory with a failed query is returned with complete false and is not stored
+ * @param {key-value} options refresh: query the device even if the versions did not change, ppadKeys: pinpad key IDs (1-49) to include
+ * @param {function} success Called with {certificates: [{slot, version, usage}], emsrKeys: [{keyID, keyVersion, keyName, dukptKSN}],
+ * cryptoKeys: {keyID: version}, ppadKeys: [{keyID, checkValue, type, usage, mode, version}], versions, takenAt, complete, cached, ms}
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.keyInventory = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'keyInventory', [options || {}]);
+};
+
+/**
+ * Drop the stored key inventory of the connected device, call after loading keys or certificates
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.keyInventoryInvalidate = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'keyInventoryInvalidate', []);
+};
+
+/**
+ * Last tamper and key state verified by the security watchdog, answered without a device round trip.
+ * The watchdog checks on connect, then at an interval that doubles up to maxInterval while nothing changes
+ * @param {function} success Called with {ok, tampered, keys: [{keyID, keyVersion}], reason, checkedAt, ageMs, stale, nextCheckMs}
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.securityGetState = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'securityGetState', []);
+};
+
+/**
+ * Confirm the device may take a payment. Answers from the watchdog state right away, and only checks the device when
+ * that state is older than maxAge
+ * @param {function} success Called with the state, see securityGetState
+ * @param {function} error Called with the reason if the device is tampered, a required key is missing or the state could not be verified
+ */
+exports.securityCheckout = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'securityCheckout', []);
+};
+
+/**
+ * Set the security watchdog schedule, omitted options are kept
+ * @param {key-value} options enabled (default true), minInterval (s, default 30), maxInterval (s, default 600),
+ * maxAge: seconds a verified state is trusted by securityCheckout (default 900), requiredKeys: IDs of keys that must be loaded, as in emsrGetKeyVersion
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.securitySetWatchdogOptions = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'securitySetWatchdogOptions', [options || {}]);
+};
+
+/**
+ * Read loyalty data with every magnetic card, it is passed to magneticCardData and magneticCardEncryptedData. A swipe waits
+ * at most 300 ms for it, and gets null if the reader is busy longer
+ * @param {array} loyaltyIDs LOYALTY_ID_* identifiers (1: Lufthansa), empty to turn reading off
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.msSetLoyaltyReading = function (loyaltyIDs, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'msSetLoyaltyReading', [loyaltyIDs || []]);
+};
+
+/**
+ * Set the messages and sounds of the universal EMV engine. The device keeps them for one transaction only, so the table is
+ * kept natively, merged with earlier calls, and uploaded right before every emvStartTransaction. Keep it to the entries
+ * transactions need, each one is a device command
+ * @param {key-value} table messages: [{id: EMV_UI_* message ID, font: FONT_* (default 8x16), message: text or null to disable}],
+ * sounds: [{id: EMV_UI_* message ID, sound: hex or null to disable}]
+ * @param {function} success Called with {entries}, the number of entries in the kept table
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.emvSyncMessages = function (table, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'emvSyncMessages', [table || {}]);
+};
+
+/**
+ * Upload the message table of emvSyncMessages and start a transaction on the universal EMV engine. emvTransactionFinished
+ * reports the outcome
+ * @param {key-value} options interfaces: EMV_INTERFACE_* flags (default contact, contactless and magnetic), flags (default 0),
+ * initData: hex TLV with additional kernel parameters, timeout in seconds (default 60)
+ * @param {function} success Called once the transaction started with {uploaded, failed: [{entry, error}], ms} of the message upload
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.emvStartTransaction = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'emvStartTransaction', [options || {}]);
+};
+
+/**
+ * Cancel the running transaction of the universal EMV engine. A held Apple VAS result is sent with emvTransactionFinished
+ * @param {function} success Called if execution success
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.emvCancelTransaction = function (success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'emvCancelTransaction', []);
+};
+
+/**
+ * Decrypt reader output locally with a test BDK, for load tests without a gateway. Only available in test builds of the plugin,
+ * compiled with INFINEA_TEST_DUKPT defined, and when the InfineaTestDUKPT preference is set. Derived keys are cached per KSN, so the tracks of one swipe derive their key once
+ * @param {key-value} options bdk: base derivation key (hex), aes: AES-128 DUKPT with 12 byte KSNs instead of TDES,
+ * usage: pin, mac, data (default), dataVariant (TDES), dataDecrypt or dataBoth (AES), payloads: [{ksn, data}] in hex, data encrypted in CBC with a zero IV
+ * @param {function} success Called with {payloads: [hex or null if the KSN or length is invalid], keysDerived, keysCached, ms}
+ * @param {function} error The error reason will be passed in if available
+ */
+exports.dukptDecrypt = function (options, success, error) {
+    exec(success, error, 'InfineaSDKCordova', 'dukptDecrypt', [options || {}]);
+};
+
+// ***** Pooled events ****
+// Handlers added with addEventHandler get one reused event object per event name, with binary payloads decoded into
+// a Uint8Array view of a reused buffer instead of new strings and arrays. Both are only valid until the handler
+// returns; a handler that keeps the event calls event.retain() for a copy of its own.
+var pooledHandlers = {};
+var eventPool = {};
+
+function PooledEvent(name) {
+    this.name = name;
+    this.data = null;
+    this.buffer = new Uint8Array(64);
+    this.busy = false;
+}
+
+// Makes event.data a view of the first length bytes of the event's buffer, growing it if needed.
+// The view is only replaced when the length changes, so runs of same sized payloads allocate nothing
+PooledEvent.prototype.reserve = function (length) {
+    if (this.buffer.length < length) {
+        var capacity = this.buffer.length;
+        while (capacity < length) {
+            capacity *= 2;
+        }
+        this.buffer = new Uint8Array(capacity);
+        this.data = null;
+    }
+    if (!this.data || this.data.length !== length) {
+        this.data = this.buffer.subarray(0, length);
+    }
+    return this.data;
+};
+
+/**
+ * Copy of the event that stays valid after the handler returns
+ */
+PooledEvent.prototype.retain = function () {
+    var copy = {};
+    for (var key in this) {
+        if (Object.prototype.hasOwnProperty.call(this, key) && key !== 'buffer' && key !== 'busy') {
+            copy[key] = this[key];
+        }
+    }
+    copy.data = this.data ? this.data.slice() : null;
+    return copy;
+};
+
+function hexInto(event, hex) {
+    var length = hex ? hex.length >> 1 : 0;
+    var data = event.reserve(length);
+    for (var i = 0; i < length; i++) {
+        var high = hex.charCodeAt(2 * i);
+        var low = hex.charCodeAt(2 * i + 1);
+        // '0'-'9' are 0x30-0x39, 'a'-'f' and 'A'-'F' have 0x40 set and map to 10-15 with the low nibble + 9
+        data[i] = (((high & 0x0F) + (high & 0x40 ? 9 : 0)) << 4) | ((low & 0x0F) + (low & 0x40 ? 9 : 0));
+    }
+}
+
+// Fill the pooled event from the arguments native called the handler with. Arguments are passed positionally, an
+// arguments object or array per event would be the allocation the pool is there to avoid
+var eventDecoders = {
+    barcodeData: function (event, barcode, type, seq, gtin, gs1) {
+        event.text = barcode;
+        event.type = type;
+        event.seq = seq;
+        event.gtin = gtin;
+        event.gs1 = gs1;
+    },
+    barcodeDecimals: function (event, decimals, type) {
+        decimals = decimals || [];
+        var data = event.reserve(decimals.length);
+        for (var i = 0; i < decimals.length; i++) {
+            data[i] = +decimals[i];
+        }
+        event.type = type;
+    },
+    barcodeNSData: function (event, barcode, type, seq, gtin, text, charset, gs1) {
+        hexInto(event, barcode);
+        event.type = type;
+        event.seq = seq;
+        event.gtin = gtin;
+        event.text = text;
+        event.charset = charset;
+        event.gs1 = gs1;
+    },
+    rfCardDetected: function (event, cardIndex, cardInfo, seq, ndef) {
+        hexInto(event, cardInfo && cardInfo.UID);
+        event.cardIndex = cardIndex;
+        event.cardInfo = cardInfo;
+        event.seq = seq;
+        event.ndef = ndef;
+    },
+    magneticCardEncryptedData: function (event, encryption, tracks, data, track1masked, track2masked, track3, source, seq, loyalty) {
+        hexInto(event, data);
+        event.encryption = encryption;
+        event.tracks = tracks;
+        event.track1masked = track1masked;
+        event.track2masked = track2masked;
+        event.track3 = track3;
+        event.source = source;
+        event.seq = seq;
+        event.loyalty = loyalty;
+    },
+    pogEventData: function (event, solution, command, data) {
+        var bytes = data ? new Uint8Array(data) : null;
+        event.reserve(bytes ? bytes.length : 0).set(bytes || []);
+        event.solution = solution;
+        event.command = command;
+    }
+};
+
+// Native passes at most 9 arguments to an event
+function dispatchPooled(name, a0, a1, a2, a3, a4, a5, a6, a7, a8) {
+    var event = eventPool[name];
+    // A handler that causes the same event synchronously gets a fresh object, the pooled one is still in use
+    if (event.busy) {
+        event = new PooledEvent(name);
+    }
+    event.busy = true;
+    var decode = eventDecoders[name];
+    if (decode) {
+        decode(event, a0, a1, a2, a3, a4, a5, a6, a7, a8);
+    } else {
+        event.args = [a0, a1, a2, a3, a4, a5, a6, a7, a8];
+    }
+
+    var handlers = pooledHandlers[name];
+    try {
+        for (var i = 0; i < handlers.length; i++) {
+            handlers[i](event);
+        }
+    } finally {
+        event.busy = false;
+    }
+}
+
+/**
+ * Receive an event as a reused event object instead of positional arguments. Binary payloads (barcodeNSData and
+ * barcodeDecimals bytes, the card UID of rfCardDetected, magneticCardEncryptedData and pogEventData data) arrive as
+ * event.data, a Uint8Array; the other arguments keep the names of the event's parameters, events without a decoder
+ * get them as the array event.args. The event and its data are reused for the next event of the same name, call event.retain()
+ * to keep a copy. Assigning Infinea.name afterwards replaces the pooled dispatch
+ * @param {string} name Event name, e.g. barcodeNSData
+ * @param {function} handler Called with the event
+ */
+exports.addEventHandler = function (name, handler) {
+    if (!pooledHandlers[name]) {
+        pooledHandlers[name] = [];
+        eventPool[name] = new PooledEvent(name);
+        var assigned = exports[name];
+        exports[name] = function (a0, a1, a2, a3, a4, a5, a6, a7, a8) {
+            dispatchPooled(name, a0, a1, a2, a3, a4, a5, a6, a7, a8);
+            // Handlers assigned before still get the positional arguments
+            if (typeof assigned === 'function') {
+                assigned.call(exports, a0, a1, a2, a3, a4, a5, a6, a7, a8);
+            }
+        };
+        exports[name].pooledAssigned = assigned;
+    }
+    pooledHandlers[name].push(handler);
+};
+
+/**
+ * Remove a handler added with addEventHandler, the last one restores positional delivery
+ * @param {string} name Event name
+ * @param {function} handler The handler passed to addEventHandler
+ */
+exports.removeEventHandler = function (name, handler) {
+    var handlers = pooledHandlers[name];
+    var index = handlers ? handlers.indexOf(handler) : -1;
+    if (index < 0) {
+        return;
+    }
+    handlers.splice(index, 1);
+    if (!handlers.length) {
+        if (exports[name] && 'pooledAssigned' in exports[name]) {
+            exports[name] = exports[name].pooledAssigned;
+        }
+        delete pooledHandlers[name];
+        delete eventPool[name];
+    }
+};
+
+// ***** Worker delivery ****
+// Events are posted to a Web Worker over a MessageChannel, binary payloads as transferred ArrayBuffers. The worker
+// side is www/InfineaWorker.js, which also sends commands back over the same port.
+
+/**
+ * Deliver events to a Web Worker instead of only the page. The worker loads infinea-worker.js with importScripts and
+ * handles them with InfineaWorker.on; it can issue commands with InfineaWorker.exec. Handlers on the page still run.
+ * The worker's own message handler also sees the {infinea: 'connect'} message that carries the port
+ * @param {Worker} worker The worker
+ * @param {array} names Event names to route, e.g. ['barcodeNSData', 'magneticCardEncryptedData']
+ * @return {key-value} The route, call close() to stop routing
+ */
+exports.routeEventsToWorker = function (worker, names) {
+    var channel = new MessageChannel();
+    var port = channel.port1;
+
+    var forwarders = {};
+    names.forEach(function (name) {
+        forwarders[name] = function (event) {
+            // The copy's buffer is handed to the worker, not copied again
+            var copy = event.retain();
+            port.postMessage({ infinea: 'event', name: name, event: copy }, copy.data ? [copy.data.buffer] : []);
+        };
+        exports.addEventHandler(name, forwarders[name]);
+    });
+
+    port.onmessage = function (message) {
+        var request = message.data;
+        if (!request || request.infinea !== 'exec') {
+            return;
+        }
+        var reply = function (ok) {
+            return function (value) {
+                port.postMessage({ infinea: 'reply', id: request.id, ok: ok, value: value }, value instanceof ArrayBuffer ? [value] : []);
+            };
+        };
+        exec(reply(true), reply(false), 'InfineaSDKCordova', request.action, request.args || []);
+    };
+
+    worker.postMessage({ infinea: 'connect' }, [channel.port2]);
+
+    return {
+        close: function () {
+            Object.keys(forwarders).forEach(function (name) {
+                exports.removeEventHandler(name, forwarders[name]);
+            });
+            forwarders = {};
+            port.close();
+        }
+    };
+};
+
+// ***** Batched event channel ****
+// Native sends queued events together as [name, argc, arg1...argN, name, argc, ...]
+function dispatchEvents(messages) {
+    var i = 0;
+    while (i < messages.length) {
+        var name = messages[i];
+        var argc = messages[i + 1];
+        var handler = exports[name];
+        if (typeof handler === 'function') {
+            handler.apply(exports, messages.slice(i + 2, i + 2 + argc));
+        }
+        i += 2 + argc;
+    }
+}
+
+channel.onCordovaReady.subscribe(function () {
+    exec(function () {
+        dispatchEvents(Array.prototype.slice.call(arguments));
+    }, null, 'InfineaSDKCordova', 'registerEventChannel', []);
+});
@@ -0,0 +1,144 @@
+/**
+ * Worker side of Infinea.routeEventsToWorker. In the worker:
+ *
+ *   importScripts('infinea-worker.js');
+ *   InfineaWorker.on('barcodeNSData', function (event) {
+ *       var code = InfineaWorker.text(event.data, event.charset);
+ *   });
+ *
+ * Events arrive as the copies made by event.retain() on the page: the arguments by parameter name and binary
+ * payloads as event.data, a Uint8Array the worker owns.
+ */
+(function (scope) {
+    var port = null;
+    var handlers = {};
+    var callbacks = {};
+    var callbackId = 0;
+    // Commands issued before the page connected
+    var queued = [];
+    // TextDecoders by charset, null for charsets the engine does not know
+    var decoders = {};
+
+    function decoderFor(charset) {
+        if (typeof TextDecoder !== 'function') {
+            return null;
+        }
+        if (!(charset in decoders)) {
+            try {
+                decoders[charset] = new TextDecoder(charset);
+            } catch (e) {
+                decoders[charset] = null;
+            }
+        }
+        return decoders[charset];
+    }
+
+    function receive(message) {
+        var data = message.data;
+        if (!data) {
+            return;
+        }
+
+        if (data.infinea === 'event') {
+            var list = handlers[data.name];
+            for (var i = 0; list && i < list.length; i++) {
+                list[i](data.event);
+            }
+        } else if (data.infinea === 'reply') {
+            var callback = callbacks[data.id];
+            delete callbacks[data.id];
+            var handler = callback && (data.ok ? callback.success : callback.error);
+            if (typeof handler === 'function') {
+                handler(data.value);
+            }
+        }
+    }
+
+    scope.addEventListener('message', function (message) {
+        if (!message.data || message.data.infinea !== 'connect') {
+            return;
+        }
+        port = message.ports[0];
+        port.onmessage = receive;
+        queued.forEach(function (request) {
+            port.postMessage(request);
+        });
+        queued = [];
+    });
+
+    scope.InfineaWorker = {
+        /**
+         * Handle a routed event
+         * @param {string} name Event name, one of the names passed to routeEventsToWorker
+         * @param {function} handler Called with the event
+         */
+        on: function (name, handler) {
+            (handlers[name] = handlers[name] || []).push(handler);
+        },
+
+        /**
+         * Remove a handler added with on
+         */
+        off: function (name, handler) {
+            var list = handlers[name] || [];
+            var index = list.indexOf(handler);
+            if (index >= 0) {
+                list.splice(index, 1);
+            }
+        },
+
+        /**
+         * Run a plugin command on the page, e.g. exec('barcodeStartScan', [], success, error)
+         * @param {string} action The native action, as passed to cordova exec by the matching Infinea function
+         * @param {array} args Its arguments, ArrayBuffers are copied
+         * @param {function} success Called with the result
+         * @param {function} error The error reason will be passed in if available
+         */
+        exec: function (action, args, success, error) {
+            var id = ++callbackId;
+            callbacks[id] = { success: success, error: error };
+            var request = { infinea: 'exec', id: id, action: action, args: args || [] };
+            if (port) {
+                port.postMessage(request);
+            } else {
+                queued.push(request);
+            }
+        },
+
+        /**
+         * Text of a payload, e.g. the barcode of barcodeNSData or barcodeDecimals. Invalid sequences become U+FFFD,
+         * and without TextDecoder text that is not valid UTF-8 is read as Latin-1
+         * @param {Uint8Array} bytes
+         * @param {string} charset Optional, e.g. event.charset of barcodeNSData, UTF-8 by default or if it is unknown
+         */
+        text: function (bytes, charset) {
+            var decoder = charset === 'binary' ? null : (charset && decoderFor(charset)) || decoderFor('utf-8');
+            if (decoder) {
+                return decoder.decode(bytes);
+            }
+            var text = '';
+            for (var i = 0; i < bytes.length; i++) {
+                text += String.fromCharCode(bytes[i]);
+            }
+            if (charset === 'binary') {
+                return text;
+            }
+            try {
+                return decodeURIComponent(escape(text));
+            } catch (e) {
+                return text;
+            }
+        },
+
+        /**
+         * Lowercase hex of a payload, as the page-side events carry it
+         */
+        hex: function (bytes) {
+            var hex = '';
+            for (var i = 0; i < bytes.length; i++) {
+                hex += (bytes[i] < 16 ? '0' : '') + bytes[i].toString(16);
+            }
+            return hex;
+        }
+    };
+})(self);